@@ -50,8 +50,15 @@ typedef struct IMX676_Context_s
     IsiSensorGain_t SensorGain;
     uint32_t minAfps;
     uint64_t AEStartExposure;
+    bool_t GroupAe;
+    uint32_t GroupSet;
+    uint32_t GroupExp;
+    uint32_t GroupGain;
 } IMX676_Context_t;
 
+#define IMX676_GROUP_EXP     (1 << 0)
+#define IMX676_GROUP_GAIN    (1 << 1)
+
 static RESULT IMX676_IsiSensorSetPowerIss(IsiSensorHandle_t handle, bool_t on)
 {
     int ret = 0;
@@ -211,6 +218,14 @@ static RESULT IMX676_UpdateIsiAEInfo(IsiSensorHandle_t handle)
     if (pIMX676Ctx->CurMode.hdr_mode == SENSOR_MODE_LINEAR) {
         pAeInfo->maxIntTime.linearInt =
             pIMX676Ctx->CurMode.ae_info.max_integration_line * pAeInfo->oneLineExpTime * NANO_MICRO_COEFF;
+        if (pIMX676Ctx->minAfps != 0) {
+            /* The sensor extends the frame down to minAfps for longer exposures */
+            uint32_t afpsLines = 1000000000ULL * 1024 /
+                ((uint64_t)pIMX676Ctx->minAfps * pIMX676Ctx->CurMode.ae_info.one_line_exp_time_ns) -
+                (pIMX676Ctx->CurMode.ae_info.curr_frm_len_lines - pIMX676Ctx->CurMode.ae_info.max_integration_line);
+            if (afpsLines > pIMX676Ctx->CurMode.ae_info.max_integration_line)
+                pAeInfo->maxIntTime.linearInt = afpsLines * pAeInfo->oneLineExpTime * NANO_MICRO_COEFF;
+        }
         pAeInfo->minIntTime.linearInt =
             pIMX676Ctx->CurMode.ae_info.min_integration_line * pAeInfo->oneLineExpTime * NANO_MICRO_COEFF;
         pAeInfo->maxAGain.linearGainParas = pIMX676Ctx->CurMode.ae_info.max_again;
@@ -603,6 +618,13 @@ static RESULT IMX676_IsiSetupSensorIss(IsiSensorHandle_t handle,
     }
 #endif
 
+    /* exposure and gain of a sensor in a sync-group go out together */
+    struct vvcam_group_ae_s GroupAe;
+    memset(&GroupAe, 0, sizeof(GroupAe));
+    ret = ioctl(pHalCtx->sensor_fd, VVSENSORIOC_S_GROUP_AE, &GroupAe);
+    pIMX676Ctx->GroupAe = (ret == 0 && GroupAe.grouped) ? BOOL_TRUE : BOOL_FALSE;
+    pIMX676Ctx->GroupSet = 0;
+
     TRACE(IMX676_INFO, "%s (exit)\n", __func__);
 
     return RET_SUCCESS;
@@ -736,10 +758,60 @@ static RESULT IMX676_IsiGetIntegrationTimeIss(IsiSensorHandle_t handle,
 
 }
 
+/*
+ * Linear exposure and gain of a sensor in a sync-group. Each hook records
+ * its value, and once both ran in an AE cycle, in either order, one
+ * VVSENSORIOC_S_GROUP_AE sends them together. Unchanged values are sent
+ * too, the group commit waits for every streaming sensor of the group.
+ */
+static RESULT IMX676_SetGroupAe(IsiSensorHandle_t handle, uint32_t Set)
+{
+    int ret = 0;
+    struct vvcam_group_ae_s GroupAe;
+    struct vvcam_mode_info_s SensorMode;
+
+    IMX676_Context_t *pIMX676Ctx = (IMX676_Context_t *) handle;
+    HalContext_t *pHalCtx = (HalContext_t *) pIMX676Ctx->IsiCtx.HalHandle;
+
+    pIMX676Ctx->GroupSet |= Set;
+    if (pIMX676Ctx->GroupSet != (IMX676_GROUP_EXP | IMX676_GROUP_GAIN))
+        return RET_SUCCESS;
+    pIMX676Ctx->GroupSet = 0;
+
+    memset(&GroupAe, 0, sizeof(GroupAe));
+    GroupAe.exp = pIMX676Ctx->GroupExp;
+    GroupAe.gain = pIMX676Ctx->GroupGain;
+    ret = ioctl(pHalCtx->sensor_fd, VVSENSORIOC_S_GROUP_AE, &GroupAe);
+    if (ret != 0) {
+        TRACE(IMX676_ERROR,"%s:set sensor group ae error!\n", __func__);
+        return RET_FAILURE;
+    }
+    TRACE(IMX676_INFO, "%s set group exp %u gain %u on frame %u\n", __func__,
+          GroupAe.exp, GroupAe.gain, GroupAe.sequence);
+
+    /* the frame length may have changed with the exposure */
+    ret = ioctl(pHalCtx->sensor_fd, VVSENSORIOC_G_SENSOR_MODE, &SensorMode);
+    if (ret != 0) {
+        TRACE(IMX676_ERROR,"%s:get sensor mode error!\n", __func__);
+        return RET_FAILURE;
+    }
+    memcpy(&pIMX676Ctx->CurMode, &SensorMode, sizeof(struct vvcam_mode_info_s));
+    IMX676_UpdateIsiAEInfo(handle);
+
+    /* S_GROUP_AE writes back the values the sensor was programmed with */
+    pIMX676Ctx->IntLine = GroupAe.exp;
+    pIMX676Ctx->IntTime.IntegrationTime.linearInt =
+        GroupAe.exp * pIMX676Ctx->AeInfo.oneLineExpTime;
+    pIMX676Ctx->SensorGain.gain.linearGainParas = GroupAe.gain;
+
+    return RET_SUCCESS;
+}
+
 static RESULT IMX676_IsiSetIntegrationTimeIss(IsiSensorHandle_t handle,
                                    IsiSensorIntTime_t *pIntegrationTime)
 {
     int ret = 0;
+    RESULT result = RET_SUCCESS;
     uint32_t LongIntLine;
     uint32_t IntLine;
     uint32_t ShortIntLine;
@@ -759,14 +831,27 @@ static RESULT IMX676_IsiSetIntegrationTimeIss(IsiSensorHandle_t handle,
     switch (pIntegrationTime->expoFrmType) {
         case ISI_EXPO_FRAME_TYPE_1FRAME:
             IntLine = pIntegrationTime->IntegrationTime.linearInt;
+            if (pIMX676Ctx->GroupAe) {
+                pIMX676Ctx->GroupExp = IntLine;
+                result = IMX676_SetGroupAe(handle, IMX676_GROUP_EXP);
+                if (result != RET_SUCCESS)
+                    return result;
+                break;
+            }
             if (IntLine != pIMX676Ctx->IntLine) {
-                printf("\n\ngoing into S_EXP ioctl %u\n\n", IntLine);
-                ret = ioctl(pHalCtx->sensor_fd, VVSENSORIOC_S_EXP, &IntLine);
+                struct vvcam_exp_ae_s ExpAe;
+                ExpAe.exp = IntLine;
+                ret = ioctl(pHalCtx->sensor_fd, VVSENSORIOC_S_EXP_AE, &ExpAe);
                 if (ret != 0) {
                     TRACE(IMX676_ERROR,"%s:set sensor linear exp error!\n", __func__);
                     return RET_FAILURE;
                 }
-               pIMX676Ctx->IntLine = IntLine;
+                /* the exposure the sensor was programmed with after clamping */
+                IntLine = ExpAe.exp;
+                pIMX676Ctx->IntLine = IntLine;
+                /* the frame length may have changed with the exposure */
+                memcpy(&pIMX676Ctx->CurMode.ae_info, &ExpAe.ae_info, sizeof(vvcam_ae_info_t));
+                IMX676_UpdateIsiAEInfo(handle);
             }
             TRACE(IMX676_INFO, "%s set linear exp %d \n", __func__,IntLine);
             pIMX676Ctx->IntTime.IntegrationTime.linearInt =  IntLine * oneLineTime;
@@ -868,6 +953,7 @@ static RESULT IMX676_IsiGetGainIss(IsiSensorHandle_t handle, IsiSensorGain_t *pG
 static RESULT IMX676_IsiSetGainIss(IsiSensorHandle_t handle, IsiSensorGain_t *pGain)
 {
     int ret = 0;
+    RESULT result = RET_SUCCESS;
     uint32_t LongGain;
     uint32_t Gain;
     uint32_t ShortGain;
@@ -884,6 +970,13 @@ static RESULT IMX676_IsiSetGainIss(IsiSensorHandle_t handle, IsiSensorGain_t *pG
     switch (pGain->expoFrmType) {
         case ISI_EXPO_FRAME_TYPE_1FRAME:
             Gain = pGain->gain.linearGainParas;
+            if (pIMX676Ctx->GroupAe) {
+                pIMX676Ctx->GroupGain = Gain;
+                result = IMX676_SetGroupAe(handle, IMX676_GROUP_GAIN);
+                if (result != RET_SUCCESS)
+                    return result;
+                break;
+            }
             if (pIMX676Ctx->SensorGain.gain.linearGainParas != Gain) {
                 ret = ioctl(pHalCtx->sensor_fd, VVSENSORIOC_S_GAIN, &Gain);
                 if (ret != 0) {
@@ -891,8 +984,9 @@ static RESULT IMX676_IsiSetGainIss(IsiSensorHandle_t handle, IsiSensorGain_t *pG
                     return RET_FAILURE;
                 }
             }
-            pIMX676Ctx->SensorGain.gain.linearGainParas = pGain->gain.linearGainParas;
-            TRACE(IMX676_INFO, "%s set linear gain %d\n", __func__,pGain->gain.linearGainParas);
+            /* S_GAIN writes back the gain the sensor was programmed with */
+            pIMX676Ctx->SensorGain.gain.linearGainParas = Gain;
+            TRACE(IMX676_INFO, "%s set linear gain %d\n", __func__, Gain);
             break;
         case ISI_EXPO_FRAME_TYPE_2FRAMES:
             Gain = pGain->gain.dualGainParas.dualGain;
@@ -1011,15 +1105,24 @@ static RESULT IMX676_IsiSetSensorFpsIss(IsiSensorHandle_t handle, uint32_t fps)
 }
 static RESULT IMX676_IsiSetSensorAfpsLimitsIss(IsiSensorHandle_t handle, uint32_t minAfps)
 {
+    int ret = 0;
     IMX676_Context_t *pIMX676Ctx = (IMX676_Context_t *) handle;
+    HalContext_t *pHalCtx = (HalContext_t *) pIMX676Ctx->IsiCtx.HalHandle;
 
     TRACE(IMX676_INFO, "%s: (enter)\n", __func__);
 
     if ((minAfps > pIMX676Ctx->CurMode.ae_info.max_fps) ||
         (minAfps < pIMX676Ctx->CurMode.ae_info.min_fps))
         return RET_FAILURE;
+
+    ret = ioctl(pHalCtx->sensor_fd, VVSENSORIOC_S_MIN_AFPS, &minAfps);
+    if (ret != 0) {
+        TRACE(IMX676_ERROR,"%s:set sensor min afps error!\n", __func__);
+        return RET_FAILURE;
+    }
     pIMX676Ctx->minAfps = minAfps;
     pIMX676Ctx->CurMode.ae_info.min_afps = minAfps;
+    IMX676_UpdateIsiAEInfo(handle);
 
     TRACE(IMX676_INFO, "%s: (exit)\n", __func__);
 
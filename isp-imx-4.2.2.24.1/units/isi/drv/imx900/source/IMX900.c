@@ -210,6 +210,14 @@ static RESULT IMX900_UpdateIsiAEInfo(IsiSensorHandle_t handle)
     if (pIMX900Ctx->CurMode.hdr_mode == SENSOR_MODE_LINEAR) {
         pAeInfo->maxIntTime.linearInt =
             pIMX900Ctx->CurMode.ae_info.max_integration_line * pAeInfo->oneLineExpTime * 1000;
+        if (pIMX900Ctx->minAfps != 0) {
+            /* The sensor extends the frame down to minAfps for longer exposures */
+            uint32_t afpsLines = 1000000000ULL * 1024 /
+                ((uint64_t)pIMX900Ctx->minAfps * pIMX900Ctx->CurMode.ae_info.one_line_exp_time_ns) -
+                (pIMX900Ctx->CurMode.ae_info.curr_frm_len_lines - pIMX900Ctx->CurMode.ae_info.max_integration_line);
+            if (afpsLines > pIMX900Ctx->CurMode.ae_info.max_integration_line)
+                pAeInfo->maxIntTime.linearInt = afpsLines * pAeInfo->oneLineExpTime * 1000;
+        }
         pAeInfo->minIntTime.linearInt =
             pIMX900Ctx->CurMode.ae_info.min_integration_line * pAeInfo->oneLineExpTime * 1000;
         pAeInfo->maxAGain.linearGainParas = pIMX900Ctx->CurMode.ae_info.max_again;
@@ -747,13 +755,19 @@ static RESULT IMX900_IsiSetIntegrationTimeIss(IsiSensorHandle_t handle,
         case ISI_EXPO_FRAME_TYPE_1FRAME:
             IntLine = pIntegrationTime->IntegrationTime.linearInt;
             if (IntLine != pIMX900Ctx->IntLine) {
-                printf("\n\ngoing into S_EXP ioctl %u\n\n", IntLine);
-                ret = ioctl(pHalCtx->sensor_fd, VVSENSORIOC_S_EXP, &IntLine);
+                struct vvcam_exp_ae_s ExpAe;
+                ExpAe.exp = IntLine;
+                ret = ioctl(pHalCtx->sensor_fd, VVSENSORIOC_S_EXP_AE, &ExpAe);
                 if (ret != 0) {
                     TRACE(IMX900_ERROR,"%s:set sensor linear exp error!\n", __func__);
                     return RET_FAILURE;
                 }
-               pIMX900Ctx->IntLine = IntLine;
+                /* the exposure the sensor was programmed with after clamping */
+                IntLine = ExpAe.exp;
+                pIMX900Ctx->IntLine = IntLine;
+                /* the frame length may have changed with the exposure */
+                memcpy(&pIMX900Ctx->CurMode.ae_info, &ExpAe.ae_info, sizeof(vvcam_ae_info_t));
+                IMX900_UpdateIsiAEInfo(handle);
             }
             TRACE(IMX900_INFO, "%s set linear exp %d \n", __func__,IntLine);
             pIMX900Ctx->IntTime.IntegrationTime.linearInt =  IntLine * oneLineTime;
@@ -878,8 +892,9 @@ static RESULT IMX900_IsiSetGainIss(IsiSensorHandle_t handle, IsiSensorGain_t *pG
                     return RET_FAILURE;
                 }
             }
-            pIMX900Ctx->SensorGain.gain.linearGainParas = pGain->gain.linearGainParas;
-            TRACE(IMX900_INFO, "%s set linear gain %d\n", __func__,pGain->gain.linearGainParas);
+            /* S_GAIN writes back the gain the sensor was programmed with */
+            pIMX900Ctx->SensorGain.gain.linearGainParas = Gain;
+            TRACE(IMX900_INFO, "%s set linear gain %d\n", __func__, Gain);
             break;
         case ISI_EXPO_FRAME_TYPE_2FRAMES:
             Gain = pGain->gain.dualGainParas.dualGain;
@@ -998,15 +1013,24 @@ static RESULT IMX900_IsiSetSensorFpsIss(IsiSensorHandle_t handle, uint32_t fps)
 }
 static RESULT IMX900_IsiSetSensorAfpsLimitsIss(IsiSensorHandle_t handle, uint32_t minAfps)
 {
+    int ret = 0;
     IMX900_Context_t *pIMX900Ctx = (IMX900_Context_t *) handle;
+    HalContext_t *pHalCtx = (HalContext_t *) pIMX900Ctx->IsiCtx.HalHandle;
 
     TRACE(IMX900_INFO, "%s: (enter)\n", __func__);
 
     if ((minAfps > pIMX900Ctx->CurMode.ae_info.max_fps) ||
         (minAfps < pIMX900Ctx->CurMode.ae_info.min_fps))
         return RET_FAILURE;
+
+    ret = ioctl(pHalCtx->sensor_fd, VVSENSORIOC_S_MIN_AFPS, &minAfps);
+    if (ret != 0) {
+        TRACE(IMX900_ERROR,"%s:set sensor min afps error!\n", __func__);
+        return RET_FAILURE;
+    }
     pIMX900Ctx->minAfps = minAfps;
     pIMX900Ctx->CurMode.ae_info.min_afps = minAfps;
+    IMX900_UpdateIsiAEInfo(handle);
 
     TRACE(IMX900_INFO, "%s: (exit)\n", __func__);
 
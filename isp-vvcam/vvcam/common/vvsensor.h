@@ -100,6 +100,11 @@ enum {
 	VVSENSORIOC_S_DATA_RATE,
 	VVSENSORIOC_S_SYNC_MODE,
 	VVSENSORIOC_S_SHUTTER_MODE,
+	VVSENSORIOC_S_FRAME_QUEUE,
+	VVSENSORIOC_G_FRAME_QUEUE,
+	VVSENSORIOC_S_MIN_AFPS,
+	VVSENSORIOC_S_EXP_AE,
+	VVSENSORIOC_S_GROUP_AE,
 	VVSENSORIOC_MAX,
 };
 
@@ -273,4 +278,71 @@ typedef struct vvcam_lens_s {
 	char name[16];
 } vvcam_lens_t;
 
+#define VVCAM_FRAME_QUEUE_LEN 16
+
+/*
+ * Settings of one frame, in the units of VVSENSORIOC_S_EXP, S_GAIN and
+ * S_FPS. A zero value keeps the current setting. sequence is the CSIS
+ * frame sequence number the setting landed on.
+ */
+typedef struct vvcam_frame_params_s {
+	uint32_t exp;
+	uint32_t gain;
+	uint32_t fps;
+	uint32_t sequence;
+} vvcam_frame_params_t;
+
+/*
+ * VVSENSORIOC_S_FRAME_QUEUE appends count entries, one per frame, count 0
+ * drops the pending ones. VVSENSORIOC_G_FRAME_QUEUE returns the landed
+ * entries and the number still pending.
+ */
+typedef struct vvcam_frame_queue_s {
+	uint32_t count;
+	uint32_t pending;
+	struct vvcam_frame_params_s params[VVCAM_FRAME_QUEUE_LEN];
+} vvcam_frame_queue_t;
+
+/*
+ * VVSENSORIOC_S_EXP_AE sets exp like VVSENSORIOC_S_EXP and returns the
+ * ae_info it left behind. With VVSENSORIOC_S_MIN_AFPS set, an exposure
+ * longer than the frame extends the frame length, lowering cur_fps down
+ * to min_afps.
+ *
+ * On return exp holds the exposure the sensor was programmed with after
+ * clamping, lines and ns the same in integration lines and nanoseconds.
+ * VVSENSORIOC_S_EXP, S_VSEXP, S_GAIN and S_VSGAIN write the programmed
+ * value back to their argument the same way.
+ */
+typedef struct vvcam_exp_ae_s {
+	uint32_t exp;
+	uint32_t lines;
+	uint32_t ns;
+	vvcam_ae_info_t ae_info;
+} vvcam_exp_ae_t;
+
+/*
+ * VVSENSORIOC_S_GROUP_AE stages exposure and gain, in VVSENSORIOC_S_EXP and
+ * VVSENSORIOC_S_GAIN units, 0 keeps the current value. When every streaming
+ * sensor of the "sync-group" has staged its settings they are applied
+ * together on the next frame start. The call blocks until then, sequence
+ * returns the frame start of the commit that applied these settings and
+ * exp and gain the values the sensor was programmed with. It
+ * fails with ETIMEDOUT when the other sensors do not stage in time, or with
+ * EPIPE when the sensor stops streaming first.
+ *
+ * A sensor without a group, or not streaming, applies them right away and
+ * returns sequence 0. grouped returns 1 when the sensor is in a group, exp
+ * and gain both 0 only query it.
+ *
+ * The commit waits for every streaming sensor of the group, so each of
+ * them has to stage every AE cycle, unchanged values included.
+ */
+typedef struct vvcam_group_ae_s {
+	uint32_t exp;
+	uint32_t gain;
+	uint32_t sequence;
+	uint32_t grouped;
+} vvcam_group_ae_t;
+
 #endif
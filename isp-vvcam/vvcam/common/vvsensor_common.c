@@ -0,0 +1,704 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Copyright (c) 2024, Framos.  All rights reserved.
+ *
+ * vvsensor_common.c - helpers shared by the vvcam sensor drivers
+ */
+#include <linux/imx8-mipi-csi2-sam.h>
+#include <linux/kernel.h>
+#include <linux/lockdep.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <linux/uaccess.h>
+#include <media/v4l2-rect.h>
+
+#include "vvsensor_common.h"
+
+void vvsensor_crop_adjust(const struct vvsensor_crop_limits *lim,
+	struct v4l2_rect *r)
+{
+	const struct v4l2_rect *b = &lim->bounds;
+
+	r->width = clamp_t(u32, round_down(r->width, lim->width_step),
+			lim->min_width, b->width);
+	r->height = clamp_t(u32, round_down(r->height, lim->height_step),
+			lim->min_height, b->height);
+	r->left = clamp_t(s32, r->left, b->left, b->left + b->width - r->width);
+	r->left = round_down(r->left, lim->left_step);
+	r->top = clamp_t(s32, r->top, b->top, b->top + b->height - r->height);
+	r->top = round_down(r->top, lim->top_step);
+}
+EXPORT_SYMBOL(vvsensor_crop_adjust);
+
+void vvsensor_crop_size(const struct vvsensor_crop_limits *lim,
+	u32 width, u32 height, vvcam_size_t *size,
+	struct v4l2_mbus_framefmt *fmt)
+{
+	size->bounds_width = width;
+	size->bounds_height = height;
+	size->left = lim->margin_left;
+	size->top = lim->margin_top;
+	size->width = width - lim->margin_width;
+	size->height = height - lim->margin_height;
+
+	fmt->width = width;
+	fmt->height = height;
+}
+EXPORT_SYMBOL(vvsensor_crop_size);
+
+int vvsensor_crop_get_selection(const struct vvsensor_crop_limits *lim,
+	const struct v4l2_rect *crop, const struct v4l2_rect *def,
+	struct v4l2_subdev_selection *sel)
+{
+	switch (sel->target) {
+	case V4L2_SEL_TGT_CROP:
+		sel->r = *crop;
+		return 0;
+	case V4L2_SEL_TGT_CROP_DEFAULT:
+		sel->r = *def;
+		return 0;
+	case V4L2_SEL_TGT_CROP_BOUNDS:
+	case V4L2_SEL_TGT_NATIVE_SIZE:
+		sel->r = lim->bounds;
+		return 0;
+	default:
+		return -EINVAL;
+	}
+}
+EXPORT_SYMBOL(vvsensor_crop_get_selection);
+
+int vvsensor_crop_set_selection(const struct vvsensor_crop_limits *lim,
+	struct v4l2_rect *crop, bool streaming,
+	struct v4l2_subdev_selection *sel)
+{
+	vvsensor_crop_adjust(lim, &sel->r);
+	if (sel->which == V4L2_SUBDEV_FORMAT_TRY ||
+	    v4l2_rect_equal(&sel->r, crop))
+		return 0;
+
+	if (streaming)
+		return -EBUSY;
+
+	*crop = sel->r;
+
+	return 1;
+}
+EXPORT_SYMBOL(vvsensor_crop_set_selection);
+
+#define VVSENSOR_G_FACTOR	1000000000LL
+
+#define VVSENSOR_FQ_EXP		BIT(0)
+#define VVSENSOR_FQ_GAIN	BIT(1)
+
+static struct vvsensor_fq_entry *vvsensor_fq_entry(struct vvsensor_fq *fq, u32 i)
+{
+	return &fq->entry[i % VVCAM_FRAME_QUEUE_LEN];
+}
+
+/*
+ * Commit the queue on the start of frame seq. A setting written now lands
+ * int_update_delay_frm or gain_update_delay_frm frames later, so each
+ * entry gets a target frame that both delays can still reach, the next
+ * entry the frame after it. Called with the sensor lock held.
+ */
+static void vvsensor_fq_commit(struct vvsensor_ctx *ctx, u32 seq)
+{
+	struct vvsensor_fq *fq = &ctx->fq;
+	u32 exp_delay = ctx->mode->ae_info.int_update_delay_frm;
+	u32 gain_delay = ctx->mode->ae_info.gain_update_delay_frm;
+	struct vvsensor_fq_entry *e;
+	u32 target, i;
+
+	if (fq->asg < fq->wr) {
+		target = seq + max(exp_delay, gain_delay);
+		if (fq->cmt < fq->asg && (s32)(fq->last_target + 1 - target) > 0)
+			target = fq->last_target + 1;
+		vvsensor_fq_entry(fq, fq->asg++)->target = target;
+		fq->last_target = target;
+	}
+
+	for (i = fq->cmt; i != fq->asg; i++) {
+		e = vvsensor_fq_entry(fq, i);
+
+		if (!(e->written & VVSENSOR_FQ_EXP) &&
+		    (s32)(seq + exp_delay - e->target) >= 0) {
+			if (e->params.fps)
+				ctx->ops->set_fps(ctx, e->params.fps);
+			if (e->params.exp)
+				ctx->ops->set_exp(ctx, e->params.exp);
+			e->exp_seq = seq + exp_delay;
+			e->written |= VVSENSOR_FQ_EXP;
+		}
+
+		if (!(e->written & VVSENSOR_FQ_GAIN) &&
+		    (s32)(seq + gain_delay - e->target) >= 0) {
+			if (e->params.gain)
+				ctx->ops->set_gain(ctx, e->params.gain);
+			e->gain_seq = seq + gain_delay;
+			e->written |= VVSENSOR_FQ_GAIN;
+		}
+	}
+
+	/* a late frame start moves the landing frame, report the real one */
+	while (fq->cmt != fq->asg) {
+		e = vvsensor_fq_entry(fq, fq->cmt);
+		if (e->written != (VVSENSOR_FQ_EXP | VVSENSOR_FQ_GAIN))
+			break;
+		e->params.sequence = max(e->exp_seq, e->gain_seq);
+		dev_dbg(ctx->dev, "%s: entry %u on frame %u\n", __func__, fq->cmt,
+			e->params.sequence);
+		fq->cmt++;
+	}
+}
+
+/*
+ * Runs in the CSIS irq thread, which must not wait for the sensor lock:
+ * record the frame and leave the i2c writes to the work.
+ */
+static int vvsensor_fq_frame_start(struct notifier_block *nb,
+				unsigned long seq, void *data)
+{
+	struct vvsensor_fq *fq = container_of(nb, struct vvsensor_fq, nb);
+
+	spin_lock(&fq->slock);
+	fq->seq = seq;
+	fq->pending = true;
+	spin_unlock(&fq->slock);
+
+	queue_work(system_highpri_wq, &fq->work);
+
+	return NOTIFY_OK;
+}
+
+/* Frame starts that came in while it waited only commit the latest one */
+static void vvsensor_fq_work(struct work_struct *work)
+{
+	struct vvsensor_ctx *ctx = container_of(work, struct vvsensor_ctx, fq.work);
+	struct vvsensor_fq *fq = &ctx->fq;
+	bool pending;
+	u32 seq;
+
+	mutex_lock(ctx->lock);
+
+	spin_lock(&fq->slock);
+	pending = fq->pending;
+	seq = fq->seq;
+	fq->pending = false;
+	spin_unlock(&fq->slock);
+
+	/* stream off clears active with the lock held */
+	if (pending && fq->active)
+		vvsensor_fq_commit(ctx, seq);
+
+	mutex_unlock(ctx->lock);
+}
+
+/**
+ * AE group, the sensors of one "sync-group" sharing XVS. Settings staged
+ * with VVSENSORIOC_S_GROUP_AE are written on the first frame start after
+ * every streaming member staged its own, with the REGHOLD windows of all
+ * of them opened and closed together, so they land on the same frame.
+ *
+ * The frame start notifiers only record the sequence and queue work, which
+ * takes the staged settings and commits them with the member locks held.
+ * A member flushes that work before it leaves, so the work never sees a
+ * removed sensor.
+ */
+struct vvsensor_group {
+	u32 id;
+	struct vvsensor_ctx *member[VVSENSOR_GROUP_MEMBERS];
+	u32 num;
+	u32 streaming;
+	u32 staged;
+	u32 seq;
+	bool pending;
+	struct work_struct work;
+};
+
+static struct vvsensor_group vvsensor_groups[VVSENSOR_GROUPS];
+static DEFINE_MUTEX(vvsensor_group_lock);
+static DECLARE_WAIT_QUEUE_HEAD(vvsensor_group_wq);
+
+static int vvsensor_group_frame_start(struct notifier_block *nb,
+				unsigned long seq, void *data)
+{
+	struct vvsensor_ctx *ctx = container_of(nb, struct vvsensor_ctx, gm.nb);
+	struct vvsensor_group *group = ctx->gm.group;
+	bool ready;
+
+	mutex_lock(&vvsensor_group_lock);
+	ready = group->staged &&
+		(group->staged & group->streaming) == group->streaming;
+	if (ready) {
+		group->seq = seq;
+		group->pending = true;
+	}
+	mutex_unlock(&vvsensor_group_lock);
+
+	if (!ready)
+		return NOTIFY_DONE;
+
+	queue_work(system_highpri_wq, &group->work);
+
+	return NOTIFY_OK;
+}
+
+static void vvsensor_group_work(struct work_struct *work)
+{
+	struct vvsensor_group *group = container_of(work, struct vvsensor_group, work);
+	struct vvsensor_ctx *member[VVSENSOR_GROUP_MEMBERS];
+	struct vvcam_group_ae_s ae[VVSENSOR_GROUP_MEMBERS];
+	u32 taken[VVSENSOR_GROUP_MEMBERS];
+	u32 i, num = 0, seq;
+
+	mutex_lock(&vvsensor_group_lock);
+	if (!group->pending) {
+		mutex_unlock(&vvsensor_group_lock);
+		return;
+	}
+
+	for (i = 0; i < group->num; i++) {
+		if (!(group->streaming & BIT(i)))
+			continue;
+		member[num] = group->member[i];
+		ae[num] = member[num]->gm.ae;
+		taken[num] = ++member[num]->gm.taken;
+		memset(&member[num]->gm.ae, 0, sizeof(member[num]->gm.ae));
+		num++;
+	}
+	group->staged = 0;
+	group->pending = false;
+	seq = group->seq;
+	mutex_unlock(&vvsensor_group_lock);
+
+	pr_debug("%s: group %u commit on frame %u\n", __func__, group->id, seq);
+
+	for (i = 0; i < num; i++)
+		mutex_lock_nested(member[i]->lock, i);
+
+	/* stream off clears active with the lock held, its settings are dropped */
+	for (i = 0; i < num; i++) {
+		if (!member[i]->gm.active)
+			continue;
+		member[i]->ops->reghold(member[i], 1);
+		member[i]->gm.hold = true;
+	}
+
+	for (i = 0; i < num; i++) {
+		if (!member[i]->gm.active)
+			continue;
+		if (ae[i].exp)
+			member[i]->ops->set_exp(member[i], ae[i].exp);
+		if (ae[i].gain)
+			member[i]->ops->set_gain(member[i], ae[i].gain);
+	}
+
+	for (i = 0; i < num; i++) {
+		if (!member[i]->gm.active)
+			continue;
+		member[i]->gm.hold = false;
+		member[i]->ops->reghold(member[i], 0);
+		member[i]->gm.sequence = seq;
+		WRITE_ONCE(member[i]->gm.commits, taken[i]);
+	}
+
+	while (num--)
+		mutex_unlock(member[num]->lock);
+
+	wake_up_all(&vvsensor_group_wq);
+}
+
+static void vvsensor_fq_register(struct vvsensor_ctx *ctx)
+{
+	struct vvsensor_fq *fq = &ctx->fq;
+	int ret;
+
+	if (fq->registered)
+		return;
+
+	fq->active = true;
+	ret = mipi_csis_frame_sync_register(ctx->dev, &fq->nb);
+	if (ret) {
+		dev_err(ctx->dev, "%s: no CSIS frame start notifications\n", __func__);
+		fq->active = false;
+		return;
+	}
+
+	fq->registered = true;
+}
+
+void vvsensor_init(struct vvsensor_ctx *ctx, struct device *dev,
+	struct mutex *lock, const struct vvsensor_ops *ops,
+	vvcam_mode_info_t *mode)
+{
+	ctx->dev = dev;
+	ctx->lock = lock;
+	ctx->ops = ops;
+	ctx->mode = mode;
+
+	ctx->fq.nb.notifier_call = vvsensor_fq_frame_start;
+	INIT_WORK(&ctx->fq.work, vvsensor_fq_work);
+	spin_lock_init(&ctx->fq.slock);
+
+	ctx->gm.nb.notifier_call = vvsensor_group_frame_start;
+}
+EXPORT_SYMBOL(vvsensor_init);
+
+void vvsensor_cleanup(struct vvsensor_ctx *ctx)
+{
+	struct vvsensor_group *group = ctx->gm.group;
+	u32 i, low;
+
+	mutex_lock(ctx->lock);
+	vvsensor_fq_stream(ctx, 0);
+	vvsensor_group_stream(ctx, 0);
+	mutex_unlock(ctx->lock);
+
+	cancel_work_sync(&ctx->fq.work);
+
+	if (!group)
+		return;
+
+	/* a commit may still hold this sensor, the next ones skip it */
+	flush_work(&group->work);
+
+	mutex_lock(&vvsensor_group_lock);
+	for (i = ctx->gm.index; i + 1 < group->num; i++) {
+		group->member[i] = group->member[i + 1];
+		group->member[i]->gm.index = i;
+	}
+	group->num--;
+
+	low = BIT(ctx->gm.index) - 1;
+	group->streaming = (group->streaming & low) | ((group->streaming >> 1) & ~low);
+	group->staged = (group->staged & low) | ((group->staged >> 1) & ~low);
+	mutex_unlock(&vvsensor_group_lock);
+
+	ctx->gm.group = NULL;
+}
+EXPORT_SYMBOL(vvsensor_cleanup);
+
+void vvsensor_fq_stream(struct vvsensor_ctx *ctx, int enable)
+{
+	struct vvsensor_fq *fq = &ctx->fq;
+
+	lockdep_assert_held(ctx->lock);
+
+	if (enable) {
+		if (fq->wr != fq->cmt)
+			vvsensor_fq_register(ctx);
+		return;
+	}
+
+	fq->active = false;
+	if (fq->registered)
+		mipi_csis_frame_sync_unregister(ctx->dev, &fq->nb);
+	fq->registered = false;
+	fq->asg = fq->cmt;
+	fq->wr = fq->cmt;
+
+	spin_lock(&fq->slock);
+	fq->pending = false;
+	spin_unlock(&fq->slock);
+}
+EXPORT_SYMBOL(vvsensor_fq_stream);
+
+int vvsensor_s_frame_queue(struct vvsensor_ctx *ctx, bool streaming,
+	void __user *arg)
+{
+	struct vvsensor_fq *fq = &ctx->fq;
+	struct vvcam_frame_queue_s queue;
+	u32 i;
+
+	if (copy_from_user(&queue, arg, sizeof(queue)))
+		return -EFAULT;
+
+	if (!queue.count) {
+		fq->asg = fq->cmt;
+		fq->wr = fq->cmt;
+		return 0;
+	}
+
+	if (queue.count > VVCAM_FRAME_QUEUE_LEN - (fq->wr - fq->rd))
+		return -ENOSPC;
+
+	for (i = 0; i < queue.count; i++) {
+		memset(vvsensor_fq_entry(fq, fq->wr), 0, sizeof(struct vvsensor_fq_entry));
+		vvsensor_fq_entry(fq, fq->wr++)->params = queue.params[i];
+	}
+
+	if (streaming)
+		vvsensor_fq_register(ctx);
+
+	return 0;
+}
+EXPORT_SYMBOL(vvsensor_s_frame_queue);
+
+int vvsensor_g_frame_queue(struct vvsensor_ctx *ctx, void __user *arg)
+{
+	struct vvsensor_fq *fq = &ctx->fq;
+	struct vvcam_frame_queue_s queue;
+
+	memset(&queue, 0, sizeof(queue));
+	while (fq->rd != fq->cmt)
+		queue.params[queue.count++] = vvsensor_fq_entry(fq, fq->rd++)->params;
+	queue.pending = fq->wr - fq->cmt;
+
+	if (copy_to_user(arg, &queue, sizeof(queue)))
+		return -EFAULT;
+
+	return 0;
+}
+EXPORT_SYMBOL(vvsensor_g_frame_queue);
+
+u32 vvsensor_afps_propose(struct vvsensor_ctx *ctx, u32 lines, u32 align,
+	struct vvsensor_afps_frame *frame)
+{
+	const vvcam_ae_info_t *ae_info = &ctx->mode->ae_info;
+	const struct vvsensor_afps *afps = &ctx->afps;
+	u32 margin, max_len, len;
+
+	frame->len = 0;
+	frame->base = afps->base;
+	frame->max_integration_line = ae_info->max_integration_line;
+
+	if (ctx->mode->hdr_mode != SENSOR_MODE_LINEAR)
+		return 0;
+
+	frame->base = afps->active ? afps->base : ae_info->curr_frm_len_lines;
+	margin = ae_info->curr_frm_len_lines - ae_info->max_integration_line;
+
+	max_len = frame->base;
+	if (afps->min)
+		max_len = max_t(u32, frame->base,
+				div64_u64((u64)VVSENSOR_G_FACTOR << 10,
+					  (u64)afps->min *
+					  ae_info->one_line_exp_time_ns));
+
+	len = clamp_t(u32, lines + margin, frame->base, max_len);
+	len = ALIGN(len, align);
+	if (len == ae_info->curr_frm_len_lines)
+		return 0;
+
+	frame->len = len;
+	frame->max_integration_line = len - margin;
+
+	return len;
+}
+EXPORT_SYMBOL(vvsensor_afps_propose);
+
+void vvsensor_afps_commit(struct vvsensor_ctx *ctx,
+	const struct vvsensor_afps_frame *frame)
+{
+	vvcam_ae_info_t *ae_info = &ctx->mode->ae_info;
+
+	if (!frame->len)
+		return;
+
+	ctx->afps.base = frame->base;
+	ctx->afps.active = frame->len != frame->base;
+
+	ae_info->curr_frm_len_lines = frame->len;
+	ae_info->max_integration_line = frame->max_integration_line;
+	ae_info->cur_fps = div64_u64((u64)VVSENSOR_G_FACTOR << 10,
+				     (u64)frame->len * ae_info->one_line_exp_time_ns);
+
+	dev_dbg(ctx->dev, "%s: frame length %u, fps %u\n", __func__,
+		frame->len, ae_info->cur_fps >> 10);
+}
+EXPORT_SYMBOL(vvsensor_afps_commit);
+
+void vvsensor_afps_reset(struct vvsensor_ctx *ctx)
+{
+	ctx->afps.active = false;
+}
+EXPORT_SYMBOL(vvsensor_afps_reset);
+
+int vvsensor_set_min_afps(struct vvsensor_ctx *ctx, u32 min_afps)
+{
+	vvcam_ae_info_t *ae_info = &ctx->mode->ae_info;
+
+	if (min_afps && (min_afps < max_t(u32, ae_info->min_fps, 1 << 10) ||
+			 min_afps > ae_info->max_fps))
+		return -EINVAL;
+
+	ctx->afps.min = min_afps;
+	if (min_afps)
+		ae_info->min_afps = min_afps;
+
+	return 0;
+}
+EXPORT_SYMBOL(vvsensor_set_min_afps);
+
+int vvsensor_group_join(struct vvsensor_ctx *ctx, u32 id)
+{
+	struct vvsensor_group *group = NULL;
+	int i, ret = -ENOSPC;
+
+	mutex_lock(&vvsensor_group_lock);
+	for (i = 0; i < VVSENSOR_GROUPS && !group; i++) {
+		if (vvsensor_groups[i].num && vvsensor_groups[i].id == id)
+			group = &vvsensor_groups[i];
+	}
+
+	/* the work of a group left by all members was flushed by the last one */
+	for (i = 0; i < VVSENSOR_GROUPS && !group; i++) {
+		if (!vvsensor_groups[i].num) {
+			group = &vvsensor_groups[i];
+			group->id = id;
+			group->streaming = 0;
+			group->staged = 0;
+			group->pending = false;
+			INIT_WORK(&group->work, vvsensor_group_work);
+		}
+	}
+
+	if (group && group->num < VVSENSOR_GROUP_MEMBERS) {
+		ctx->gm.index = group->num;
+		ctx->gm.group = group;
+		group->member[group->num++] = ctx;
+		ret = 0;
+	}
+	mutex_unlock(&vvsensor_group_lock);
+
+	return ret;
+}
+EXPORT_SYMBOL(vvsensor_group_join);
+
+void vvsensor_group_stream(struct vvsensor_ctx *ctx, int enable)
+{
+	struct vvsensor_group_member *gm = &ctx->gm;
+	int ret;
+
+	lockdep_assert_held(ctx->lock);
+
+	if (!gm->group)
+		return;
+
+	if (enable) {
+		if (gm->active)
+			return;
+
+		ret = mipi_csis_frame_sync_register(ctx->dev, &gm->nb);
+		if (ret) {
+			dev_err(ctx->dev, "%s: no CSIS frame start notifications\n", __func__);
+			return;
+		}
+		WRITE_ONCE(gm->active, true);
+
+		mutex_lock(&vvsensor_group_lock);
+		gm->group->streaming |= BIT(gm->index);
+		mutex_unlock(&vvsensor_group_lock);
+		return;
+	}
+
+	if (!gm->active)
+		return;
+
+	WRITE_ONCE(gm->active, false);
+	mipi_csis_frame_sync_unregister(ctx->dev, &gm->nb);
+
+	mutex_lock(&vvsensor_group_lock);
+	gm->group->streaming &= ~BIT(gm->index);
+	gm->group->staged &= ~BIT(gm->index);
+	memset(&gm->ae, 0, sizeof(gm->ae));
+	mutex_unlock(&vvsensor_group_lock);
+
+	wake_up_all(&vvsensor_group_wq);
+}
+EXPORT_SYMBOL(vvsensor_group_stream);
+
+int vvsensor_s_group_ae(struct vvsensor_ctx *ctx, void __user *arg)
+{
+	struct vvsensor_group_member *gm = &ctx->gm;
+	struct vvsensor_group *group = gm->group;
+	struct vvcam_group_ae_s ae;
+	bool staged = false, taken;
+	u32 want = 0;
+	long left;
+	int ret = 0;
+
+	if (!ctx->ops->reghold || !ctx->ops->get_ae)
+		return -EINVAL;
+
+	if (copy_from_user(&ae, arg, sizeof(ae)))
+		return -EFAULT;
+
+	ae.grouped = !!group;
+	ae.sequence = 0;
+	if (!ae.exp && !ae.gain)
+		goto out;
+
+	if (group) {
+		mutex_lock(&vvsensor_group_lock);
+		if (group->streaming & BIT(gm->index)) {
+			if (ae.exp)
+				gm->ae.exp = ae.exp;
+			if (ae.gain)
+				gm->ae.gain = ae.gain;
+			group->staged |= BIT(gm->index);
+			/* the next commit that takes the staged settings */
+			want = gm->taken + 1;
+			staged = true;
+		}
+		mutex_unlock(&vvsensor_group_lock);
+	}
+
+	if (!staged) {
+		/* no group commit, exposure and gain in one REGHOLD window */
+		mutex_lock(ctx->lock);
+		ret = ctx->ops->reghold(ctx, 1);
+		gm->hold = true;
+		if (ae.exp)
+			ret |= ctx->ops->set_exp(ctx, ae.exp);
+		if (ae.gain)
+			ret |= ctx->ops->set_gain(ctx, ae.gain);
+		gm->hold = false;
+		ret |= ctx->ops->reghold(ctx, 0);
+		ctx->ops->get_ae(ctx, &ae.exp, &ae.gain);
+		mutex_unlock(ctx->lock);
+		if (ret)
+			return ret;
+		goto out;
+	}
+
+	left = wait_event_timeout(vvsensor_group_wq,
+			(s32)(READ_ONCE(gm->commits) - want) >= 0 ||
+			!READ_ONCE(gm->active),
+			msecs_to_jiffies(VVSENSOR_GROUP_TIMEOUT_MS));
+
+	mutex_lock(&vvsensor_group_lock);
+	taken = (s32)(gm->taken - want) >= 0;
+	if (!taken) {
+		group->staged &= ~BIT(gm->index);
+		memset(&gm->ae, 0, sizeof(gm->ae));
+	}
+	mutex_unlock(&vvsensor_group_lock);
+
+	if (!taken)
+		return left ? -EPIPE : -ETIMEDOUT;
+
+	/* a commit that took them may still be writing */
+	flush_work(&group->work);
+
+	mutex_lock(ctx->lock);
+	if ((s32)(gm->commits - want) >= 0) {
+		ae.sequence = gm->sequence;
+		ctx->ops->get_ae(ctx, &ae.exp, &ae.gain);
+	} else
+		ret = -EPIPE;
+	mutex_unlock(ctx->lock);
+	if (ret)
+		return ret;
+
+out:
+	if (copy_to_user(arg, &ae, sizeof(ae)))
+		return -EFAULT;
+
+	return 0;
+}
+EXPORT_SYMBOL(vvsensor_s_group_ae);
+
+MODULE_DESCRIPTION("Helpers shared by the vvcam sensor drivers");
+MODULE_AUTHOR("FRAMOS GmbH");
+MODULE_LICENSE("GPL v2");
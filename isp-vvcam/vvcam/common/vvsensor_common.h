@@ -0,0 +1,354 @@
+/* SPDX-License-Identifier: GPL-2.0
+ *
+ * Copyright (c) 2024, Framos.  All rights reserved.
+ *
+ * vvsensor_common.h - helpers shared by the vvcam sensor drivers
+ */
+
+/**
+ * @file
+ * <b>vvsensor common API: For the vvcam V4L2 sensor drivers.</b>
+ *
+ * @b Description: Defines the helpers the sensor drivers share, the crop
+ *  window handling of the selection API, the per-frame settings queue, the
+ *  automatic frame rate and the AE groups.
+ */
+
+#ifndef __VVSENSOR_COMMON_H__
+#define __VVSENSOR_COMMON_H__
+
+#include <linux/mutex.h>
+#include <linux/notifier.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
+#include <media/v4l2-subdev.h>
+
+#include "vvsensor.h"
+
+/**
+ * \defgroup vvsensor_common vvcam sensor helpers
+ *
+ * Code shared by the vvcam sensor drivers.
+ *
+ * @{
+ */
+
+/**
+ * Crop window limits of a sensor readout.
+ *
+ * The ISP window of the mode starts margin_left and margin_top pixels into
+ * the sensor output and is margin_width and margin_height pixels smaller.
+ */
+struct vvsensor_crop_limits {
+	struct v4l2_rect bounds;
+	u32 min_width;
+	u32 min_height;
+	u32 width_step;
+	u32 height_step;
+	u32 left_step;
+	u32 top_step;
+	u32 margin_left;
+	u32 margin_top;
+	u32 margin_width;
+	u32 margin_height;
+};
+
+/**
+ * @brief  Rounds a crop window to the steps of the sensor and moves it
+ * inside the bounds.
+ *
+ * @param [in]  lim	The crop limits of the sensor.
+ * @param [in]  r	The window, adjusted in place.
+ */
+void vvsensor_crop_adjust(const struct vvsensor_crop_limits *lim,
+	struct v4l2_rect *r);
+
+/**
+ * @brief  Sets the mode size and the pad format for a sensor output of
+ * width x height.
+ *
+ * @param [in]  lim	The crop limits of the sensor.
+ * @param [in]  width	The sensor output width.
+ * @param [in]  height	The sensor output height.
+ * @param [out] size	The mode size reported to the ISI.
+ * @param [out] fmt	The pad format.
+ */
+void vvsensor_crop_size(const struct vvsensor_crop_limits *lim,
+	u32 width, u32 height, vvcam_size_t *size,
+	struct v4l2_mbus_framefmt *fmt);
+
+/**
+ * @brief  Fills the rectangle of a get_selection target.
+ *
+ * @param [in]  lim	The crop limits of the sensor.
+ * @param [in]  crop	The active crop window.
+ * @param [in]  def	The default crop window of the mode.
+ * @param [in]  sel	The selection.
+ *
+ * @return  0 for success, or -EINVAL for an unsupported target.
+ */
+int vvsensor_crop_get_selection(const struct vvsensor_crop_limits *lim,
+	const struct v4l2_rect *crop, const struct v4l2_rect *def,
+	struct v4l2_subdev_selection *sel);
+
+/**
+ * @brief  Adjusts the window of a set_selection call and makes it the
+ * active crop window.
+ *
+ * @param [in]  lim		The crop limits of the sensor.
+ * @param [in]  crop		The active crop window, replaced on success.
+ * @param [in]  streaming	The sensor is streaming.
+ * @param [in]  sel		The selection.
+ *
+ * @return  1 when the active window changed, 0 when it stays, or -EBUSY
+ * while streaming.
+ */
+int vvsensor_crop_set_selection(const struct vvsensor_crop_limits *lim,
+	struct v4l2_rect *crop, bool streaming,
+	struct v4l2_subdev_selection *sel);
+
+struct vvsensor_ctx;
+
+/**
+ * Sensor callbacks, called with the sensor lock held. The values are in
+ * the units of VVSENSORIOC_S_EXP, VVSENSORIOC_S_GAIN and VVSENSORIOC_S_FPS.
+ * reghold writes REGHOLD and get_ae reads back the programmed exposure and
+ * gain, they are only needed by the sensors of an AE group.
+ */
+struct vvsensor_ops {
+	int (*set_exp)(struct vvsensor_ctx *ctx, u32 exp);
+	int (*set_gain)(struct vvsensor_ctx *ctx, u32 gain);
+	int (*set_fps)(struct vvsensor_ctx *ctx, u32 fps);
+	int (*reghold)(struct vvsensor_ctx *ctx, u8 hold);
+	void (*get_ae)(struct vvsensor_ctx *ctx, u32 *exp, u32 *gain);
+};
+
+/** Frame queue entry and the frames its exposure and gain land on. */
+struct vvsensor_fq_entry {
+	struct vvcam_frame_params_s params;
+	u32 target;
+	u32 exp_seq;
+	u32 gain_seq;
+	u8 written;
+};
+
+/**
+ * Per-frame settings, committed on the CSIS frame starts. Entries
+ * [rd, cmt) have landed, [cmt, asg) have a target frame and [asg, wr)
+ * wait for one. The indexes only grow, the ring slot is the index modulo
+ * VVCAM_FRAME_QUEUE_LEN.
+ *
+ * The frame start notifier only records the sequence under slock and
+ * queues work, which commits with the sensor lock held.
+ */
+struct vvsensor_fq {
+	struct vvsensor_fq_entry entry[VVCAM_FRAME_QUEUE_LEN];
+	u32 rd;
+	u32 cmt;
+	u32 asg;
+	u32 wr;
+	u32 last_target;
+	bool active;
+	bool registered;
+	struct notifier_block nb;
+	struct work_struct work;
+	spinlock_t slock;
+	u32 seq;
+	bool pending;
+};
+
+/** Automatic frame rate, see vvsensor_afps_propose(). */
+struct vvsensor_afps {
+	u32 min;
+	u32 base;
+	bool active;
+};
+
+/**
+ * Frame length proposed for an exposure. len is 0 when the frame length
+ * stays, max_integration_line is the limit of the exposure either way.
+ */
+struct vvsensor_afps_frame {
+	u32 len;
+	u32 base;
+	u32 max_integration_line;
+};
+
+#define VVSENSOR_GROUPS		4
+#define VVSENSOR_GROUP_MEMBERS	4
+
+/* How long VVSENSORIOC_S_GROUP_AE waits for the group commit */
+#define VVSENSOR_GROUP_TIMEOUT_MS	500
+
+struct vvsensor_group;
+
+/**
+ * Membership of a sensor in an AE group, the sensors of one "sync-group"
+ * sharing XVS. ae holds the staged settings and taken counts the group
+ * commits that took them, both under the group lock. commits is the last
+ * taken count written and sequence its frame start. They, active and hold
+ * change with the sensor lock held. hold tells the driver that REGHOLD is
+ * already open, so set_exp and set_gain must not open or close it.
+ */
+struct vvsensor_group_member {
+	struct vvsensor_group *group;
+	u32 index;
+	struct vvcam_group_ae_s ae;
+	u32 taken;
+	u32 commits;
+	u32 sequence;
+	bool hold;
+	bool active;
+	struct notifier_block nb;
+};
+
+/**
+ * Shared state of a sensor, embedded in the driver data. The callbacks
+ * get it back to find their sensor with container_of().
+ */
+struct vvsensor_ctx {
+	struct device *dev;
+	struct mutex *lock;
+	const struct vvsensor_ops *ops;
+	vvcam_mode_info_t *mode;
+	struct vvsensor_fq fq;
+	struct vvsensor_afps afps;
+	struct vvsensor_group_member gm;
+};
+
+/**
+ * @brief  Sets up the shared state of a sensor.
+ *
+ * @param [in]  ctx	The shared state.
+ * @param [in]  dev	The sensor device, as known to the CSIS.
+ * @param [in]  lock	The sensor lock, held around every callback.
+ * @param [in]  ops	The sensor callbacks.
+ * @param [in]  mode	The current mode, with its AE limits.
+ */
+void vvsensor_init(struct vvsensor_ctx *ctx, struct device *dev,
+	struct mutex *lock, const struct vvsensor_ops *ops,
+	vvcam_mode_info_t *mode);
+
+/**
+ * @brief  Stops the frame start handling, leaves the AE group and waits for
+ * pending work, called without the sensor lock on remove.
+ *
+ * @param [in]  ctx	The shared state.
+ */
+void vvsensor_cleanup(struct vvsensor_ctx *ctx);
+
+/**
+ * @brief  Starts or stops the frame queue with the stream. Pending entries
+ * are dropped at stream off, landed ones are kept. Called with the sensor
+ * lock held.
+ *
+ * @param [in]  ctx	The shared state.
+ * @param [in]  enable	The stream state.
+ */
+void vvsensor_fq_stream(struct vvsensor_ctx *ctx, int enable);
+
+/**
+ * @brief  VVSENSORIOC_S_FRAME_QUEUE, called with the sensor lock held.
+ *
+ * @param [in]  ctx		The shared state.
+ * @param [in]  streaming	The sensor is streaming.
+ * @param [in]  arg		The user vvcam_frame_queue_s.
+ *
+ * @return  0 for success, -EFAULT or -ENOSPC.
+ */
+int vvsensor_s_frame_queue(struct vvsensor_ctx *ctx, bool streaming,
+	void __user *arg);
+
+/**
+ * @brief  VVSENSORIOC_G_FRAME_QUEUE, called with the sensor lock held.
+ *
+ * @param [in]  ctx	The shared state.
+ * @param [out] arg	The user vvcam_frame_queue_s.
+ *
+ * @return  0 for success, or -EFAULT.
+ */
+int vvsensor_g_frame_queue(struct vvsensor_ctx *ctx, void __user *arg);
+
+/**
+ * @brief  Proposes the frame length for an exposure. With a minimum frame
+ * rate set, an exposure that does not fit into the frame set by S_FPS
+ * extends the frame length, down to that rate, and the frame length goes
+ * back to the S_FPS one once it fits again. Linear modes only.
+ *
+ * Nothing changes until vvsensor_afps_commit(), which the caller calls
+ * once the frame length and the exposure are written.
+ *
+ * @param [in]  ctx	The shared state.
+ * @param [in]  lines	The exposure in integration lines.
+ * @param [in]  align	The frame length step of the sensor.
+ * @param [out] frame	The proposed frame.
+ *
+ * @return  The new frame length, or 0 if the frame length stays.
+ */
+u32 vvsensor_afps_propose(struct vvsensor_ctx *ctx, u32 lines, u32 align,
+	struct vvsensor_afps_frame *frame);
+
+/**
+ * @brief  Makes a proposed frame length the current one in the AE limits.
+ *
+ * @param [in]  ctx	The shared state.
+ * @param [in]  frame	The frame from vvsensor_afps_propose().
+ */
+void vvsensor_afps_commit(struct vvsensor_ctx *ctx,
+	const struct vvsensor_afps_frame *frame);
+
+/**
+ * @brief  Forgets the extended frame length, when S_FPS or a mode change
+ * sets a new one.
+ *
+ * @param [in]  ctx	The shared state.
+ */
+void vvsensor_afps_reset(struct vvsensor_ctx *ctx);
+
+/**
+ * @brief  VVSENSORIOC_S_MIN_AFPS, 0 turns the automatic frame rate off.
+ *
+ * @param [in]  ctx		The shared state.
+ * @param [in]  min_afps	The minimum frame rate, fps << 10.
+ *
+ * @return  0 for success, or -EINVAL outside the frame rates of the mode.
+ */
+int vvsensor_set_min_afps(struct vvsensor_ctx *ctx, u32 min_afps);
+
+/**
+ * @brief  Joins the AE group id, called on probe.
+ *
+ * @param [in]  ctx	The shared state.
+ * @param [in]  id	The "sync-group" of the sensor.
+ *
+ * @return  0 for success, or -ENOSPC when no group or member is free.
+ */
+int vvsensor_group_join(struct vvsensor_ctx *ctx, u32 id);
+
+/**
+ * @brief  Starts or stops the group commits of the sensor with the stream.
+ * Staged settings are dropped at stream off. Called with the sensor lock
+ * held.
+ *
+ * @param [in]  ctx	The shared state.
+ * @param [in]  enable	The stream state.
+ */
+void vvsensor_group_stream(struct vvsensor_ctx *ctx, int enable);
+
+/**
+ * @brief  VVSENSORIOC_S_GROUP_AE. Called without the sensor lock, as it
+ * waits for the group commit.
+ *
+ * @param [in]  ctx	The shared state.
+ * @param [in]  arg	The user vvcam_group_ae_s.
+ *
+ * @return  0 for success, -EFAULT, -EINVAL without REGHOLD support,
+ * -ETIMEDOUT when no group commit took the settings in time, which drops
+ * them, or -EPIPE when the stream stopped first.
+ */
+int vvsensor_s_group_ae(struct vvsensor_ctx *ctx, void __user *arg);
+
+/** @} */
+
+#endif /* __VVSENSOR_COMMON_H__ */
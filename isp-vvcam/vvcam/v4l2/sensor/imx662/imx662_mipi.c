@@ -18,12 +18,14 @@
 #include <linux/device.h>
 #include <linux/gpio.h>
 #include <linux/i2c.h>
+#include <linux/imx8-mipi-csi2-sam.h>
 #include <linux/init.h>
 #include <linux/module.h>
 #include <linux/of.h>
 #include <linux/of_device.h>
 #include <linux/of_gpio.h>
 #include <linux/pinctrl/consumer.h>
+#include <linux/pm_runtime.h>
 #include <linux/regmap.h>
 #include <linux/regulator/consumer.h>
 #include <linux/seq_file.h>
@@ -31,11 +33,15 @@
 #include <linux/uaccess.h>
 #include <linux/version.h>
 #include <linux/v4l2-mediabus.h>
+#include <media/mipi-csi2.h>
 #include <media/v4l2-device.h>
 #include <media/v4l2-ctrls.h>
+#include <media/v4l2-event.h>
 #include <media/v4l2-fwnode.h>
+#include <media/v4l2-rect.h>
 
 #include "vvsensor.h"
+#include "vvsensor_common.h"
 #include "imx662_regs.h"
 #include "max96792.h"
 #include "max96793.h"
@@ -86,13 +92,20 @@
 #define IMX662_LINE_TIME_H990            13333 // in ns
 #define IMX662_LINE_TIME_H660            8904  //in ns
 
+/* Window cropping limits */
+#define IMX662_CROP_MIN_WIDTH		256
+#define IMX662_CROP_MIN_HEIGHT		64
+#define IMX662_CROP_WIDTH_STEP		16
+#define IMX662_CROP_HEIGHT_STEP		4
+#define IMX662_CROP_POS_STEP		2
+
 #define V4L2_CID_DATA_RATE              (V4L2_CID_USER_IMX_BASE + 1)
 #define V4L2_CID_SYNC_MODE              (V4L2_CID_USER_IMX_BASE + 2)
 #define V4L2_CID_FRAME_RATE             (V4L2_CID_USER_IMX_BASE + 3)
 #define V4L2_CID_VS_EXP                 (V4L2_CID_USER_IMX_BASE + 4)
 #define V4L2_CID_VS_GAIN                (V4L2_CID_USER_IMX_BASE + 5)
 #define V4L2_CID_EXP_GAIN               (V4L2_CID_USER_IMX_BASE + 6)
-#define V4L2_NUM_CTRLS                  10
+#define V4L2_NUM_CTRLS                  12
 
 enum mode_index {
 	IMX662_ALL_PIXEL_INDEX,
@@ -104,6 +117,42 @@ enum mode_index {
 	IMX662_MAX_INDEX
 };
 
+/* Default window of each mode, in pixel array coordinates */
+static const struct v4l2_rect imx662_mode_crop[IMX662_MAX_INDEX] = {
+	[IMX662_ALL_PIXEL_INDEX] = {
+		0, 0, IMX662_PIXEL_ARRAY_WIDTH, IMX662_PIXEL_ARRAY_HEIGHT,
+	},
+	[IMX662_CROP_INDEX] = {
+		320, 180, 1296, 740,
+	},
+	[IMX662_BINNING_INDEX] = {
+		0, 0, IMX662_PIXEL_ARRAY_WIDTH, IMX662_PIXEL_ARRAY_HEIGHT,
+	},
+	[IMX662_BINNING_CROP_INDEX] = {
+		320, 60, 1296, 980,
+	},
+	[IMX662_DOL_INDEX] = {
+		0, 0, IMX662_PIXEL_ARRAY_WIDTH, IMX662_PIXEL_ARRAY_HEIGHT,
+	},
+	[IMX662_CLEAR_INDEX] = {
+		0, 0, IMX662_PIXEL_ARRAY_WIDTH, IMX662_PIXEL_ARRAY_HEIGHT,
+	},
+};
+
+static const struct vvsensor_crop_limits imx662_crop_limits = {
+	.bounds = { 0, 0, IMX662_PIXEL_ARRAY_WIDTH, IMX662_PIXEL_ARRAY_HEIGHT },
+	.min_width = IMX662_CROP_MIN_WIDTH,
+	.min_height = IMX662_CROP_MIN_HEIGHT,
+	.width_step = IMX662_CROP_WIDTH_STEP,
+	.height_step = IMX662_CROP_HEIGHT_STEP,
+	.left_step = IMX662_CROP_POS_STEP,
+	.top_step = IMX662_CROP_POS_STEP,
+	.margin_left = 8,
+	.margin_top = 12,
+	.margin_width = 16,
+	.margin_height = 20,
+};
+
 static const struct of_device_id imx662_of_match[] = {
 	{ .compatible = "framos,imx662" },
 	{ /* sentinel */ }
@@ -189,6 +238,28 @@ const char * const imx662_sync_mode_menu[] = {
 	[EXTERNAL_SYNC] = "External sync",
 };
 
+/*
+ * CSI-2 link frequencies reported through V4L2_CID_LINK_FREQ, the sensor
+ * rates are indexed by the data rate control and followed by the
+ * deserializer output rates of a GMSL link.
+ */
+static const s64 imx662_link_freq_menu[] = {
+	1188000000,
+	1039500000,
+	891000000,
+	720000000,
+	594000000,
+	445500000,
+	360000000,
+	297000000,
+	/* GMSL deserializer CSI rates */
+	500000000,
+	600000000,
+	750000000,
+};
+
+#define IMX662_LINK_FREQ_GMSL (IMX662_594_MBPS + 1)
+
 static const struct v4l2_ctrl_ops imx662_ctrl_ops;
 
 static struct v4l2_ctrl_config imx662_ctrl_data_rate[] = {
@@ -277,12 +348,46 @@ struct imx662_ctrls {
 	struct v4l2_ctrl *framerate;
 	struct v4l2_ctrl *black_level;
 	struct v4l2_ctrl *data_rate;
+	struct v4l2_ctrl *link_freq;
+	struct v4l2_ctrl *pixel_rate;
 	struct v4l2_ctrl *sync_mode;
 	struct v4l2_ctrl *vs_exp;
 	struct v4l2_ctrl *vs_gain;
 	struct v4l2_ctrl *exp_gain;
 };
 
+/* AE registers written at runtime, replayed after a mode restore */
+static const u16 imx662_shadow_regs[] = {
+	VMAX_LOW,
+	VMAX_MID,
+	VMAX_HIGH,
+	SHR0_LOW,
+	SHR0_MID,
+	SHR0_HIGH,
+	SHR1_LOW,
+	RHS1_LOW,
+	RHS1_MID,
+	RHS1_HIGH,
+	GAIN_LOW,
+	GAIN_HIGH,
+	GAIN_1_LOW,
+	GAIN_1_HIGH,
+	EXP_GAIN,
+	BLKLEVEL_LOW,
+	BLKLEVEL_HIGH,
+};
+
+/*
+ * Exposure and gain programmed by the last set_exp, set_vs_exp, set_gain
+ * and set_vs_gain, after clamping.
+ */
+struct imx662_applied {
+	u32 exp_lines;
+	u32 vs_exp_lines;
+	u32 gain_reg;
+	u32 vs_gain_reg;
+};
+
 struct imx662 {
 	struct i2c_client *i2c_client;
 	unsigned int rst_gpio;
@@ -294,6 +399,7 @@ struct imx662 {
 
 	struct v4l2_mbus_framefmt format;
 	vvcam_mode_info_t cur_mode;
+	struct v4l2_rect crop;
 	struct mutex lock;
 	u32 stream_status;
 	u32 resume_status;
@@ -302,6 +408,12 @@ struct imx662 {
 	struct device *ser_dev;
 	struct device *dser_dev;
 	struct gmsl_link_ctx g_ctx;
+	u32 sync_mode;
+	u8 shadow_val[ARRAY_SIZE(imx662_shadow_regs)];
+	u32 shadow_valid;
+	bool mode_applied;
+	struct vvsensor_ctx vs;
+	struct imx662_applied applied;
 };
 
 #define client_to_imx662(client)\
@@ -617,6 +729,19 @@ static struct vvcam_mode_info_s pimx662_mode_info[] = {
 	},
 };
 
+static void imx662_shadow_update(struct imx662 *sensor, u16 reg, u8 val)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(imx662_shadow_regs); i++) {
+		if (imx662_shadow_regs[i] == reg) {
+			sensor->shadow_val[i] = val;
+			sensor->shadow_valid |= BIT(i);
+			return;
+		}
+	}
+}
+
 static int imx662_write_reg(struct imx662 *sensor, u16 reg, u8 val)
 {
 	struct device *dev = &sensor->i2c_client->dev;
@@ -646,6 +771,8 @@ static int imx662_write_reg(struct imx662 *sensor, u16 reg, u8 val)
 	if (num_retry > 0)
 		dev_warn(dev, "i2c communication passed after %d retries: reg=%x", num_retry, reg);
 
+	imx662_shadow_update(sensor, reg, val);
+
 	return 0;
 }
 
@@ -922,6 +1049,8 @@ static int imx662_set_sensor_mode(struct imx662 *sensor, void *pmode)
 		if (pimx662_mode_info[i].index == sensor_mode.index) {
 			memcpy(&sensor->cur_mode, &pimx662_mode_info[i],
 				sizeof(struct vvcam_mode_info_s));
+			vvsensor_afps_reset(&sensor->vs);
+			sensor->crop = imx662_mode_crop[sensor->cur_mode.index];
 			return 0;
 		}
 	}
@@ -958,7 +1087,11 @@ static int imx662_adjust_hmax_register(struct imx662 *sensor)
 		hmax = 660;
 	}
 	else if (data_rate == IMX662_594_MBPS) {
-		hmax = binning_mode ? 660 : 990;
+		/* a 10 bit line fits into the shorter line time at this rate */
+		if (binning_mode || sensor->cur_mode.bit_width == 10)
+			hmax = 660;
+		else
+			hmax = 990;
 	} else {
 		pr_err("%s: Invalid data rate %u and binning %d combination.\n", __func__, data_rate, binning_mode);
 		return -1;
@@ -1037,6 +1170,95 @@ change_datarate:
 	return ret;
 }
 
+/*
+ * Select the lowest GMSL link and deserializer CSI rates that carry the
+ * active mode, from the payload of one line per line time.
+ */
+static int imx662_gmsl_set_bandwidth(struct imx662 *sensor)
+{
+	struct device *dev = &sensor->i2c_client->dev;
+	u64 bandwidth;
+	u32 rate, prev_rate;
+	int err = 0;
+
+	if (strcmp(sensor->gmsl, "gmsl") || !sensor->cur_mode.ae_info.one_line_exp_time_ns)
+		return 0;
+
+	bandwidth = (u64)sensor->cur_mode.size.bounds_width *
+		sensor->cur_mode.bit_width * NSEC_PER_SEC;
+	bandwidth = div_u64(bandwidth, sensor->cur_mode.ae_info.one_line_exp_time_ns);
+	if (sensor->cur_mode.hdr_mode != SENSOR_MODE_LINEAR)
+		bandwidth *= 2;
+
+	rate = max96792_get_link_rate(bandwidth);
+	prev_rate = sensor->g_ctx.link_rate;
+	if (rate != prev_rate) {
+		err = max96793_set_link_rate(sensor->ser_dev, rate);
+		if (!err)
+			err = max96792_set_link_rate(sensor->dser_dev, dev, rate);
+		if (err) {
+			dev_err(dev, "%s: unable to change gmsl link rate\n", __func__);
+			/* put both ends back on the previous rate and relink */
+			if (max96793_set_link_rate(sensor->ser_dev, prev_rate) ||
+			    max96792_set_link_rate(sensor->dser_dev, dev, prev_rate))
+				dev_err(dev, "%s: unable to restore gmsl link rate\n",
+					__func__);
+			return err;
+		}
+	}
+
+	return max96792_set_csi_bandwidth(sensor->dser_dev, dev, bandwidth);
+}
+
+/* Only the linear modes without binning take an arbitrary window */
+static bool imx662_crop_supported(struct imx662 *sensor)
+{
+	return sensor->cur_mode.index == IMX662_ALL_PIXEL_INDEX ||
+	       sensor->cur_mode.index == IMX662_CROP_INDEX;
+}
+
+static bool imx662_crop_is_default(struct imx662 *sensor)
+{
+	return v4l2_rect_equal(&sensor->crop,
+			&imx662_mode_crop[sensor->cur_mode.index]);
+}
+
+/*
+ * The shortest frame of a cropped readout is the window height plus a
+ * fixed number of lines, the frame rate limit follows from the line time.
+ * Called with sensor->lock held.
+ */
+static int imx662_update_framerate_range(struct imx662 *sensor)
+{
+	vvcam_ae_info_t *ae_info = &sensor->cur_mode.ae_info;
+	u32 min_vmax, i;
+
+	if (!imx662_crop_supported(sensor) || !ae_info->one_line_exp_time_ns)
+		return 0;
+
+	if (imx662_crop_is_default(sensor)) {
+		/* the mode table limit holds for the default window */
+		for (i = 0; i < ARRAY_SIZE(pimx662_mode_info); i++) {
+			if (pimx662_mode_info[i].index == sensor->cur_mode.index)
+				ae_info->max_fps = pimx662_mode_info[i].ae_info.max_fps;
+		}
+	} else {
+		min_vmax = ALIGN(sensor->crop.height + IMX662_MIN_FRAME_LENGTH_DELTA, 2);
+		ae_info->max_fps = div_u64(IMX662_G_FACTOR << 10,
+				min_vmax * ae_info->one_line_exp_time_ns);
+		pr_debug("%s: min vmax %u\n", __func__, min_vmax);
+	}
+	if (ae_info->cur_fps > ae_info->max_fps)
+		ae_info->cur_fps = ae_info->max_fps;
+
+	pr_debug("%s: max fps %u\n", __func__, ae_info->max_fps >> 10);
+
+	return __v4l2_ctrl_modify_range(sensor->ctrls.framerate,
+			sensor->ctrls.framerate->minimum, ae_info->max_fps >> 10, 1,
+			min_t(s64, sensor->ctrls.framerate->default_value,
+			      ae_info->max_fps >> 10));
+}
+
 static int imx662_set_data_rate(struct imx662 *sensor, u8 data_rate)
 {
 	int ret = 0;
@@ -1053,7 +1275,12 @@ static int imx662_set_data_rate(struct imx662 *sensor, u8 data_rate)
 		pr_err("%s: unable to adjust hmax\n", __func__);
 		return ret;
 	}
-	return ret;
+
+	ret = imx662_update_framerate_range(sensor);
+	if (ret < 0)
+		return ret;
+
+	return imx662_gmsl_set_bandwidth(sensor);
 }
 
 /**
@@ -1069,17 +1296,15 @@ static int imx662_set_data_rate(struct imx662 *sensor, u8 data_rate)
 static int imx662_configure_triggering_pins(struct imx662 *sensor)
 {
 	int err = 0;
-	u8 extmode;
 	u8 xvs_xhs_drv = 0xF;
 
 	pr_debug("enter %s function\n", __func__);
-	err = imx662_read_reg(sensor, EXTMODE, &extmode);
 
-	if (extmode == INTERNAL_SYNC) {
+	if (sensor->sync_mode == INTERNAL_SYNC) {
 		/* XVS - output, XHS - output */
 		xvs_xhs_drv = 0x0;
 		pr_debug("%s: Sensor is in - Internal sync Master mode\n", __func__);
-	} else if (extmode == EXTERNAL_SYNC) {
+	} else if (sensor->sync_mode == EXTERNAL_SYNC) {
 		/* XVS - hi-z, XHS - output */
 		xvs_xhs_drv = 0x3;
 		pr_debug("%s: Sensor is in - External sync Master mode\n", __func__);
@@ -1100,6 +1325,27 @@ static int imx662_configure_triggering_pins(struct imx662 *sensor)
 	return 0;
 }
 
+static int imx662_gmsl_sync_setup(struct imx662 *sensor, u32 val)
+{
+	struct device *dev = &sensor->i2c_client->dev;
+	int err;
+
+	if (val == NO_SYNC) {
+		max96792_sync_leave(sensor->dser_dev, dev);
+		return 0;
+	}
+
+	sensor->g_ctx.sync_master = (val == INTERNAL_SYNC);
+
+	/* master serializer sends XVS over the link, slaves drive it */
+	err = max96793_xvs_setup(sensor->ser_dev,
+		sensor->g_ctx.sync_master ? max96793_IN : max96793_OUT);
+	if (err)
+		return err;
+
+	return max96792_sync_join(sensor->dser_dev, &sensor->g_ctx);
+}
+
 /**
  * Synchronization mode is for Master mode
  * Sensor can be synchronized Externaly and Internaly in Master mode
@@ -1111,6 +1357,8 @@ static int imx662_set_sync_mode(struct imx662 *sensor, u32 val)
 
 	pr_debug("enter %s sync mode %u\n", __func__, val);
 
+	sensor->sync_mode = val;
+
 	if (val == EXTERNAL_SYNC)
 		extmode = 1;
 	else
@@ -1130,9 +1378,26 @@ static int imx662_set_sync_mode(struct imx662 *sensor, u32 val)
 		return -EINVAL;
 	}
 
+	if (!(strcmp(sensor->gmsl, "gmsl")) && sensor->g_ctx.sync_group) {
+		err = imx662_gmsl_sync_setup(sensor, val);
+		if (err < 0) {
+			pr_err("%s: unable to set up gmsl sync group\n", __func__);
+			return err;
+		}
+	}
+
 	return err;
 }
 
+/* A group commit holds REGHOLD across all members, see vvsensor_common */
+static int imx662_reghold(struct imx662 *sensor, u8 hold)
+{
+	if (sensor->vs.gm.hold)
+		return 0;
+
+	return imx662_write_reg(sensor, REGHOLD, hold);
+}
+
 static int imx662_set_exp(struct imx662 *sensor, u32 exp, u8 which_control)
 {
 	int ret = 0;
@@ -1140,6 +1405,8 @@ static int imx662_set_exp(struct imx662 *sensor, u32 exp, u8 which_control)
 	u32 reg_shr0 = 0;
 	u32 min_shr0 = IMX662_MIN_SHR0_LENGTH;
 	u32 frame_length;
+	u32 vmax;
+	struct vvsensor_afps_frame afps;
 
 	pr_debug("enter %s exposure received: %u control: %u\n", __func__, exp, which_control);
 
@@ -1152,10 +1419,14 @@ static int imx662_set_exp(struct imx662 *sensor, u32 exp, u8 which_control)
 		integration_time_line = (exp * IMX662_K_FACTOR) / sensor->cur_mode.ae_info.one_line_exp_time_ns;
 	}
 
-	if (integration_time_line > sensor->cur_mode.ae_info.max_integration_line) {
+	vmax = vvsensor_afps_propose(&sensor->vs, integration_time_line, 2, &afps);
+	if (vmax)
+		frame_length = vmax;
+
+	if (integration_time_line > afps.max_integration_line) {
 		pr_info("%s: setting integration time to max value %u\n", __func__,
-			sensor->cur_mode.ae_info.max_integration_line);
-		integration_time_line = sensor->cur_mode.ae_info.max_integration_line;
+			afps.max_integration_line);
+		integration_time_line = afps.max_integration_line;
 		}
 
 	if (integration_time_line < sensor->cur_mode.ae_info.min_integration_line) {
@@ -1197,11 +1468,25 @@ static int imx662_set_exp(struct imx662 *sensor, u32 exp, u8 which_control)
 	reg_shr0 = max_t(u32, min_shr0, reg_shr0);
 
 	pr_debug("%s: exposure register: %u integration_time_line: %u\n", __func__, reg_shr0, integration_time_line);
-	ret = imx662_write_reg(sensor, REGHOLD, 1);
+	ret = imx662_reghold(sensor, 1);
+	if (vmax) {
+		ret |= imx662_write_reg(sensor, VMAX_HIGH, (vmax >> 16) & 0xff);
+		ret |= imx662_write_reg(sensor, VMAX_MID, (vmax >> 8) & 0xff);
+		ret |= imx662_write_reg(sensor, VMAX_LOW, vmax & 0xff);
+	}
 	ret |= imx662_write_reg(sensor, SHR0_HIGH, (reg_shr0 >> 16) & 0xff);
 	ret |= imx662_write_reg(sensor, SHR0_MID, (reg_shr0 >> 8) & 0xff);
 	ret |= imx662_write_reg(sensor, SHR0_LOW, reg_shr0 & 0xff);
-	ret |= imx662_write_reg(sensor, REGHOLD, 0);
+	ret |= imx662_reghold(sensor, 0);
+
+	/* the frame length is only the new one once it is written */
+	if (!ret)
+		vvsensor_afps_commit(&sensor->vs, &afps);
+
+	if (sensor->cur_mode.index == IMX662_DOL_INDEX)
+		sensor->applied.exp_lines = 2 * frame_length - reg_shr0;
+	else
+		sensor->applied.exp_lines = frame_length - reg_shr0;
 
 	if (ret < 0)
 		pr_err("%s Failed to set exposure exp: %u, shr register:  %u\n", __func__, exp, reg_shr0);
@@ -1289,6 +1574,7 @@ static int imx662_set_vs_exp(struct imx662 *sensor, u32 exp, unsigned int which_
 	ret |= imx662_write_reg(sensor, RHS1_MID, (reg_rhs1 >> 8) & 0xff);
 	ret |= imx662_write_reg(sensor, RHS1_HIGH, (reg_rhs1 >> 16) & 0xff);
 	ret |= imx662_write_reg(sensor, REGHOLD, 0);
+	sensor->applied.vs_exp_lines = reg_rhs1 - reg_shr1;
 
 	if (ret < 0) {
 		pr_err("%s Failed to set vs exposure :\n", __func__);
@@ -1364,10 +1650,11 @@ static int imx662_set_gain(struct imx662 *sensor, u32 gain, u8 which_control)
 	}
 
 	pr_debug("enter %s gain register: %u\n", __func__, gain_reg);
-	ret = imx662_write_reg(sensor, REGHOLD, 1);
+	ret = imx662_reghold(sensor, 1);
 	ret |= imx662_write_reg(sensor, GAIN_HIGH, (gain_reg>>8) & 0xff);
 	ret |= imx662_write_reg(sensor, GAIN_LOW, gain_reg & 0xff);
-	ret |= imx662_write_reg(sensor, REGHOLD, 0);
+	ret |= imx662_reghold(sensor, 0);
+	sensor->applied.gain_reg = gain_reg;
 
 	return ret;
 }
@@ -1398,6 +1685,7 @@ static int imx662_set_vs_gain(struct imx662 *sensor, u32 gain, u8 which_control)
 	ret |= imx662_write_reg(sensor, GAIN_1_HIGH, (gain_reg>>8) & 0xff);
 	ret |= imx662_write_reg(sensor, GAIN_1_LOW, gain_reg & 0xff);
 	ret |= imx662_write_reg(sensor, REGHOLD, 0);
+	sensor->applied.vs_gain_reg = gain_reg;
 
 	return ret;
 }
@@ -1508,6 +1796,7 @@ static int imx662_set_fps(struct imx662 *sensor, u32 fps, u8 which_control)
 		sensor->cur_mode.ae_info.max_integration_line = fps_reg - sensor->cur_mode.ae_info.min_integration_line;
 
 	sensor->cur_mode.ae_info.curr_frm_len_lines = fps_reg;
+	vvsensor_afps_reset(&sensor->vs);
 	return ret;
 }
 
@@ -1619,42 +1908,98 @@ static int imx662_s_ctrl(struct v4l2_ctrl *ctrl)
 	return ret;
 }
 
+static u32 imx662_csi_lanes(struct imx662 *sensor)
+{
+	if (!strcmp(sensor->gmsl, "gmsl") && sensor->g_ctx.num_csi_lanes)
+		return sensor->g_ctx.num_csi_lanes;
+
+	return sensor->cur_mode.mipi_info.mipi_lane;
+}
+
+static int imx662_link_freq_index(struct imx662 *sensor)
+{
+	struct device *dev = &sensor->i2c_client->dev;
+	s64 freq;
+	u32 i;
+
+	if (strcmp(sensor->gmsl, "gmsl"))
+		return sensor->ctrls.data_rate->val;
+
+	/* the CSI receiver sees the deserializer rate, not the sensor one */
+	freq = (s64)max96792_get_csi_rate(sensor->dser_dev) * 1000000 / 2;
+	for (i = IMX662_LINK_FREQ_GMSL; i < ARRAY_SIZE(imx662_link_freq_menu); i++) {
+		if (imx662_link_freq_menu[i] == freq)
+			return i;
+	}
+
+	dev_warn(dev, "%s: deserializer CSI rate %lld Hz is not in the link frequency menu\n",
+		 __func__, freq);
+
+	return -EINVAL;
+}
+
+static int imx662_g_volatile_ctrl(struct v4l2_ctrl *ctrl)
+{
+	struct v4l2_subdev *sd = ctrl_to_sd(ctrl);
+	struct imx662 *sensor = to_imx662_dev(sd);
+	int idx = imx662_link_freq_index(sensor);
+
+	if (idx < 0)
+		return idx;
+
+	switch (ctrl->id) {
+	case V4L2_CID_LINK_FREQ:
+		ctrl->val = idx;
+		break;
+	case V4L2_CID_PIXEL_RATE:
+		ctrl->val64 = div_u64(imx662_link_freq_menu[idx] * 2 *
+			imx662_csi_lanes(sensor), sensor->cur_mode.bit_width);
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
 static const struct v4l2_ctrl_ops imx662_ctrl_ops = {
+	.g_volatile_ctrl = imx662_g_volatile_ctrl,
 	.s_ctrl = imx662_s_ctrl,
 };
 
-static int imx662_get_format_code(struct imx662 *sensor, u32 *code)
+/* Media bus code of the mode bayer pattern at the given bit width */
+static void imx662_format_code_for(struct imx662 *sensor, u32 bit_width,
+				u32 *code)
 {
-	pr_debug("enter %s function\n", __func__);
 	switch (sensor->cur_mode.bayer_pattern) {
 	case BAYER_RGGB:
-		if (sensor->cur_mode.bit_width == 8)
+		if (bit_width == 8)
 			*code = MEDIA_BUS_FMT_SRGGB8_1X8;
-		else if (sensor->cur_mode.bit_width == 10)
+		else if (bit_width == 10)
 			*code = MEDIA_BUS_FMT_SRGGB10_1X10;
 		else
 			*code = MEDIA_BUS_FMT_SRGGB12_1X12;
 		break;
 	case BAYER_GRBG:
-		if (sensor->cur_mode.bit_width == 8)
+		if (bit_width == 8)
 			*code = MEDIA_BUS_FMT_SGRBG8_1X8;
-		else if (sensor->cur_mode.bit_width == 10)
+		else if (bit_width == 10)
 			*code = MEDIA_BUS_FMT_SGRBG10_1X10;
 		else
 			*code = MEDIA_BUS_FMT_SGRBG12_1X12;
 		break;
 	case BAYER_GBRG:
-		if (sensor->cur_mode.bit_width == 8)
+		if (bit_width == 8)
 			*code = MEDIA_BUS_FMT_SGBRG8_1X8;
-		else if (sensor->cur_mode.bit_width == 10)
+		else if (bit_width == 10)
 			*code = MEDIA_BUS_FMT_SGBRG10_1X10;
 		else
 			*code = MEDIA_BUS_FMT_SGBRG12_1X12;
 		break;
 	case BAYER_BGGR:
-		if (sensor->cur_mode.bit_width == 8)
+		if (bit_width == 8)
 			*code = MEDIA_BUS_FMT_SBGGR8_1X8;
-		else if (sensor->cur_mode.bit_width == 10)
+		else if (bit_width == 10)
 			*code = MEDIA_BUS_FMT_SBGGR10_1X10;
 		else
 			*code = MEDIA_BUS_FMT_SBGGR12_1X12;
@@ -1663,9 +2008,47 @@ static int imx662_get_format_code(struct imx662 *sensor, u32 *code)
 		/*nothing need to do*/
 		break;
 	}
+}
+
+static int imx662_get_format_code(struct imx662 *sensor, u32 *code)
+{
+	pr_debug("enter %s function\n", __func__);
+	imx662_format_code_for(sensor, sensor->cur_mode.bit_width, code);
 	return 0;
 }
 
+/*
+ * Linear modes without binning output RAW10 or RAW12 as requested by the bus code,
+ * the binning tables fix the output to 12 bit. The sensor has no 8 bit
+ * output.
+ */
+static bool imx662_bit_width_selectable(struct imx662 *sensor)
+{
+	return imx662_crop_supported(sensor);
+}
+
+/* Other codes keep the bit width of the mode */
+static u32 imx662_code_bit_width(struct imx662 *sensor, u32 code)
+{
+	if (!imx662_bit_width_selectable(sensor))
+		return sensor->cur_mode.bit_width;
+
+	switch (code) {
+	case MEDIA_BUS_FMT_SRGGB10_1X10:
+	case MEDIA_BUS_FMT_SGRBG10_1X10:
+	case MEDIA_BUS_FMT_SGBRG10_1X10:
+	case MEDIA_BUS_FMT_SBGGR10_1X10:
+		return 10;
+	case MEDIA_BUS_FMT_SRGGB12_1X12:
+	case MEDIA_BUS_FMT_SGRBG12_1X12:
+	case MEDIA_BUS_FMT_SGBRG12_1X12:
+	case MEDIA_BUS_FMT_SBGGR12_1X12:
+		return 12;
+	default:
+		return sensor->cur_mode.bit_width;
+	}
+}
+
 static int imx662_parse_dt(struct imx662 *sensor, struct i2c_client *client)
 {
 	struct device_node *node = client->dev.of_node;
@@ -1729,6 +2112,82 @@ static int imx662_set_pixel_format(struct imx662 *sensor)
 	return err;
 }
 
+/* Exposure of lines in the units of VVSENSORIOC_S_EXP, us << 10 */
+static u32 imx662_lines_to_exp(struct imx662 *sensor, u32 lines)
+{
+	return div_u64((u64)lines * sensor->cur_mode.ae_info.one_line_exp_time_ns << 10,
+		       IMX662_K_FACTOR);
+}
+
+static u32 imx662_lines_to_ns(struct imx662 *sensor, u32 lines)
+{
+	return lines * sensor->cur_mode.ae_info.one_line_exp_time_ns;
+}
+
+/* Gain register in the units of VVSENSORIOC_S_GAIN */
+static u32 imx662_gain_reg_to_gain(u32 gain_reg)
+{
+	return gain_reg2times[min_t(u32, gain_reg, IMX662_GAIN_REG_LEN - 1)];
+}
+
+static int imx662_vs_set_exp(struct vvsensor_ctx *ctx, u32 exp)
+{
+	return imx662_set_exp(container_of(ctx, struct imx662, vs), exp, 0);
+}
+
+static int imx662_vs_set_gain(struct vvsensor_ctx *ctx, u32 gain)
+{
+	return imx662_set_gain(container_of(ctx, struct imx662, vs), gain, 0);
+}
+
+static int imx662_vs_set_fps(struct vvsensor_ctx *ctx, u32 fps)
+{
+	return imx662_set_fps(container_of(ctx, struct imx662, vs), fps, 0);
+}
+
+static int imx662_vs_reghold(struct vvsensor_ctx *ctx, u8 hold)
+{
+	return imx662_write_reg(container_of(ctx, struct imx662, vs), REGHOLD, hold);
+}
+
+static void imx662_vs_get_ae(struct vvsensor_ctx *ctx, u32 *exp, u32 *gain)
+{
+	struct imx662 *sensor = container_of(ctx, struct imx662, vs);
+
+	*exp = imx662_lines_to_exp(sensor, sensor->applied.exp_lines);
+	*gain = imx662_gain_reg_to_gain(sensor->applied.gain_reg);
+}
+
+static const struct vvsensor_ops imx662_vs_ops = {
+	.set_exp  = imx662_vs_set_exp,
+	.set_gain = imx662_vs_set_gain,
+	.set_fps  = imx662_vs_set_fps,
+	.reghold  = imx662_vs_reghold,
+	.get_ae   = imx662_vs_get_ae,
+};
+
+static int imx662_s_exp_ae(struct imx662 *sensor, void __user *arg)
+{
+	struct vvcam_exp_ae_s exp_ae;
+	int ret;
+
+	if (copy_from_user(&exp_ae, arg, sizeof(exp_ae)))
+		return -EFAULT;
+
+	ret = imx662_set_exp(sensor, exp_ae.exp, 0);
+	if (ret)
+		return ret;
+
+	exp_ae.exp = imx662_lines_to_exp(sensor, sensor->applied.exp_lines);
+	exp_ae.lines = sensor->applied.exp_lines;
+	exp_ae.ns = imx662_lines_to_ns(sensor, sensor->applied.exp_lines);
+	exp_ae.ae_info = sensor->cur_mode.ae_info;
+	if (copy_to_user(arg, &exp_ae, sizeof(exp_ae)))
+		return -EFAULT;
+
+	return 0;
+}
+
 static int imx662_s_stream(struct v4l2_subdev *sd, int enable)
 {
 	struct i2c_client *client = v4l2_get_subdevdata(sd);
@@ -1758,7 +2217,18 @@ static int imx662_s_stream(struct v4l2_subdev *sd, int enable)
 		}
 		imx662_write_reg(sensor, STANDBY, 0x00);
 		msleep(30);
-		imx662_write_reg(sensor, XMSTA, 0x00);
+		if (!sensor->g_ctx.sync_group) {
+			imx662_write_reg(sensor, XMSTA, 0x00);
+		} else if (sensor->g_ctx.sync_master) {
+			/* deferred until all slaves of the group stream */
+			if (max96792_sync_stream(sensor->dser_dev,
+					&sensor->i2c_client->dev, true))
+				imx662_write_reg(sensor, XMSTA, 0x00);
+		} else {
+			imx662_write_reg(sensor, XMSTA, 0x00);
+			max96792_sync_stream(sensor->dser_dev,
+					&sensor->i2c_client->dev, true);
+		}
 		// 8 frame stabilisation - remove this?
 		msleep(300);
 	} else  {
@@ -1768,11 +2238,17 @@ static int imx662_s_stream(struct v4l2_subdev *sd, int enable)
 
 			max96792_stop_streaming(sensor->dser_dev, &sensor->i2c_client->dev);
 		}
+		if (sensor->g_ctx.sync_group)
+			max96792_sync_stream(sensor->dser_dev,
+					&sensor->i2c_client->dev, false);
 		imx662_write_reg(sensor, STANDBY, 0x01);
 		msleep(30);
 		imx662_write_reg(sensor, XMSTA, 0x01);
 	}
 
+	vvsensor_fq_stream(&sensor->vs, enable);
+	vvsensor_group_stream(&sensor->vs, enable);
+
 	return 0;
 exit:
 	pr_err("%s: error setting stream\n", __func__);
@@ -1808,6 +2284,7 @@ static int imx662_gmsl_serdes_setup(struct imx662 *priv)
 		pr_err("serializer gmsl setup failed\n");
 		goto error;
 	}
+	priv->g_ctx.link_rate = GMSL_LINK_RATE_12G;
 
 
 	pr_debug("%s: max96792_setup_link\n", __func__);
@@ -1858,58 +2335,110 @@ static void imx662_gmsl_serdes_reset(struct imx662 *priv)
 	mutex_unlock(&priv->lock);
 }
 
+static void imx662_gmsl_link_notify(struct device *s_dev, u32 event)
+{
+	struct i2c_client *client = to_i2c_client(s_dev);
+	struct imx662 *sensor = client_to_imx662(client);
+	struct v4l2_event ev = {
+		.type = GMSL_V4L2_EVENT_LINK,
+	};
+
+	dev_dbg(s_dev, "%s: gmsl link event %u\n", __func__, event);
+
+	ev.u.data[0] = event;
+	if (sensor->sd.devnode)
+		v4l2_event_queue(sensor->sd.devnode, &ev);
+}
+
+static int imx662_gmsl_sync_start(struct device *s_dev)
+{
+	struct i2c_client *client = to_i2c_client(s_dev);
+	struct imx662 *sensor = client_to_imx662(client);
+
+	dev_dbg(s_dev, "%s: releasing sync master\n", __func__);
+
+	return imx662_write_reg(sensor, XMSTA, 0x00);
+}
+
+static int imx662_subscribe_event(struct v4l2_subdev *sd, struct v4l2_fh *fh,
+				struct v4l2_event_subscription *sub)
+{
+	switch (sub->type) {
+	case GMSL_V4L2_EVENT_LINK:
+		return v4l2_event_subscribe(fh, sub, 4, NULL);
+	case V4L2_EVENT_CTRL:
+		return v4l2_ctrl_subdev_subscribe_event(sd, fh, sub);
+	default:
+		return -EINVAL;
+	}
+}
+
 static int imx662_enum_mbus_code(struct v4l2_subdev *sd,
 					 struct v4l2_subdev_state *state,
 					 struct v4l2_subdev_mbus_code_enum *code)
 {
 	struct i2c_client *client = v4l2_get_subdevdata(sd);
 	struct imx662 *sensor = client_to_imx662(client);
+	u32 bit_width;
 	u32 cur_code = MEDIA_BUS_FMT_SRGGB12_1X12;
 
 	pr_debug("enter %s function\n", __func__);
-	if (code->index > 0)
+	if (code->index > 1)
 		return -EINVAL;
-	imx662_get_format_code(sensor, &cur_code);
+
+	/* the second code is the other bit width, where the mode has one */
+	mutex_lock(&sensor->lock);
+	if (code->index && !imx662_bit_width_selectable(sensor)) {
+		mutex_unlock(&sensor->lock);
+		return -EINVAL;
+	}
+	bit_width = sensor->cur_mode.bit_width;
+	if (code->index)
+		bit_width = (bit_width == 10) ? 12 : 10;
+	imx662_format_code_for(sensor, bit_width, &cur_code);
+	mutex_unlock(&sensor->lock);
 	code->code = cur_code;
 
 	return 0;
 }
 
-static int imx662_set_fmt(struct v4l2_subdev *sd,
-			  struct v4l2_subdev_state *state,
-			  struct v4l2_subdev_format *fmt)
+static int imx662_write_crop(struct imx662 *sensor)
 {
-	int ret = 0;
-	struct i2c_client *client = v4l2_get_subdevdata(sd);
-	struct imx662 *sensor = client_to_imx662(client);
+	const struct v4l2_rect *r = &sensor->crop;
+	int ret;
 
-	mutex_lock(&sensor->lock);
+	pr_debug("%s: %ux%u at %d,%d\n", __func__,
+		r->width, r->height, r->left, r->top);
 
-	pr_debug("enter %s function\n", __func__);
-	if ((fmt->format.width != sensor->cur_mode.size.bounds_width) ||
-		(fmt->format.height != sensor->cur_mode.size.bounds_height)) {
-		pr_err("%s:set sensor format %dx%d error\n",
-			__func__, fmt->format.width, fmt->format.height);
-		mutex_unlock(&sensor->lock);
-		return -EINVAL;
-	}
-	imx662_get_format_code(sensor, &fmt->format.code);
-	fmt->format.field = V4L2_FIELD_NONE;
-	sensor->format = fmt->format;
+	ret = imx662_write_reg(sensor, WINMODE, 0x04);
+	ret |= imx662_write_reg(sensor, PIX_HST_HIGH, IMX662_TO_MID_BYTE(r->left));
+	ret |= imx662_write_reg(sensor, PIX_HST_LOW, IMX662_TO_LOW_BYTE(r->left));
+	ret |= imx662_write_reg(sensor, PIX_HWIDTH_HIGH, IMX662_TO_MID_BYTE(r->width));
+	ret |= imx662_write_reg(sensor, PIX_HWIDTH_LOW, IMX662_TO_LOW_BYTE(r->width));
+	ret |= imx662_write_reg(sensor, PIX_VST_HIGH, IMX662_TO_MID_BYTE(r->top));
+	ret |= imx662_write_reg(sensor, PIX_VST_LOW, IMX662_TO_LOW_BYTE(r->top));
+	ret |= imx662_write_reg(sensor, PIX_VWIDTH_HIGH, IMX662_TO_MID_BYTE(r->height));
+	ret |= imx662_write_reg(sensor, PIX_VWIDTH_LOW, IMX662_TO_LOW_BYTE(r->height));
+
+	return ret;
+}
+
+/* Called with sensor->lock held */
+static int imx662_apply_mode(struct imx662 *sensor)
+{
+	int ret = 0;
 
 	ret = imx662_write_reg_arry(sensor,
 		(struct vvcam_sccb_data_s *)sensor->cur_mode.preg_data,
 		sensor->cur_mode.reg_data_count);
 	if (ret < 0) {
 		pr_err("%s:imx662_write_reg_arry error, error when setting initial data\n", __func__);
-		mutex_unlock(&sensor->lock);
 		return -EINVAL;
 	}
 
 	ret = imx662_set_pixel_format(sensor);
 	if (ret < 0) {
 		pr_err("%s:imx662_write_reg_arry error, failed to set pixel format\n", __func__);
-		mutex_unlock(&sensor->lock);
 		return -EINVAL;
 	}
 
@@ -1933,6 +2462,9 @@ static int imx662_set_fmt(struct v4l2_subdev *sd,
 	case IMX662_DOL_INDEX:
 		pr_info("%s:Setting mode 4 ", __func__);
 		ret = imx662_write_reg_arry(sensor, (struct vvcam_sccb_data_s *)imx662_setting_dol_hdr, ARRAY_SIZE(imx662_setting_dol_hdr));
+		/* split the exposures on VC 0 and 1, as reported by get_frame_desc */
+		if (!ret && strcmp(sensor->gmsl, "gmsl"))
+			ret = imx662_write_reg(sensor, VCMODE, 0x01);
 		break;
 	case IMX662_CLEAR_INDEX:
 		pr_info("%s:Setting mode 5 ", __func__);
@@ -1945,16 +2477,114 @@ static int imx662_set_fmt(struct v4l2_subdev *sd,
 	if (ret < 0)
 		pr_err("%s:Failed to initialize settings for mode. Error while writing to setting to sensors/\n", __func__);
 
+	if (imx662_crop_supported(sensor) && !imx662_crop_is_default(sensor)) {
+		ret = imx662_write_crop(sensor);
+		if (ret < 0) {
+			pr_err("%s:unable to set up crop window\n", __func__);
+			return -EINVAL;
+		}
+	}
+
 	ret = imx662_s_ctrl(sensor->ctrls.data_rate);
 	if (ret < 0) {
 		pr_err("%s:unable to set data rate\n", __func__);
 		return -EINVAL;
 	}
-	mutex_unlock(&sensor->lock);
+
+	/* run a custom window at the shortest frame it allows */
+	if (imx662_crop_supported(sensor) && !imx662_crop_is_default(sensor)) {
+		ret = imx662_set_fps(sensor, sensor->cur_mode.ae_info.max_fps, 0);
+		if (ret < 0) {
+			pr_err("%s:unable to set frame length\n", __func__);
+			return -EINVAL;
+		}
+	}
 
 	return 0;
 }
 
+static int imx662_shadow_replay(struct imx662 *sensor)
+{
+	int ret;
+	int i;
+
+	if (!sensor->shadow_valid)
+		return 0;
+
+	ret = imx662_write_reg(sensor, REGHOLD, 1);
+	for (i = 0; i < ARRAY_SIZE(imx662_shadow_regs); i++) {
+		if (sensor->shadow_valid & BIT(i))
+			ret |= imx662_write_reg(sensor, imx662_shadow_regs[i],
+					sensor->shadow_val[i]);
+	}
+	ret |= imx662_write_reg(sensor, REGHOLD, 0);
+
+	return ret;
+}
+
+/*
+ * Reprogram the sensor after it lost its registers: mode tables first,
+ * then the controls that are not part of them, then the last AE values.
+ * Called with sensor->lock held.
+ */
+static int imx662_restore_mode(struct imx662 *sensor)
+{
+	u8 shadow_val[ARRAY_SIZE(imx662_shadow_regs)];
+	u32 shadow_valid = sensor->shadow_valid;
+	int ret;
+
+	/* applying the mode rewrites some shadowed registers with defaults */
+	memcpy(shadow_val, sensor->shadow_val, sizeof(shadow_val));
+
+	ret = imx662_apply_mode(sensor);
+
+	memcpy(sensor->shadow_val, shadow_val, sizeof(shadow_val));
+	sensor->shadow_valid = shadow_valid;
+
+	if (ret < 0)
+		return ret;
+
+	ret = imx662_set_sync_mode(sensor, sensor->ctrls.sync_mode->val);
+	if (sensor->ctrls.test_pattern->val)
+		ret |= imx662_set_test_pattern(sensor,
+				sensor->ctrls.test_pattern->val);
+	ret |= imx662_shadow_replay(sensor);
+
+	return ret;
+}
+
+static int imx662_set_fmt(struct v4l2_subdev *sd,
+			  struct v4l2_subdev_state *state,
+			  struct v4l2_subdev_format *fmt)
+{
+	int ret = 0;
+	struct i2c_client *client = v4l2_get_subdevdata(sd);
+	struct imx662 *sensor = client_to_imx662(client);
+
+	mutex_lock(&sensor->lock);
+
+	pr_debug("enter %s function\n", __func__);
+	if ((fmt->format.width != sensor->cur_mode.size.bounds_width) ||
+		(fmt->format.height != sensor->cur_mode.size.bounds_height)) {
+		pr_err("%s:set sensor format %dx%d error\n",
+			__func__, fmt->format.width, fmt->format.height);
+		mutex_unlock(&sensor->lock);
+		return -EINVAL;
+	}
+	sensor->cur_mode.bit_width = imx662_code_bit_width(sensor, fmt->format.code);
+	imx662_get_format_code(sensor, &fmt->format.code);
+	fmt->format.field = V4L2_FIELD_NONE;
+	sensor->format = fmt->format;
+
+	sensor->shadow_valid = 0;
+	ret = imx662_apply_mode(sensor);
+	if (ret == 0)
+		sensor->mode_applied = true;
+
+	mutex_unlock(&sensor->lock);
+	return ret;
+}
+
 static int imx662_get_fmt(struct v4l2_subdev *sd,
 			  struct v4l2_subdev_state *state,
 			  struct v4l2_subdev_format *fmt)
@@ -1969,6 +2599,63 @@ static int imx662_get_fmt(struct v4l2_subdev *sd,
 	return 0;
 }
 
+static int imx662_get_selection(struct v4l2_subdev *sd,
+				struct v4l2_subdev_state *state,
+				struct v4l2_subdev_selection *sel)
+{
+	struct imx662 *sensor = to_imx662_dev(sd);
+	int ret;
+
+	mutex_lock(&sensor->lock);
+	ret = vvsensor_crop_get_selection(&imx662_crop_limits, &sensor->crop,
+			&imx662_mode_crop[sensor->cur_mode.index], sel);
+	mutex_unlock(&sensor->lock);
+
+	return ret;
+}
+
+/*
+ * Program a window of the all-pixel readout. The frame rate limit of the
+ * mode is raised for a shorter window and the frame is set to the
+ * shortest length the window allows.
+ */
+static int imx662_set_selection(struct v4l2_subdev *sd,
+				struct v4l2_subdev_state *state,
+				struct v4l2_subdev_selection *sel)
+{
+	struct imx662 *sensor = to_imx662_dev(sd);
+	int ret = 0;
+
+	if (sel->target != V4L2_SEL_TGT_CROP)
+		return -EINVAL;
+
+	mutex_lock(&sensor->lock);
+
+	if (!imx662_crop_supported(sensor)) {
+		/* fixed window of the binning and HDR modes */
+		sel->r = sensor->crop;
+		goto out;
+	}
+
+	ret = vvsensor_crop_set_selection(&imx662_crop_limits, &sensor->crop,
+			sensor->stream_status, sel);
+	if (ret <= 0)
+		goto out;
+
+	ret = 0;
+	vvsensor_crop_size(&imx662_crop_limits, sensor->crop.width,
+			sensor->crop.height, &sensor->cur_mode.size, &sensor->format);
+
+	if (sensor->mode_applied && sensor->powered_on) {
+		sensor->shadow_valid = 0;
+		ret = imx662_apply_mode(sensor);
+	}
+
+out:
+	mutex_unlock(&sensor->lock);
+	return ret;
+}
+
 static long imx662_priv_ioctl(struct v4l2_subdev *sd,
 				unsigned int cmd,
 				void *arg)
@@ -1979,6 +2666,10 @@ static long imx662_priv_ioctl(struct v4l2_subdev *sd,
 	struct vvcam_sccb_data_s sensor_reg;
 
 	pr_info("enter %s %u\n", __func__, cmd);
+	/* waits for the group commit, which takes the sensor lock */
+	if (cmd == VVSENSORIOC_S_GROUP_AE)
+		return vvsensor_s_group_ae(&sensor->vs, arg);
+
 	mutex_lock(&sensor->lock);
 	switch (cmd) {
 	case VVSENSORIOC_S_POWER:
@@ -2033,18 +2724,30 @@ static long imx662_priv_ioctl(struct v4l2_subdev *sd,
 		break;
 	case VVSENSORIOC_S_EXP:
 		ret = imx662_set_exp(sensor, *(u32 *)arg, 0);
+		if (!ret)
+			ret = put_user(imx662_lines_to_exp(sensor, sensor->applied.exp_lines),
+				       (u32 __user *)arg);
 		break;
 	case VVSENSORIOC_S_VSEXP:
 		ret = imx662_set_vs_exp(sensor, *(u32 *)arg, 0);
+		if (!ret)
+			ret = put_user(imx662_lines_to_exp(sensor, sensor->applied.vs_exp_lines),
+				       (u32 __user *)arg);
 		break;
 	case VVSENSORIOC_S_LONG_GAIN:
 		ret = imx662_set_exp_gain(sensor, *(u32 *)arg, 0);
 		break;
 	case VVSENSORIOC_S_GAIN:
 		ret = imx662_set_gain(sensor, *(u32 *)arg, 0);
+		if (!ret)
+			ret = put_user(imx662_gain_reg_to_gain(sensor->applied.gain_reg),
+				       (u32 __user *)arg);
 		break;
 	case VVSENSORIOC_S_VSGAIN:
 		ret = imx662_set_vs_gain(sensor, *(u32 *)arg, 0);
+		if (!ret)
+			ret = put_user(imx662_gain_reg_to_gain(sensor->applied.vs_gain_reg),
+				       (u32 __user *)arg);
 		break;
 	case VVSENSORIOC_S_FPS:
 		ret = imx662_set_fps(sensor, *(u32 *)arg, 0);
@@ -2070,6 +2773,19 @@ static long imx662_priv_ioctl(struct v4l2_subdev *sd,
 	case VVSENSORIOC_S_DATA_RATE:
 		ret = imx662_set_data_rate(sensor, *(u32 *)arg);
 		break;
+	case VVSENSORIOC_S_FRAME_QUEUE:
+		ret = vvsensor_s_frame_queue(&sensor->vs,
+					     sensor->stream_status, arg);
+		break;
+	case VVSENSORIOC_G_FRAME_QUEUE:
+		ret = vvsensor_g_frame_queue(&sensor->vs, arg);
+		break;
+	case VVSENSORIOC_S_MIN_AFPS:
+		ret = vvsensor_set_min_afps(&sensor->vs, *(u32 *)arg);
+		break;
+	case VVSENSORIOC_S_EXP_AE:
+		ret = imx662_s_exp_ae(sensor, arg);
+		break;
 	case VVSENSORIOC_S_SYNC_MODE:
 		ret = imx662_set_sync_mode(sensor, *(u32 *)arg);
 		break;
@@ -2082,19 +2798,132 @@ static long imx662_priv_ioctl(struct v4l2_subdev *sd,
 	return ret;
 }
 
+/* VVSENSORIOC_S_STREAM calls imx662_s_stream() with the lock held */
+static int imx662_video_s_stream(struct v4l2_subdev *sd, int enable)
+{
+	struct imx662 *sensor = to_imx662_dev(sd);
+	struct device *dev = &sensor->i2c_client->dev;
+	int ret;
+
+	if (enable) {
+		ret = pm_runtime_resume_and_get(dev);
+		if (ret < 0)
+			return ret;
+	}
+
+	mutex_lock(&sensor->lock);
+	ret = imx662_s_stream(sd, enable);
+	mutex_unlock(&sensor->lock);
+
+	if (!enable || ret) {
+		pm_runtime_mark_last_busy(dev);
+		pm_runtime_put_autosuspend(dev);
+	}
+
+	return ret;
+}
+
+/* An open subdev node keeps the sensor powered for the vvcam ioctls */
+static int imx662_open(struct v4l2_subdev *sd, struct v4l2_subdev_fh *fh)
+{
+	struct imx662 *sensor = to_imx662_dev(sd);
+
+	return pm_runtime_resume_and_get(&sensor->i2c_client->dev);
+}
+
+static int imx662_close(struct v4l2_subdev *sd, struct v4l2_subdev_fh *fh)
+{
+	struct imx662 *sensor = to_imx662_dev(sd);
+
+	pm_runtime_mark_last_busy(&sensor->i2c_client->dev);
+	pm_runtime_put_autosuspend(&sensor->i2c_client->dev);
+
+	return 0;
+}
+
+static const struct v4l2_subdev_internal_ops imx662_internal_ops = {
+	.open = imx662_open,
+	.close = imx662_close,
+};
+
 static const struct v4l2_subdev_video_ops imx662_subdev_video_ops = {
-	.s_stream = imx662_s_stream,
+	.s_stream = imx662_video_s_stream,
 };
 
+static int imx662_get_mbus_config(struct v4l2_subdev *sd, unsigned int pad,
+				struct v4l2_mbus_config *cfg)
+{
+	struct imx662 *sensor = to_imx662_dev(sd);
+
+	/* the receiver can not be set up for an unknown link frequency */
+	if (imx662_link_freq_index(sensor) < 0)
+		return -EINVAL;
+
+	cfg->type = V4L2_MBUS_CSI2_DPHY;
+	cfg->bus.mipi_csi2.flags = 0;
+	cfg->bus.mipi_csi2.num_data_lanes = imx662_csi_lanes(sensor);
+
+	return 0;
+}
+
+/*
+ * In DOL HDR mode the long and short exposures are sent on virtual
+ * channels 0 and 1, VCMODE is set when the mode is applied. On a GMSL
+ * link VCMODE is left off and the routing to the receiver defaults.
+ */
+static int imx662_get_frame_desc(struct v4l2_subdev *sd, unsigned int pad,
+				struct v4l2_mbus_frame_desc *fd)
+{
+	struct imx662 *sensor = to_imx662_dev(sd);
+	u32 i, num_entries = 1;
+	u8 dt;
+
+	if (!strcmp(sensor->gmsl, "gmsl"))
+		return -ENOIOCTLCMD;
+
+	switch (sensor->cur_mode.bit_width) {
+	case 8:
+		dt = MIPI_CSI2_DT_RAW8;
+		break;
+	case 10:
+		dt = MIPI_CSI2_DT_RAW10;
+		break;
+	default:
+		dt = MIPI_CSI2_DT_RAW12;
+		break;
+	}
+
+	if (sensor->cur_mode.index == IMX662_DOL_INDEX)
+		num_entries = 2;
+
+	memset(fd, 0, sizeof(*fd));
+	fd->type = V4L2_MBUS_FRAME_DESC_TYPE_CSI2;
+	fd->num_entries = num_entries;
+	for (i = 0; i < num_entries; i++) {
+		fd->entry[i].stream = i;
+		fd->entry[i].pixelcode = sensor->format.code;
+		fd->entry[i].bus.csi2.vc = i;
+		fd->entry[i].bus.csi2.dt = dt;
+	}
+
+	return 0;
+}
+
 static const struct v4l2_subdev_pad_ops imx662_subdev_pad_ops = {
 	.enum_mbus_code = imx662_enum_mbus_code,
 	.set_fmt = imx662_set_fmt,
 	.get_fmt = imx662_get_fmt,
+	.get_selection = imx662_get_selection,
+	.set_selection = imx662_set_selection,
+	.get_mbus_config = imx662_get_mbus_config,
+	.get_frame_desc = imx662_get_frame_desc,
 };
 
 static const struct v4l2_subdev_core_ops imx662_subdev_core_ops = {
 	.s_power = imx662_s_power,
 	.ioctl = imx662_priv_ioctl,
+	.subscribe_event = imx662_subscribe_event,
+	.unsubscribe_event = v4l2_event_subdev_unsubscribe,
 };
 
 static const struct v4l2_subdev_ops imx662_subdev_ops = {
@@ -2131,6 +2960,7 @@ static int imx662_probe(struct i2c_client *client)
 	const char *str_value;
 	const char *str_value1[2];
 	int  i;
+	u32 group_id;
 	int err = 0;
 
 	pr_debug("enter %s function\n", __func__);
@@ -2150,6 +2980,8 @@ static int imx662_probe(struct i2c_client *client)
 	mutex_init(&sensor->lock);
 
 	sensor->i2c_client = client;
+	vvsensor_init(&sensor->vs, &client->dev, &sensor->lock, &imx662_vs_ops,
+		      &sensor->cur_mode);
 	if (strcmp(sensor->gmsl, "gmsl")) {
 		sensor->rst_gpio = of_get_named_gpio(dev->of_node, "rst-gpios", 0);
 		if (!gpio_is_valid(sensor->rst_gpio))
@@ -2238,6 +3070,11 @@ static int imx662_probe(struct i2c_client *client)
 
 		sensor->dser_dev = &dser_i2c->dev;
 
+		/* resume order: deserializer, serializer, sensor */
+		device_link_add(dev, sensor->ser_dev, DL_FLAG_STATELESS);
+		device_link_add(sensor->ser_dev, sensor->dser_dev,
+				DL_FLAG_STATELESS);
+
 		/* populate g_ctx from DT */
 		gmsl = of_get_child_by_name(node, "gmsl-link");
 		if (gmsl == NULL) {
@@ -2340,6 +3177,12 @@ static int imx662_probe(struct i2c_client *client)
 		}
 
 		sensor->g_ctx.s_dev = dev;
+		sensor->g_ctx.notify = imx662_gmsl_link_notify;
+		sensor->g_ctx.sync_start = imx662_gmsl_sync_start;
+
+		/* optional XVS sync group, role follows the sync mode control */
+		of_property_read_u32(node, "sync-group",
+				&sensor->g_ctx.sync_group);
 
 		//mutex_init(&serdes_lock__);
 		/* Pair sensor to serializer dev */
@@ -2386,7 +3229,8 @@ static int imx662_probe(struct i2c_client *client)
 
 	sd = &sensor->sd;
 	v4l2_i2c_subdev_init(sd, client, &imx662_subdev_ops);
-	sd->flags |= V4L2_SUBDEV_FL_HAS_DEVNODE;
+	sd->internal_ops = &imx662_internal_ops;
+	sd->flags |= V4L2_SUBDEV_FL_HAS_DEVNODE | V4L2_SUBDEV_FL_HAS_EVENTS;
 	sd->dev = &client->dev;
 	sd->entity.ops = &imx662_sd_media_ops;
 	sd->entity.function = MEDIA_ENT_F_CAM_SENSOR;
@@ -2399,6 +3243,7 @@ static int imx662_probe(struct i2c_client *client)
 
 	memcpy(&sensor->cur_mode, &pimx662_mode_info[0],
 		sizeof(struct vvcam_mode_info_s));
+	sensor->crop = imx662_mode_crop[IMX662_ALL_PIXEL_INDEX];
 
 	/* initialize controls */
 	retval = v4l2_ctrl_handler_init(&sensor->ctrls.handler, V4L2_NUM_CTRLS);
@@ -2430,6 +3275,16 @@ static int imx662_probe(struct i2c_client *client)
 	sensor->ctrls.test_pattern = v4l2_ctrl_new_std_menu_items(&sensor->ctrls.handler, &imx662_ctrl_ops, V4L2_CID_TEST_PATTERN,
 					ARRAY_SIZE(imx662_test_pattern_menu) - 1, 0, 0, imx662_test_pattern_menu);
 
+	sensor->ctrls.link_freq = v4l2_ctrl_new_int_menu(&sensor->ctrls.handler, &imx662_ctrl_ops, V4L2_CID_LINK_FREQ,
+					ARRAY_SIZE(imx662_link_freq_menu) - 1, imx662_ctrl_data_rate[0].def, imx662_link_freq_menu);
+	if (sensor->ctrls.link_freq)
+		sensor->ctrls.link_freq->flags |= V4L2_CTRL_FLAG_VOLATILE |
+						  V4L2_CTRL_FLAG_READ_ONLY;
+	sensor->ctrls.pixel_rate = v4l2_ctrl_new_std(&sensor->ctrls.handler, &imx662_ctrl_ops, V4L2_CID_PIXEL_RATE,
+					1, S64_MAX, 1, 1);
+	if (sensor->ctrls.pixel_rate)
+		sensor->ctrls.pixel_rate->flags |= V4L2_CTRL_FLAG_VOLATILE;
+
 	sd->ctrl_handler = &sensor->ctrls.handler;
 	if (sensor->ctrls.handler.error) {
 		retval = sensor->ctrls.handler.error;
@@ -2444,15 +3299,33 @@ static int imx662_probe(struct i2c_client *client)
 		goto free_ctrls;
 	}
 
+	/* the sensor is powered, keep it so until probe is done */
+	pm_runtime_set_active(dev);
+	pm_runtime_get_noresume(dev);
+	pm_runtime_enable(dev);
+
 	retval = v4l2_async_register_subdev_sensor(sd);
 	if (retval < 0) {
 		dev_err(&client->dev, "%s--Async register failed, ret=%d\n",
 			__func__, retval);
+		pm_runtime_disable(dev);
+		pm_runtime_set_suspended(dev);
+		pm_runtime_put_noidle(dev);
 		goto probe_err_free_entiny;
 	}
 
+	/* optional AE group of the sensors sharing XVS */
+	if (!of_property_read_u32(dev->of_node, "sync-group", &group_id) &&
+	    vvsensor_group_join(&sensor->vs, group_id))
+		dev_warn(dev, "sync-group %u is full\n", group_id);
+
 	pr_info("%s camera mipi imx662, is found\n", __func__);
 
+	pm_runtime_set_autosuspend_delay(dev, 1000);
+	pm_runtime_use_autosuspend(dev);
+	pm_runtime_mark_last_busy(dev);
+	pm_runtime_put_autosuspend(dev);
+
 	return 0;
 
 free_ctrls:
@@ -2473,18 +3346,28 @@ static void imx662_remove(struct i2c_client *client)
 	int err = 0;
 
 	pr_debug("enter %s function\n", __func__);
+	/* the Hi-Z write below needs the sensor out of reset */
+	pm_runtime_get_sync(&client->dev);
+
 	err = imx662_write_reg(sensor, XVS_DRV_XHS_DRV, 0xF);
 	if (err < 0)
 		pr_err("%s: failed to set XVS XHS to Hi-Z\n", __func__);
 
 
 	if (!(strcmp(sensor->gmsl, "gmsl"))) {
+		max96792_sync_leave(sensor->dser_dev, &sensor->i2c_client->dev);
 		max96792_sdev_unregister(sensor->dser_dev, &sensor->i2c_client->dev);
+		device_link_remove(&client->dev, sensor->ser_dev);
+		device_link_remove(sensor->ser_dev, sensor->dser_dev);
 		imx662_gmsl_serdes_reset(sensor);
 	}
 
+	vvsensor_cleanup(&sensor->vs);
 	v4l2_async_unregister_subdev(sd);
 	media_entity_cleanup(&sd->entity);
+	pm_runtime_disable(&client->dev);
+	pm_runtime_set_suspended(&client->dev);
+	pm_runtime_put_noidle(&client->dev);
 	imx662_power_off(sensor);
 	mutex_destroy(&sensor->lock);
 }
@@ -2494,9 +3377,11 @@ static int __maybe_unused imx662_suspend(struct device *dev)
 	struct i2c_client *client = to_i2c_client(dev);
 	struct imx662 *sensor = client_to_imx662(client);
 
+	mutex_lock(&sensor->lock);
 	sensor->resume_status = sensor->stream_status;
 	if (sensor->resume_status)
 		imx662_s_stream(&sensor->sd, 0);
+	mutex_unlock(&sensor->lock);
 
 	return 0;
 }
@@ -2505,16 +3390,66 @@ static int __maybe_unused imx662_resume(struct device *dev)
 {
 	struct i2c_client *client = to_i2c_client(dev);
 	struct imx662 *sensor = client_to_imx662(client);
+	int ret = 0;
 
+	/* serdes registers are restored by their own resume (device links) */
+	mutex_lock(&sensor->lock);
+	if (sensor->mode_applied && sensor->powered_on)
+		ret = imx662_restore_mode(sensor);
+
+	if (ret < 0) {
+		mutex_unlock(&sensor->lock);
+		dev_err(dev, "%s: failed to restore sensor mode\n", __func__);
+		return ret;
+	}
+
+	/* resume to first frame is measured by the CSIS driver */
 	if (sensor->resume_status)
 		imx662_s_stream(&sensor->sd, 1);
-
+	mutex_unlock(&sensor->lock);
 
 	return 0;
 }
 
+/*
+ * Runtime PM holds a directly connected sensor in reset while unused. On a
+ * GMSL link the sensor is powered with the serializer, and a deserializer
+ * power cycle takes seconds, so the link stays up.
+ */
+static int __maybe_unused imx662_runtime_suspend(struct device *dev)
+{
+	struct imx662 *sensor = client_to_imx662(to_i2c_client(dev));
+
+	if (!strcmp(sensor->gmsl, "gmsl"))
+		return 0;
+
+	return imx662_power_off(sensor);
+}
+
+static int __maybe_unused imx662_runtime_resume(struct device *dev)
+{
+	struct imx662 *sensor = client_to_imx662(to_i2c_client(dev));
+	int ret;
+
+	if (!strcmp(sensor->gmsl, "gmsl"))
+		return 0;
+
+	ret = imx662_power_on(sensor);
+	if (ret < 0)
+		return ret;
+
+	/* the reset dropped the mode, replay it with the shadowed AE */
+	mutex_lock(&sensor->lock);
+	if (sensor->mode_applied)
+		ret = imx662_restore_mode(sensor);
+	mutex_unlock(&sensor->lock);
+
+	return ret;
+}
+
 static const struct dev_pm_ops imx662_pm_ops = {
 	SET_SYSTEM_SLEEP_PM_OPS(imx662_suspend, imx662_resume)
+	SET_RUNTIME_PM_OPS(imx662_runtime_suspend, imx662_runtime_resume, NULL)
 };
 
 static const struct i2c_device_id imx662_id[] = {
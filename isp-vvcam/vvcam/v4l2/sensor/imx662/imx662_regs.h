@@ -109,6 +109,11 @@
 #define IMX662_ROI_WIDTH                 648
 #define IMX662_ROI_HEIGHT                490
 
+#define IMX662_PIXEL_ARRAY_WIDTH         1936
+#define IMX662_PIXEL_ARRAY_HEIGHT        1100
+
+#define IMX662_MIN_FRAME_LENGTH_DELTA    150
+
 static struct vvcam_sccb_data_s imx662_10bit_mode[] = {
 	{ADBIT,             0x00},
 	{MDBIT,             0x00},
@@ -141,6 +146,7 @@ static struct vvcam_sccb_data_s imx662_init_setting[] = {
 	{INCK_SEL,          0x01},
 	{WDMODE,            0x00},
 	{ADDMODE,           0x00},
+	{VCMODE,            0x00},
 
 	{LANEMODE,          0x03},
 	{SHR0_LOW,          0x04},
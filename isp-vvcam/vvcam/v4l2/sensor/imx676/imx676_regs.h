@@ -111,6 +111,9 @@
 #define IMX676_CROP_BINNING_1768x1080_WIDTH     1768
 #define IMX676_CROP_BINNING_1768x1080_HEIGHT    1080
 
+#define IMX676_PIXEL_ARRAY_WIDTH        3552
+#define IMX676_PIXEL_ARRAY_HEIGHT       3556
+
 #define IMX676_MIN_FRAME_LENGTH_DELTA  72
 
 #define IMX676_TO_LOW_BYTE(x) (x & 0xFF)
@@ -176,6 +179,7 @@ static struct vvcam_sccb_data_s imx676_init_setting[] = {
 	{LANEMODE,             0x03},
 	/* INCK = 37.125Mhz */
 	{INCK_SEL,             0x01},
+	{VCMODE,               0x00},
 
 	{0x304E,               0x04},
 	{0x3148,               0x00},
@@ -12,12 +12,14 @@
 #include <linux/device.h>
 #include <linux/gpio.h>
 #include <linux/i2c.h>
+#include <linux/imx8-mipi-csi2-sam.h>
 #include <linux/init.h>
 #include <linux/module.h>
 #include <linux/of.h>
 #include <linux/of_device.h>
 #include <linux/of_gpio.h>
 #include <linux/pinctrl/consumer.h>
+#include <linux/pm_runtime.h>
 #include <linux/regmap.h>
 #include <linux/regulator/consumer.h>
 #include <linux/seq_file.h>
@@ -26,11 +28,14 @@
 #include <linux/uaccess.h>
 #include <linux/version.h>
 #include <linux/v4l2-mediabus.h>
+#include <media/mipi-csi2.h>
 #include <media/v4l2-device.h>
 #include <media/v4l2-ctrls.h>
+#include <media/v4l2-event.h>
 #include <media/v4l2-fwnode.h>
 
 #include "vvsensor.h"
+#include "vvsensor_common.h"
 #include "imx678_regs.h"
 #include "max96792.h"
 #include "max96793.h"
@@ -84,7 +89,7 @@
 #define V4L2_CID_VS_EXP			(V4L2_CID_USER_IMX_BASE + 4)
 #define V4L2_CID_VS_GAIN		(V4L2_CID_USER_IMX_BASE + 5)
 #define V4L2_CID_EXP_GAIN		(V4L2_CID_USER_IMX_BASE + 6)
-#define V4L2_NUM_CTRLS			10
+#define V4L2_NUM_CTRLS			12
 
 static const struct of_device_id imx678_of_match[] = {
 	{ .compatible = "framos,imx678" },
@@ -172,6 +177,28 @@ const char * const sync_mode_menu[] = {
 	[EXTERNAL_SYNC] = "External sync",
 };
 
+/*
+ * CSI-2 link frequencies reported through V4L2_CID_LINK_FREQ, the sensor
+ * rates are indexed by the data rate control and followed by the
+ * deserializer output rates of a GMSL link.
+ */
+static const s64 imx678_link_freq_menu[] = {
+	1188000000,
+	1039500000,
+	891000000,
+	720000000,
+	594000000,
+	445500000,
+	360000000,
+	297000000,
+	/* GMSL deserializer CSI rates */
+	500000000,
+	600000000,
+	750000000,
+};
+
+#define IMX678_LINK_FREQ_GMSL (IMX678_594_MBPS + 1)
+
 static const struct v4l2_ctrl_ops imx678_ctrl_ops;
 static struct v4l2_ctrl_config imx678_ctrl_data_rate[] = {
 	{
@@ -257,12 +284,46 @@ struct imx678_ctrls {
 	struct v4l2_ctrl *framerate;
 	struct v4l2_ctrl *black_level;
 	struct v4l2_ctrl *data_rate;
+	struct v4l2_ctrl *link_freq;
+	struct v4l2_ctrl *pixel_rate;
 	struct v4l2_ctrl *sync_mode;
 	struct v4l2_ctrl *vs_exp;
 	struct v4l2_ctrl *vs_gain;
 	struct v4l2_ctrl *exp_gain;
 };
 
+/* AE registers written at runtime, replayed after a mode restore */
+static const u16 imx678_shadow_regs[] = {
+	VMAX_LOW,
+	VMAX_MID,
+	VMAX_HIGH,
+	SHR0_LOW,
+	SHR0_MID,
+	SHR0_HIGH,
+	SHR1_LOW,
+	RHS1_LOW,
+	RHS1_MID,
+	RHS1_HIGH,
+	GAIN_0_LOW,
+	GAIN_0_HIGH,
+	GAIN_1_LOW,
+	GAIN_1_HIGH,
+	EXP_GAIN,
+	BLKLEVEL_LOW,
+	BLKLEVEL_HIGH,
+};
+
+/*
+ * Exposure and gain programmed by the last set_exp, set_vs_exp, set_gain
+ * and set_vs_gain, after clamping.
+ */
+struct imx678_applied {
+	u32 exp_lines;
+	u32 vs_exp_lines;
+	u32 gain_reg;
+	u32 vs_gain_reg;
+};
+
 struct imx678 {
 	struct i2c_client *i2c_client;
 	unsigned int pwn_gpio;
@@ -283,6 +344,12 @@ struct imx678 {
 	struct device *ser_dev;
 	struct device *dser_dev;
 	struct gmsl_link_ctx g_ctx;
+	u32 sync_mode;
+	u8 shadow_val[ARRAY_SIZE(imx678_shadow_regs)];
+	u32 shadow_valid;
+	bool mode_applied;
+	struct vvsensor_ctx vs;
+	struct imx678_applied applied;
 };
 
 #define client_to_imx678(client)\
@@ -506,6 +573,19 @@ static struct vvcam_mode_info_s pimx678_mode_info[] = {
 	},
 };
 
+static void imx678_shadow_update(struct imx678 *sensor, u16 reg, u8 val)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(imx678_shadow_regs); i++) {
+		if (imx678_shadow_regs[i] == reg) {
+			sensor->shadow_val[i] = val;
+			sensor->shadow_valid |= BIT(i);
+			return;
+		}
+	}
+}
+
 static int imx678_write_reg(struct imx678 *sensor, u16 reg, u8 val)
 {
 	struct device *dev = &sensor->i2c_client->dev;
@@ -538,6 +618,8 @@ static int imx678_write_reg(struct imx678 *sensor, u16 reg, u8 val)
 			num_retry, reg);
 	}
 
+	imx678_shadow_update(sensor, reg, val);
+
 	return 0;
 }
 
@@ -815,6 +897,7 @@ static int imx678_set_sensor_mode(struct imx678 *sensor, void *pmode)
 		if (pimx678_mode_info[i].index == sensor_mode.index) {
 			memcpy(&sensor->cur_mode, &pimx678_mode_info[i],
 				sizeof(struct vvcam_mode_info_s));
+			vvsensor_afps_reset(&sensor->vs);
 			return 0;
 		}
 	}
@@ -955,6 +1038,46 @@ change_datarate:
 	return ret;
 }
 
+/*
+ * Select the lowest GMSL link and deserializer CSI rates that carry the
+ * active mode, from the payload of one line per line time.
+ */
+static int imx678_gmsl_set_bandwidth(struct imx678 *sensor)
+{
+	struct device *dev = &sensor->i2c_client->dev;
+	u64 bandwidth;
+	u32 rate, prev_rate;
+	int err = 0;
+
+	if (strcmp(sensor->gmsl, "gmsl") || !sensor->cur_mode.ae_info.one_line_exp_time_ns)
+		return 0;
+
+	bandwidth = (u64)sensor->cur_mode.size.bounds_width *
+		sensor->cur_mode.bit_width * NSEC_PER_SEC;
+	bandwidth = div_u64(bandwidth, sensor->cur_mode.ae_info.one_line_exp_time_ns);
+	if (sensor->cur_mode.hdr_mode != SENSOR_MODE_LINEAR)
+		bandwidth *= 2;
+
+	rate = max96792_get_link_rate(bandwidth);
+	prev_rate = sensor->g_ctx.link_rate;
+	if (rate != prev_rate) {
+		err = max96793_set_link_rate(sensor->ser_dev, rate);
+		if (!err)
+			err = max96792_set_link_rate(sensor->dser_dev, dev, rate);
+		if (err) {
+			dev_err(dev, "%s: unable to change gmsl link rate\n", __func__);
+			/* put both ends back on the previous rate and relink */
+			if (max96793_set_link_rate(sensor->ser_dev, prev_rate) ||
+			    max96792_set_link_rate(sensor->dser_dev, dev, prev_rate))
+				dev_err(dev, "%s: unable to restore gmsl link rate\n",
+					__func__);
+			return err;
+		}
+	}
+
+	return max96792_set_csi_bandwidth(sensor->dser_dev, dev, bandwidth);
+}
+
 static int imx678_set_data_rate(struct imx678 *sensor, u32 data_rate)
 {
 	int ret = 0;
@@ -971,6 +1094,10 @@ static int imx678_set_data_rate(struct imx678 *sensor, u32 data_rate)
 		return ret;
 	}
 
+	ret = imx678_gmsl_set_bandwidth(sensor);
+	if (ret)
+		return ret;
+
 	return ret;
 
 fail:
@@ -991,19 +1118,16 @@ fail:
 static int imx678_configure_triggering_pins(struct imx678 *sensor)
 {
 	int err = 0;
-	u8 extmode;
 	u8  xvs_xhs_drv = 0xF;
 
 	pr_debug("enter %s function\n", __func__);
 
-	err = imx678_read_reg(sensor, EXTMODE, &extmode);
-
-	if (extmode == INTERNAL_SYNC) {
+	if (sensor->sync_mode == INTERNAL_SYNC) {
 		/* XVS - output, XHS - output */
 		xvs_xhs_drv = 0x0;
 		pr_debug("%s: Sensor is in - Internal sync Master mode\n",
 			__func__);
-	} else if (extmode == EXTERNAL_SYNC) {
+	} else if (sensor->sync_mode == EXTERNAL_SYNC) {
 		/* XVS - hi-z, XHS - output */
 		xvs_xhs_drv = 0x3;
 		pr_debug("%s: Sensor is in - External sync Master mode\n",
@@ -1025,6 +1149,27 @@ static int imx678_configure_triggering_pins(struct imx678 *sensor)
 	return 0;
 }
 
+static int imx678_gmsl_sync_setup(struct imx678 *sensor, u32 val)
+{
+	struct device *dev = &sensor->i2c_client->dev;
+	int err;
+
+	if (val == NO_SYNC) {
+		max96792_sync_leave(sensor->dser_dev, dev);
+		return 0;
+	}
+
+	sensor->g_ctx.sync_master = (val == INTERNAL_SYNC);
+
+	/* master serializer sends XVS over the link, slaves drive it */
+	err = max96793_xvs_setup(sensor->ser_dev,
+		sensor->g_ctx.sync_master ? max96793_IN : max96793_OUT);
+	if (err)
+		return err;
+
+	return max96792_sync_join(sensor->dser_dev, &sensor->g_ctx);
+}
+
 /*
  * Synchronization mode is for Master mode
  * Sensor can be synchronized Externaly and Internaly in Master mode
@@ -1036,6 +1181,8 @@ static int imx678_set_sync_mode(struct imx678 *sensor, u32 val)
 
 	pr_debug("enter %s sync mode %u\n", __func__, val);
 
+	sensor->sync_mode = val;
+
 	if (val == EXTERNAL_SYNC)
 		extmode = 1;
 	else
@@ -1053,9 +1200,26 @@ static int imx678_set_sync_mode(struct imx678 *sensor, u32 val)
 		return -EINVAL;
 	}
 
+	if (!(strcmp(sensor->gmsl, "gmsl")) && sensor->g_ctx.sync_group) {
+		err = imx678_gmsl_sync_setup(sensor, val);
+		if (err < 0) {
+			pr_err("%s: unable to set up gmsl sync group\n", __func__);
+			return err;
+		}
+	}
+
 	return err;
 }
 
+/* A group commit holds REGHOLD across all members, see vvsensor_common */
+static int imx678_reghold(struct imx678 *sensor, u8 hold)
+{
+	if (sensor->vs.gm.hold)
+		return 0;
+
+	return imx678_write_reg(sensor, REGHOLD, hold);
+}
+
 static int imx678_set_exp(struct imx678 *sensor, u32 exp, unsigned int which_control)
 {
 	int ret = 0;
@@ -1063,6 +1227,8 @@ static int imx678_set_exp(struct imx678 *sensor, u32 exp, unsigned int which_con
 	u32 reg_shr0 = 0;
 	u32 min_shr0;
 	u32 frame_length;
+	u32 vmax;
+	struct vvsensor_afps_frame afps;
 
 	pr_debug("enter %s exposure received: %u control: %u\n", __func__, exp, which_control);
 
@@ -1080,10 +1246,14 @@ static int imx678_set_exp(struct imx678 *sensor, u32 exp, unsigned int which_con
 		integration_time_line = exp * IMX678_K_FACTOR / sensor->cur_mode.ae_info.one_line_exp_time_ns;
 	}
 
-	if (integration_time_line > sensor->cur_mode.ae_info.max_integration_line) {
+	vmax = vvsensor_afps_propose(&sensor->vs, integration_time_line, 2, &afps);
+	if (vmax)
+		frame_length = vmax;
+
+	if (integration_time_line > afps.max_integration_line) {
 		pr_info("%s: setting integration time to max value %u\n", __func__,
-			sensor->cur_mode.ae_info.max_integration_line);
-		integration_time_line = sensor->cur_mode.ae_info.max_integration_line;
+			afps.max_integration_line);
+		integration_time_line = afps.max_integration_line;
 	}
 
 	if (integration_time_line < sensor->cur_mode.ae_info.min_integration_line) {
@@ -1121,11 +1291,25 @@ static int imx678_set_exp(struct imx678 *sensor, u32 exp, unsigned int which_con
 
 	reg_shr0 = max_t(u32, min_shr0, reg_shr0);
 	pr_debug("%s: exposure register: %u integration_time_line: %u\n", __func__, reg_shr0, integration_time_line);
-	ret = imx678_write_reg(sensor, REGHOLD, 1);
+	ret = imx678_reghold(sensor, 1);
+	if (vmax) {
+		ret |= imx678_write_reg(sensor, VMAX_HIGH, (vmax >> 16) & 0xff);
+		ret |= imx678_write_reg(sensor, VMAX_MID, (vmax >> 8) & 0xff);
+		ret |= imx678_write_reg(sensor, VMAX_LOW, vmax & 0xff);
+	}
 	ret |= imx678_write_reg(sensor, SHR0_HIGH, (reg_shr0 >> 16) & 0xff);
 	ret |= imx678_write_reg(sensor, SHR0_MID, (reg_shr0 >> 8) & 0xff);
 	ret |= imx678_write_reg(sensor, SHR0_LOW, reg_shr0 & 0xff);
-	ret |= imx678_write_reg(sensor, REGHOLD, 0);
+	ret |= imx678_reghold(sensor, 0);
+
+	/* the frame length is only the new one once it is written */
+	if (!ret)
+		vvsensor_afps_commit(&sensor->vs, &afps);
+
+	if (sensor->cur_mode.index == IMX678_DOL_INDEX)
+		sensor->applied.exp_lines = 2 * frame_length - reg_shr0;
+	else
+		sensor->applied.exp_lines = frame_length - reg_shr0;
 
 	if (ret < 0) {
 		pr_err("%s Failed to set exposure exp: %u, shr register:  %u\n",
@@ -1214,6 +1398,7 @@ static int imx678_set_vs_exp(struct imx678 *sensor, u32 exp, unsigned int which_
 	ret |= imx678_write_reg(sensor, RHS1_MID, (reg_rhs1 >> 8) & 0xff);
 	ret |= imx678_write_reg(sensor, RHS1_HIGH, (reg_rhs1 >> 16) & 0xff);
 	ret |= imx678_write_reg(sensor, REGHOLD, 0);
+	sensor->applied.vs_exp_lines = reg_rhs1 - reg_shr1;
 
 	if (ret < 0) {
 		pr_err("%s Failed to set vs exposure :\n", __func__);
@@ -1289,10 +1474,11 @@ static int imx678_set_gain(struct imx678 *sensor, u32 gain, unsigned int which_c
 	}
 
 	pr_debug("%s: gain register: %u\n", __func__, gain_reg);
-	ret = imx678_write_reg(sensor, REGHOLD, 1);
+	ret = imx678_reghold(sensor, 1);
 	ret |= imx678_write_reg(sensor, GAIN_0_HIGH, (gain_reg>>8) & 0xff);
 	ret |= imx678_write_reg(sensor, GAIN_0_LOW, gain_reg & 0xff);
-	ret |= imx678_write_reg(sensor, REGHOLD, 0);
+	ret |= imx678_reghold(sensor, 0);
+	sensor->applied.gain_reg = gain_reg;
 
 	return ret;
 }
@@ -1325,6 +1511,7 @@ static int imx678_set_vs_gain(struct imx678 *sensor, u32 gain, u8 which_control)
 	ret |= imx678_write_reg(sensor, GAIN_1_HIGH, (gain_reg>>8) & 0xff);
 	ret |= imx678_write_reg(sensor, GAIN_1_LOW, gain_reg & 0xff);
 	ret |= imx678_write_reg(sensor, REGHOLD, 0);
+	sensor->applied.vs_gain_reg = gain_reg;
 
 	return ret;
 }
@@ -1433,6 +1620,7 @@ static int imx678_set_fps(struct imx678 *sensor, u32 fps, u32 which_control)
 
 
 	sensor->cur_mode.ae_info.curr_frm_len_lines = fps_reg;
+	vvsensor_afps_reset(&sensor->vs);
 	return ret;
 }
 
@@ -1542,42 +1730,98 @@ static int imx678_s_ctrl(struct v4l2_ctrl *ctrl)
 	return ret;
 }
 
+static u32 imx678_csi_lanes(struct imx678 *sensor)
+{
+	if (!strcmp(sensor->gmsl, "gmsl") && sensor->g_ctx.num_csi_lanes)
+		return sensor->g_ctx.num_csi_lanes;
+
+	return sensor->cur_mode.mipi_info.mipi_lane;
+}
+
+static int imx678_link_freq_index(struct imx678 *sensor)
+{
+	struct device *dev = &sensor->i2c_client->dev;
+	s64 freq;
+	u32 i;
+
+	if (strcmp(sensor->gmsl, "gmsl"))
+		return sensor->ctrls.data_rate->val;
+
+	/* the CSI receiver sees the deserializer rate, not the sensor one */
+	freq = (s64)max96792_get_csi_rate(sensor->dser_dev) * 1000000 / 2;
+	for (i = IMX678_LINK_FREQ_GMSL; i < ARRAY_SIZE(imx678_link_freq_menu); i++) {
+		if (imx678_link_freq_menu[i] == freq)
+			return i;
+	}
+
+	dev_warn(dev, "%s: deserializer CSI rate %lld Hz is not in the link frequency menu\n",
+		 __func__, freq);
+
+	return -EINVAL;
+}
+
+static int imx678_g_volatile_ctrl(struct v4l2_ctrl *ctrl)
+{
+	struct v4l2_subdev *sd = ctrl_to_sd(ctrl);
+	struct imx678 *sensor = to_imx678_dev(sd);
+	int idx = imx678_link_freq_index(sensor);
+
+	if (idx < 0)
+		return idx;
+
+	switch (ctrl->id) {
+	case V4L2_CID_LINK_FREQ:
+		ctrl->val = idx;
+		break;
+	case V4L2_CID_PIXEL_RATE:
+		ctrl->val64 = div_u64(imx678_link_freq_menu[idx] * 2 *
+			imx678_csi_lanes(sensor), sensor->cur_mode.bit_width);
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
 static const struct v4l2_ctrl_ops imx678_ctrl_ops = {
+	.g_volatile_ctrl = imx678_g_volatile_ctrl,
 	.s_ctrl = imx678_s_ctrl,
 };
 
-static int imx678_get_format_code(struct imx678 *sensor, u32 *code)
+/* Media bus code of the mode bayer pattern at the given bit width */
+static void imx678_format_code_for(struct imx678 *sensor, u32 bit_width,
+				u32 *code)
 {
-	pr_debug("enter %s function\n", __func__);
 	switch (sensor->cur_mode.bayer_pattern) {
 	case BAYER_RGGB:
-		if (sensor->cur_mode.bit_width == 8)
+		if (bit_width == 8)
 			*code = MEDIA_BUS_FMT_SRGGB8_1X8;
-		else if (sensor->cur_mode.bit_width == 10)
+		else if (bit_width == 10)
 			*code = MEDIA_BUS_FMT_SRGGB10_1X10;
 		else
 			*code = MEDIA_BUS_FMT_SRGGB12_1X12;
 		break;
 	case BAYER_GRBG:
-		if (sensor->cur_mode.bit_width == 8)
+		if (bit_width == 8)
 			*code = MEDIA_BUS_FMT_SGRBG8_1X8;
-		else if (sensor->cur_mode.bit_width == 10)
+		else if (bit_width == 10)
 			*code = MEDIA_BUS_FMT_SGRBG10_1X10;
 		else
 			*code = MEDIA_BUS_FMT_SGRBG12_1X12;
 		break;
 	case BAYER_GBRG:
-		if (sensor->cur_mode.bit_width == 8)
+		if (bit_width == 8)
 			*code = MEDIA_BUS_FMT_SGBRG8_1X8;
-		else if (sensor->cur_mode.bit_width == 10)
+		else if (bit_width == 10)
 			*code = MEDIA_BUS_FMT_SGBRG10_1X10;
 		else
 			*code = MEDIA_BUS_FMT_SGBRG12_1X12;
 		break;
 	case BAYER_BGGR:
-		if (sensor->cur_mode.bit_width == 8)
+		if (bit_width == 8)
 			*code = MEDIA_BUS_FMT_SBGGR8_1X8;
-		else if (sensor->cur_mode.bit_width == 10)
+		else if (bit_width == 10)
 			*code = MEDIA_BUS_FMT_SBGGR10_1X10;
 		else
 			*code = MEDIA_BUS_FMT_SBGGR12_1X12;
@@ -1585,9 +1829,47 @@ static int imx678_get_format_code(struct imx678 *sensor, u32 *code)
 	default:
 		break;
 	}
+}
+
+static int imx678_get_format_code(struct imx678 *sensor, u32 *code)
+{
+	pr_debug("enter %s function\n", __func__);
+	imx678_format_code_for(sensor, sensor->cur_mode.bit_width, code);
 	return 0;
 }
 
+/*
+ * The all pixel mode outputs RAW10 or RAW12 as requested by the bus code,
+ * the binning tables fix the output to 12 bit. The sensor has no 8 bit
+ * output.
+ */
+static bool imx678_bit_width_selectable(struct imx678 *sensor)
+{
+	return sensor->cur_mode.index == IMX678_ALL_PIXEL_INDEX;
+}
+
+/* Other codes keep the bit width of the mode */
+static u32 imx678_code_bit_width(struct imx678 *sensor, u32 code)
+{
+	if (!imx678_bit_width_selectable(sensor))
+		return sensor->cur_mode.bit_width;
+
+	switch (code) {
+	case MEDIA_BUS_FMT_SRGGB10_1X10:
+	case MEDIA_BUS_FMT_SGRBG10_1X10:
+	case MEDIA_BUS_FMT_SGBRG10_1X10:
+	case MEDIA_BUS_FMT_SBGGR10_1X10:
+		return 10;
+	case MEDIA_BUS_FMT_SRGGB12_1X12:
+	case MEDIA_BUS_FMT_SGRBG12_1X12:
+	case MEDIA_BUS_FMT_SGBRG12_1X12:
+	case MEDIA_BUS_FMT_SBGGR12_1X12:
+		return 12;
+	default:
+		return sensor->cur_mode.bit_width;
+	}
+}
+
 static int imx678_parse_dt(struct imx678 *sensor, struct i2c_client *client)
 {
 	struct device_node *node = client->dev.of_node;
@@ -1654,6 +1936,82 @@ static int imx678_set_pixel_format(struct imx678 *sensor)
 	return err;
 }
 
+/* Exposure of lines in the units of VVSENSORIOC_S_EXP, us << 10 */
+static u32 imx678_lines_to_exp(struct imx678 *sensor, u32 lines)
+{
+	return div_u64((u64)lines * sensor->cur_mode.ae_info.one_line_exp_time_ns << 10,
+		       IMX678_K_FACTOR);
+}
+
+static u32 imx678_lines_to_ns(struct imx678 *sensor, u32 lines)
+{
+	return lines * sensor->cur_mode.ae_info.one_line_exp_time_ns;
+}
+
+/* Gain register in the units of VVSENSORIOC_S_GAIN */
+static u32 imx678_gain_reg_to_gain(u32 gain_reg)
+{
+	return gain_reg2times[min_t(u32, gain_reg, IMX678_GAIN_REG_LEN - 1)];
+}
+
+static int imx678_vs_set_exp(struct vvsensor_ctx *ctx, u32 exp)
+{
+	return imx678_set_exp(container_of(ctx, struct imx678, vs), exp, 0);
+}
+
+static int imx678_vs_set_gain(struct vvsensor_ctx *ctx, u32 gain)
+{
+	return imx678_set_gain(container_of(ctx, struct imx678, vs), gain, 0);
+}
+
+static int imx678_vs_set_fps(struct vvsensor_ctx *ctx, u32 fps)
+{
+	return imx678_set_fps(container_of(ctx, struct imx678, vs), fps, 0);
+}
+
+static int imx678_vs_reghold(struct vvsensor_ctx *ctx, u8 hold)
+{
+	return imx678_write_reg(container_of(ctx, struct imx678, vs), REGHOLD, hold);
+}
+
+static void imx678_vs_get_ae(struct vvsensor_ctx *ctx, u32 *exp, u32 *gain)
+{
+	struct imx678 *sensor = container_of(ctx, struct imx678, vs);
+
+	*exp = imx678_lines_to_exp(sensor, sensor->applied.exp_lines);
+	*gain = imx678_gain_reg_to_gain(sensor->applied.gain_reg);
+}
+
+static const struct vvsensor_ops imx678_vs_ops = {
+	.set_exp  = imx678_vs_set_exp,
+	.set_gain = imx678_vs_set_gain,
+	.set_fps  = imx678_vs_set_fps,
+	.reghold  = imx678_vs_reghold,
+	.get_ae   = imx678_vs_get_ae,
+};
+
+static int imx678_s_exp_ae(struct imx678 *sensor, void __user *arg)
+{
+	struct vvcam_exp_ae_s exp_ae;
+	int ret;
+
+	if (copy_from_user(&exp_ae, arg, sizeof(exp_ae)))
+		return -EFAULT;
+
+	ret = imx678_set_exp(sensor, exp_ae.exp, 0);
+	if (ret)
+		return ret;
+
+	exp_ae.exp = imx678_lines_to_exp(sensor, sensor->applied.exp_lines);
+	exp_ae.lines = sensor->applied.exp_lines;
+	exp_ae.ns = imx678_lines_to_ns(sensor, sensor->applied.exp_lines);
+	exp_ae.ae_info = sensor->cur_mode.ae_info;
+	if (copy_to_user(arg, &exp_ae, sizeof(exp_ae)))
+		return -EFAULT;
+
+	return 0;
+}
+
 static int imx678_s_stream(struct v4l2_subdev *sd, int enable)
 {
 	struct i2c_client *client = v4l2_get_subdevdata(sd);
@@ -1690,17 +2048,34 @@ static int imx678_s_stream(struct v4l2_subdev *sd, int enable)
 		}
 		imx678_write_reg(sensor, STANDBY, 0x00);
 		msleep(30);
-		imx678_write_reg(sensor, XMSTA, 0x00);
+		if (!sensor->g_ctx.sync_group) {
+			imx678_write_reg(sensor, XMSTA, 0x00);
+		} else if (sensor->g_ctx.sync_master) {
+			/* deferred until all slaves of the group stream */
+			if (max96792_sync_stream(sensor->dser_dev,
+					&sensor->i2c_client->dev, true))
+				imx678_write_reg(sensor, XMSTA, 0x00);
+		} else {
+			imx678_write_reg(sensor, XMSTA, 0x00);
+			max96792_sync_stream(sensor->dser_dev,
+					&sensor->i2c_client->dev, true);
+		}
 	} else  {
 		pr_info("Disable stream\n");
 		if (!(strcmp(sensor->gmsl, "gmsl")))
 			max96792_stop_streaming(sensor->dser_dev,
 						&sensor->i2c_client->dev);
+		if (sensor->g_ctx.sync_group)
+			max96792_sync_stream(sensor->dser_dev,
+					&sensor->i2c_client->dev, false);
 		imx678_write_reg(sensor, STANDBY, 0x01);
 		msleep(30);
 		imx678_write_reg(sensor, XMSTA, 0x01);
 	}
 
+	vvsensor_fq_stream(&sensor->vs, enable);
+	vvsensor_group_stream(&sensor->vs, enable);
+
 	return 0;
 
 exit:
@@ -1738,6 +2113,7 @@ static int imx678_gmsl_serdes_setup(struct imx678 *priv)
 		pr_err("serializer gmsl setup failed\n");
 		goto error;
 	}
+	priv->g_ctx.link_rate = GMSL_LINK_RATE_12G;
 
 
 	pr_debug("%s: max96792_setup_link\n", __func__);
@@ -1787,51 +2163,83 @@ static void imx678_gmsl_serdes_reset(struct imx678 *priv)
 	mutex_unlock(&priv->lock);
 }
 
+static void imx678_gmsl_link_notify(struct device *s_dev, u32 event)
+{
+	struct i2c_client *client = to_i2c_client(s_dev);
+	struct imx678 *sensor = client_to_imx678(client);
+	struct v4l2_event ev = {
+		.type = GMSL_V4L2_EVENT_LINK,
+	};
+
+	dev_dbg(s_dev, "%s: gmsl link event %u\n", __func__, event);
+
+	ev.u.data[0] = event;
+	if (sensor->sd.devnode)
+		v4l2_event_queue(sensor->sd.devnode, &ev);
+}
+
+static int imx678_gmsl_sync_start(struct device *s_dev)
+{
+	struct i2c_client *client = to_i2c_client(s_dev);
+	struct imx678 *sensor = client_to_imx678(client);
+
+	dev_dbg(s_dev, "%s: releasing sync master\n", __func__);
+
+	return imx678_write_reg(sensor, XMSTA, 0x00);
+}
+
+static int imx678_subscribe_event(struct v4l2_subdev *sd, struct v4l2_fh *fh,
+				struct v4l2_event_subscription *sub)
+{
+	switch (sub->type) {
+	case GMSL_V4L2_EVENT_LINK:
+		return v4l2_event_subscribe(fh, sub, 4, NULL);
+	case V4L2_EVENT_CTRL:
+		return v4l2_ctrl_subdev_subscribe_event(sd, fh, sub);
+	default:
+		return -EINVAL;
+	}
+}
+
 static int imx678_enum_mbus_code(struct v4l2_subdev *sd,
 				struct v4l2_subdev_state *state,
 				struct v4l2_subdev_mbus_code_enum *code)
 {
 	struct i2c_client *client = v4l2_get_subdevdata(sd);
 	struct imx678 *sensor = client_to_imx678(client);
+	u32 bit_width;
 	u32 cur_code = MEDIA_BUS_FMT_SRGGB10_1X10;
 
 	pr_debug("enter %s function\n", __func__);
-	if (code->index > 0)
+	if (code->index > 1)
+		return -EINVAL;
+
+	/* the second code is the other bit width, where the mode has one */
+	mutex_lock(&sensor->lock);
+	if (code->index && !imx678_bit_width_selectable(sensor)) {
+		mutex_unlock(&sensor->lock);
 		return -EINVAL;
-	imx678_get_format_code(sensor, &cur_code);
+	}
+	bit_width = sensor->cur_mode.bit_width;
+	if (code->index)
+		bit_width = (bit_width == 10) ? 12 : 10;
+	imx678_format_code_for(sensor, bit_width, &cur_code);
+	mutex_unlock(&sensor->lock);
 	code->code = cur_code;
 
 	return 0;
 }
 
-static int imx678_set_fmt(struct v4l2_subdev *sd,
-			struct v4l2_subdev_state *state,
-			struct v4l2_subdev_format *fmt)
+/* Called with sensor->lock held */
+static int imx678_apply_mode(struct imx678 *sensor)
 {
 	int ret = 0;
-	struct i2c_client *client = v4l2_get_subdevdata(sd);
-	struct imx678 *sensor = client_to_imx678(client);
-
-	mutex_lock(&sensor->lock);
-	pr_debug("enter %s function\n", __func__);
-	if ((fmt->format.width != sensor->cur_mode.size.bounds_width) ||
-	    (fmt->format.height != sensor->cur_mode.size.bounds_height)) {
-		pr_err("%s:set sensor format %dx%d error\n",
-			__func__, fmt->format.width, fmt->format.height);
-		mutex_unlock(&sensor->lock);
-		return -EINVAL;
-	}
-
-	imx678_get_format_code(sensor, &fmt->format.code);
-	fmt->format.field = V4L2_FIELD_NONE;
-	sensor->format = fmt->format;
 
 	ret = imx678_write_reg_arry(sensor,
 		(struct vvcam_sccb_data_s *)sensor->cur_mode.preg_data,
 		sensor->cur_mode.reg_data_count);
 	if (ret < 0) {
 		pr_err("%s:imx678_write_reg_arry error\n", __func__);
-		mutex_unlock(&sensor->lock);
 		return -EINVAL;
 	}
 
@@ -1839,7 +2247,6 @@ static int imx678_set_fmt(struct v4l2_subdev *sd,
 	if (ret < 0) {
 		pr_err("%s:imx678_write_reg_arry error, failed to set pixel format\n",
 			__func__);
-		mutex_unlock(&sensor->lock);
 		return -EINVAL;
 	}
 
@@ -1868,6 +2275,9 @@ static int imx678_set_fmt(struct v4l2_subdev *sd,
 	case IMX678_DOL_INDEX:
 		pr_info("%s:Setting mode 2 ", __func__);
 		ret = imx678_write_reg_arry(sensor, (struct vvcam_sccb_data_s *)imx678_setting_dol_hdr, ARRAY_SIZE(imx678_setting_dol_hdr));
+		/* split the exposures on VC 0 and 1, as reported by get_frame_desc */
+		if (!ret && strcmp(sensor->gmsl, "gmsl"))
+			ret = imx678_write_reg(sensor, VCMODE, 0x01);
 		if (ret < 0) {
 			pr_err("%s:imx678_write_reg_arry error, failed to set up resolution\n", __func__);
 			return -EINVAL;
@@ -1891,10 +2301,91 @@ static int imx678_set_fmt(struct v4l2_subdev *sd,
 		return -EINVAL;
 	}
 
-	mutex_unlock(&sensor->lock);
 	return 0;
 }
 
+static int imx678_shadow_replay(struct imx678 *sensor)
+{
+	int ret;
+	int i;
+
+	if (!sensor->shadow_valid)
+		return 0;
+
+	ret = imx678_write_reg(sensor, REGHOLD, 1);
+	for (i = 0; i < ARRAY_SIZE(imx678_shadow_regs); i++) {
+		if (sensor->shadow_valid & BIT(i))
+			ret |= imx678_write_reg(sensor, imx678_shadow_regs[i],
+					sensor->shadow_val[i]);
+	}
+	ret |= imx678_write_reg(sensor, REGHOLD, 0);
+
+	return ret;
+}
+
+/*
+ * Reprogram the sensor after it lost its registers: mode tables first,
+ * then the controls that are not part of them, then the last AE values.
+ * Called with sensor->lock held.
+ */
+static int imx678_restore_mode(struct imx678 *sensor)
+{
+	u8 shadow_val[ARRAY_SIZE(imx678_shadow_regs)];
+	u32 shadow_valid = sensor->shadow_valid;
+	int ret;
+
+	/* applying the mode rewrites some shadowed registers with defaults */
+	memcpy(shadow_val, sensor->shadow_val, sizeof(shadow_val));
+
+	ret = imx678_apply_mode(sensor);
+
+	memcpy(sensor->shadow_val, shadow_val, sizeof(shadow_val));
+	sensor->shadow_valid = shadow_valid;
+
+	if (ret < 0)
+		return ret;
+
+	ret = imx678_set_sync_mode(sensor, sensor->ctrls.sync_mode->val);
+	if (sensor->ctrls.test_pattern->val)
+		ret |= imx678_set_test_pattern(sensor,
+				sensor->ctrls.test_pattern->val);
+	ret |= imx678_shadow_replay(sensor);
+
+	return ret;
+}
+
+static int imx678_set_fmt(struct v4l2_subdev *sd,
+			struct v4l2_subdev_state *state,
+			struct v4l2_subdev_format *fmt)
+{
+	int ret = 0;
+	struct i2c_client *client = v4l2_get_subdevdata(sd);
+	struct imx678 *sensor = client_to_imx678(client);
+
+	mutex_lock(&sensor->lock);
+	pr_debug("enter %s function\n", __func__);
+	if ((fmt->format.width != sensor->cur_mode.size.bounds_width) ||
+	    (fmt->format.height != sensor->cur_mode.size.bounds_height)) {
+		pr_err("%s:set sensor format %dx%d error\n",
+			__func__, fmt->format.width, fmt->format.height);
+		mutex_unlock(&sensor->lock);
+		return -EINVAL;
+	}
+
+	sensor->cur_mode.bit_width = imx678_code_bit_width(sensor, fmt->format.code);
+	imx678_get_format_code(sensor, &fmt->format.code);
+	fmt->format.field = V4L2_FIELD_NONE;
+	sensor->format = fmt->format;
+
+	sensor->shadow_valid = 0;
+	ret = imx678_apply_mode(sensor);
+	if (ret == 0)
+		sensor->mode_applied = true;
+
+	mutex_unlock(&sensor->lock);
+	return ret;
+}
+
 static int imx678_get_fmt(struct v4l2_subdev *sd,
 			struct v4l2_subdev_state *state,
 			struct v4l2_subdev_format *fmt)
@@ -1917,6 +2408,10 @@ static long imx678_priv_ioctl(struct v4l2_subdev *sd, unsigned int cmd, void *ar
 	struct vvcam_sccb_data_s sensor_reg;
 
 	pr_debug("enter %s %u\n", __func__, cmd);
+	/* waits for the group commit, which takes the sensor lock */
+	if (cmd == VVSENSORIOC_S_GROUP_AE)
+		return vvsensor_s_group_ae(&sensor->vs, arg);
+
 	mutex_lock(&sensor->lock);
 	switch (cmd) {
 	case VVSENSORIOC_S_POWER:
@@ -1971,18 +2466,30 @@ static long imx678_priv_ioctl(struct v4l2_subdev *sd, unsigned int cmd, void *ar
 		break;
 	case VVSENSORIOC_S_EXP:
 		ret = imx678_set_exp(sensor, *(u32 *)arg, 0);
+		if (!ret)
+			ret = put_user(imx678_lines_to_exp(sensor, sensor->applied.exp_lines),
+				       (u32 __user *)arg);
 		break;
 	case VVSENSORIOC_S_VSEXP:
 		ret = imx678_set_vs_exp(sensor, *(u32 *)arg, 0);
+		if (!ret)
+			ret = put_user(imx678_lines_to_exp(sensor, sensor->applied.vs_exp_lines),
+				       (u32 __user *)arg);
 		break;
 	case VVSENSORIOC_S_LONG_GAIN:
 		ret = imx678_set_exp_gain(sensor, *(u32 *)arg, 0);
 		break;
 	case VVSENSORIOC_S_GAIN:
 		ret = imx678_set_gain(sensor, *(u32 *)arg, 0);
+		if (!ret)
+			ret = put_user(imx678_gain_reg_to_gain(sensor->applied.gain_reg),
+				       (u32 __user *)arg);
 		break;
 	case VVSENSORIOC_S_VSGAIN:
 		ret = imx678_set_vs_gain(sensor, *(u32 *)arg, 0);
+		if (!ret)
+			ret = put_user(imx678_gain_reg_to_gain(sensor->applied.vs_gain_reg),
+				       (u32 __user *)arg);
 		break;
 	case VVSENSORIOC_S_FPS:
 		ret = imx678_set_fps(sensor, *(u32 *)arg, 0);
@@ -2008,6 +2515,19 @@ static long imx678_priv_ioctl(struct v4l2_subdev *sd, unsigned int cmd, void *ar
 	case VVSENSORIOC_S_DATA_RATE:
 		ret = imx678_set_data_rate(sensor, *(u32 *)arg);
 		break;
+	case VVSENSORIOC_S_FRAME_QUEUE:
+		ret = vvsensor_s_frame_queue(&sensor->vs,
+					     sensor->stream_status, arg);
+		break;
+	case VVSENSORIOC_G_FRAME_QUEUE:
+		ret = vvsensor_g_frame_queue(&sensor->vs, arg);
+		break;
+	case VVSENSORIOC_S_MIN_AFPS:
+		ret = vvsensor_set_min_afps(&sensor->vs, *(u32 *)arg);
+		break;
+	case VVSENSORIOC_S_EXP_AE:
+		ret = imx678_s_exp_ae(sensor, arg);
+		break;
 	case VVSENSORIOC_S_SYNC_MODE:
 		ret = imx678_set_sync_mode(sensor, *(u32 *)arg);
 		break;
@@ -2020,19 +2540,130 @@ static long imx678_priv_ioctl(struct v4l2_subdev *sd, unsigned int cmd, void *ar
 	return ret;
 }
 
+/* VVSENSORIOC_S_STREAM calls imx678_s_stream() with the lock held */
+static int imx678_video_s_stream(struct v4l2_subdev *sd, int enable)
+{
+	struct imx678 *sensor = to_imx678_dev(sd);
+	struct device *dev = &sensor->i2c_client->dev;
+	int ret;
+
+	if (enable) {
+		ret = pm_runtime_resume_and_get(dev);
+		if (ret < 0)
+			return ret;
+	}
+
+	mutex_lock(&sensor->lock);
+	ret = imx678_s_stream(sd, enable);
+	mutex_unlock(&sensor->lock);
+
+	if (!enable || ret) {
+		pm_runtime_mark_last_busy(dev);
+		pm_runtime_put_autosuspend(dev);
+	}
+
+	return ret;
+}
+
+/* An open subdev node keeps the sensor powered for the vvcam ioctls */
+static int imx678_open(struct v4l2_subdev *sd, struct v4l2_subdev_fh *fh)
+{
+	struct imx678 *sensor = to_imx678_dev(sd);
+
+	return pm_runtime_resume_and_get(&sensor->i2c_client->dev);
+}
+
+static int imx678_close(struct v4l2_subdev *sd, struct v4l2_subdev_fh *fh)
+{
+	struct imx678 *sensor = to_imx678_dev(sd);
+
+	pm_runtime_mark_last_busy(&sensor->i2c_client->dev);
+	pm_runtime_put_autosuspend(&sensor->i2c_client->dev);
+
+	return 0;
+}
+
+static const struct v4l2_subdev_internal_ops imx678_internal_ops = {
+	.open = imx678_open,
+	.close = imx678_close,
+};
+
 static const struct v4l2_subdev_video_ops imx678_subdev_video_ops = {
-	.s_stream = imx678_s_stream,
+	.s_stream = imx678_video_s_stream,
 };
 
+static int imx678_get_mbus_config(struct v4l2_subdev *sd, unsigned int pad,
+				struct v4l2_mbus_config *cfg)
+{
+	struct imx678 *sensor = to_imx678_dev(sd);
+
+	/* the receiver can not be set up for an unknown link frequency */
+	if (imx678_link_freq_index(sensor) < 0)
+		return -EINVAL;
+
+	cfg->type = V4L2_MBUS_CSI2_DPHY;
+	cfg->bus.mipi_csi2.flags = 0;
+	cfg->bus.mipi_csi2.num_data_lanes = imx678_csi_lanes(sensor);
+
+	return 0;
+}
+
+/*
+ * In DOL HDR mode the long and short exposures are sent on virtual
+ * channels 0 and 1, VCMODE is set when the mode is applied. On a GMSL
+ * link VCMODE is left off and the routing to the receiver defaults.
+ */
+static int imx678_get_frame_desc(struct v4l2_subdev *sd, unsigned int pad,
+				struct v4l2_mbus_frame_desc *fd)
+{
+	struct imx678 *sensor = to_imx678_dev(sd);
+	u32 i, num_entries = 1;
+	u8 dt;
+
+	if (!strcmp(sensor->gmsl, "gmsl"))
+		return -ENOIOCTLCMD;
+
+	switch (sensor->cur_mode.bit_width) {
+	case 8:
+		dt = MIPI_CSI2_DT_RAW8;
+		break;
+	case 10:
+		dt = MIPI_CSI2_DT_RAW10;
+		break;
+	default:
+		dt = MIPI_CSI2_DT_RAW12;
+		break;
+	}
+
+	if (sensor->cur_mode.index == IMX678_DOL_INDEX)
+		num_entries = 2;
+
+	memset(fd, 0, sizeof(*fd));
+	fd->type = V4L2_MBUS_FRAME_DESC_TYPE_CSI2;
+	fd->num_entries = num_entries;
+	for (i = 0; i < num_entries; i++) {
+		fd->entry[i].stream = i;
+		fd->entry[i].pixelcode = sensor->format.code;
+		fd->entry[i].bus.csi2.vc = i;
+		fd->entry[i].bus.csi2.dt = dt;
+	}
+
+	return 0;
+}
+
 static const struct v4l2_subdev_pad_ops imx678_subdev_pad_ops = {
 	.enum_mbus_code = imx678_enum_mbus_code,
 	.set_fmt = imx678_set_fmt,
 	.get_fmt = imx678_get_fmt,
+	.get_mbus_config = imx678_get_mbus_config,
+	.get_frame_desc = imx678_get_frame_desc,
 };
 
 static const struct v4l2_subdev_core_ops imx678_subdev_core_ops = {
 	.s_power = imx678_s_power,
 	.ioctl = imx678_priv_ioctl,
+	.subscribe_event = imx678_subscribe_event,
+	.unsubscribe_event = v4l2_event_subdev_unsubscribe,
 };
 
 static const struct v4l2_subdev_ops imx678_subdev_ops = {
@@ -2069,6 +2700,7 @@ static int imx678_probe(struct i2c_client *client)
 	const char *str_value;
 	const char *str_value1[2];
 	int  i;
+	u32 group_id;
 	int err = 0;
 
 	pr_debug("enter %s function\n", __func__);
@@ -2090,6 +2722,8 @@ static int imx678_probe(struct i2c_client *client)
 	mutex_init(&sensor->lock);
 
 	sensor->i2c_client = client;
+	vvsensor_init(&sensor->vs, &client->dev, &sensor->lock, &imx678_vs_ops,
+		      &sensor->cur_mode);
 	if (strcmp(sensor->gmsl, "gmsl")) {
 		sensor->rst_gpio = of_get_named_gpio(dev->of_node, "rst-gpios", 0);
 		if (!gpio_is_valid(sensor->rst_gpio))
@@ -2172,6 +2806,11 @@ static int imx678_probe(struct i2c_client *client)
 
 		sensor->dser_dev = &dser_i2c->dev;
 
+		/* resume order: deserializer, serializer, sensor */
+		device_link_add(dev, sensor->ser_dev, DL_FLAG_STATELESS);
+		device_link_add(sensor->ser_dev, sensor->dser_dev,
+				DL_FLAG_STATELESS);
+
 		/* populate g_ctx from DT */
 		gmsl = of_get_child_by_name(node, "gmsl-link");
 		if (gmsl == NULL) {
@@ -2268,6 +2907,12 @@ static int imx678_probe(struct i2c_client *client)
 		}
 
 		sensor->g_ctx.s_dev = dev;
+		sensor->g_ctx.notify = imx678_gmsl_link_notify;
+		sensor->g_ctx.sync_start = imx678_gmsl_sync_start;
+
+		/* optional XVS sync group, role follows the sync mode control */
+		of_property_read_u32(node, "sync-group",
+				&sensor->g_ctx.sync_group);
 
 		//mutex_init(&serdes_lock__);
 		/* Pair sensor to serializer dev */
@@ -2314,7 +2959,8 @@ static int imx678_probe(struct i2c_client *client)
 
 	sd = &sensor->sd;
 	v4l2_i2c_subdev_init(sd, client, &imx678_subdev_ops);
-	sd->flags |= V4L2_SUBDEV_FL_HAS_DEVNODE;
+	sd->internal_ops = &imx678_internal_ops;
+	sd->flags |= V4L2_SUBDEV_FL_HAS_DEVNODE | V4L2_SUBDEV_FL_HAS_EVENTS;
 	sd->dev = &client->dev;
 	sd->entity.ops = &imx678_sd_media_ops;
 	sd->entity.function = MEDIA_ENT_F_CAM_SENSOR;
@@ -2356,6 +3002,16 @@ static int imx678_probe(struct i2c_client *client)
 	sensor->ctrls.test_pattern = v4l2_ctrl_new_std_menu_items(&sensor->ctrls.handler, &imx678_ctrl_ops, V4L2_CID_TEST_PATTERN,
 						ARRAY_SIZE(test_pattern_menu) - 1, 0, 0, test_pattern_menu);
 
+	sensor->ctrls.link_freq = v4l2_ctrl_new_int_menu(&sensor->ctrls.handler, &imx678_ctrl_ops, V4L2_CID_LINK_FREQ,
+					ARRAY_SIZE(imx678_link_freq_menu) - 1, imx678_ctrl_data_rate[0].def, imx678_link_freq_menu);
+	if (sensor->ctrls.link_freq)
+		sensor->ctrls.link_freq->flags |= V4L2_CTRL_FLAG_VOLATILE |
+						  V4L2_CTRL_FLAG_READ_ONLY;
+	sensor->ctrls.pixel_rate = v4l2_ctrl_new_std(&sensor->ctrls.handler, &imx678_ctrl_ops, V4L2_CID_PIXEL_RATE,
+					1, S64_MAX, 1, 1);
+	if (sensor->ctrls.pixel_rate)
+		sensor->ctrls.pixel_rate->flags |= V4L2_CTRL_FLAG_VOLATILE;
+
 	sensor->sd.ctrl_handler = &sensor->ctrls.handler;
 	if (sensor->ctrls.handler.error) {
 		retval = sensor->ctrls.handler.error;
@@ -2370,15 +3026,33 @@ static int imx678_probe(struct i2c_client *client)
 		goto free_ctrls;
 	}
 
+	/* the sensor is powered, keep it so until probe is done */
+	pm_runtime_set_active(dev);
+	pm_runtime_get_noresume(dev);
+	pm_runtime_enable(dev);
+
 	retval = v4l2_async_register_subdev_sensor(sd);
 	if (retval < 0) {
 		dev_err(&client->dev, "%s--Async register failed, ret=%d\n",
 			__func__, retval);
+		pm_runtime_disable(dev);
+		pm_runtime_set_suspended(dev);
+		pm_runtime_put_noidle(dev);
 		goto probe_err_free_entiny;
 	}
 
+	/* optional AE group of the sensors sharing XVS */
+	if (!of_property_read_u32(dev->of_node, "sync-group", &group_id) &&
+	    vvsensor_group_join(&sensor->vs, group_id))
+		dev_warn(dev, "sync-group %u is full\n", group_id);
+
 	pr_info("%s camera mipi imx678, is found\n", __func__);
 
+	pm_runtime_set_autosuspend_delay(dev, 1000);
+	pm_runtime_use_autosuspend(dev);
+	pm_runtime_mark_last_busy(dev);
+	pm_runtime_put_autosuspend(dev);
+
 	return 0;
 
 free_ctrls:
@@ -2400,17 +3074,27 @@ static void imx678_remove(struct i2c_client *client)
 	int err = 0;
 
 	pr_debug("enter %s function\n", __func__);
+	/* the Hi-Z write below needs the sensor out of reset */
+	pm_runtime_get_sync(&client->dev);
+
 	err = imx678_write_reg(sensor, XVS_XHS_DRV, 0xF);
 	if (err < 0)
 		pr_err("%s: failed to set XVS XHS to Hi-Z\n", __func__);
 
 	if (!(strcmp(sensor->gmsl, "gmsl"))) {
+		max96792_sync_leave(sensor->dser_dev, &sensor->i2c_client->dev);
 		max96792_sdev_unregister(sensor->dser_dev, &sensor->i2c_client->dev);
+		device_link_remove(&client->dev, sensor->ser_dev);
+		device_link_remove(sensor->ser_dev, sensor->dser_dev);
 		imx678_gmsl_serdes_reset(sensor);
 	}
 
+	vvsensor_cleanup(&sensor->vs);
 	v4l2_async_unregister_subdev(sd);
 	media_entity_cleanup(&sd->entity);
+	pm_runtime_disable(&client->dev);
+	pm_runtime_set_suspended(&client->dev);
+	pm_runtime_put_noidle(&client->dev);
 	imx678_power_off(sensor);
 	mutex_destroy(&sensor->lock);
 }
@@ -2420,9 +3104,11 @@ static int __maybe_unused imx678_suspend(struct device *dev)
 	struct i2c_client *client = to_i2c_client(dev);
 	struct imx678 *sensor = client_to_imx678(client);
 
+	mutex_lock(&sensor->lock);
 	sensor->resume_status = sensor->stream_status;
 	if (sensor->resume_status)
 		imx678_s_stream(&sensor->sd, 0);
+	mutex_unlock(&sensor->lock);
 
 	return 0;
 }
@@ -2431,15 +3117,66 @@ static int __maybe_unused imx678_resume(struct device *dev)
 {
 	struct i2c_client *client = to_i2c_client(dev);
 	struct imx678 *sensor = client_to_imx678(client);
+	int ret = 0;
 
+	/* serdes registers are restored by their own resume (device links) */
+	mutex_lock(&sensor->lock);
+	if (sensor->mode_applied && sensor->powered_on)
+		ret = imx678_restore_mode(sensor);
+
+	if (ret < 0) {
+		mutex_unlock(&sensor->lock);
+		dev_err(dev, "%s: failed to restore sensor mode\n", __func__);
+		return ret;
+	}
+
+	/* resume to first frame is measured by the CSIS driver */
 	if (sensor->resume_status)
 		imx678_s_stream(&sensor->sd, 1);
+	mutex_unlock(&sensor->lock);
 
 	return 0;
 }
 
+/*
+ * Runtime PM holds a directly connected sensor in reset while unused. On a
+ * GMSL link the sensor is powered with the serializer, and a deserializer
+ * power cycle takes seconds, so the link stays up.
+ */
+static int __maybe_unused imx678_runtime_suspend(struct device *dev)
+{
+	struct imx678 *sensor = client_to_imx678(to_i2c_client(dev));
+
+	if (!strcmp(sensor->gmsl, "gmsl"))
+		return 0;
+
+	return imx678_power_off(sensor);
+}
+
+static int __maybe_unused imx678_runtime_resume(struct device *dev)
+{
+	struct imx678 *sensor = client_to_imx678(to_i2c_client(dev));
+	int ret;
+
+	if (!strcmp(sensor->gmsl, "gmsl"))
+		return 0;
+
+	ret = imx678_power_on(sensor);
+	if (ret < 0)
+		return ret;
+
+	/* the reset dropped the mode, replay it with the shadowed AE */
+	mutex_lock(&sensor->lock);
+	if (sensor->mode_applied)
+		ret = imx678_restore_mode(sensor);
+	mutex_unlock(&sensor->lock);
+
+	return ret;
+}
+
 static const struct dev_pm_ops imx678_pm_ops = {
 	SET_SYSTEM_SLEEP_PM_OPS(imx678_suspend, imx678_resume)
+	SET_RUNTIME_PM_OPS(imx678_runtime_suspend, imx678_runtime_resume, NULL)
 };
 
 static const struct i2c_device_id imx678_id[] = {
@@ -146,6 +146,7 @@ static struct vvcam_sccb_data_s imx678_init_setting[] = {
 	{HREVERSE,             0x00},
 	{WINMODE,              0x00},
 	{ADDMODE,              0x00},
+	{VCMODE,               0x00},
 
 	{0x3460,               0x22},
 	{0x355A,               0x64},
@@ -17,25 +17,33 @@
 #include <linux/of_graph.h>
 #include <linux/device.h>
 #include <linux/gpio.h>
+#include <linux/gpio/consumer.h>
+#include <linux/hrtimer.h>
 #include <linux/i2c.h>
+#include <linux/imx8-mipi-csi2-sam.h>
 #include <linux/init.h>
 #include <linux/module.h>
 #include <linux/of.h>
 #include <linux/of_device.h>
 #include <linux/of_gpio.h>
 #include <linux/pinctrl/consumer.h>
+#include <linux/pm_runtime.h>
 #include <linux/regmap.h>
 #include <linux/regulator/consumer.h>
 #include <linux/seq_file.h>
 
 #include <linux/slab.h>
+#include <linux/sort.h>
 #include <linux/uaccess.h>
 #include <linux/version.h>
 #include <linux/v4l2-mediabus.h>
 #include <media/v4l2-device.h>
 #include <media/v4l2-ctrls.h>
+#include <media/v4l2-event.h>
 #include <media/v4l2-fwnode.h>
+#include <media/v4l2-rect.h>
 
+#include "vvsensor_common.h"
 #include "imx900_regs.h"
 #include "max96792.h"
 #include "max96793.h"
@@ -76,10 +84,32 @@
 #define IMX900_MAX_BOUNDS_HEIGHT 1688
 #define IMX900_LINE_TIME 8215 // hmax = 610
 
+/* ROI window limits of the all-pixel readout */
+#define IMX900_CROP_MIN_WIDTH	256
+#define IMX900_CROP_MIN_HEIGHT	64
+#define IMX900_CROP_WIDTH_STEP	16
+#define IMX900_CROP_HEIGHT_STEP	8
+#define IMX900_CROP_LEFT_STEP	8
+#define IMX900_CROP_TOP_STEP	4
+
 #define V4L2_CID_DATA_RATE		(V4L2_CID_USER_IMX_BASE + 1)
 //#define V4L2_CID_SYNC_MODE		(V4L2_CID_USER_IMX_BASE + 2)
 #define V4L2_CID_FRAME_RATE		(V4L2_CID_USER_IMX_BASE + 2)
 #define V4L2_CID_SHUTTER_MODE	(V4L2_CID_USER_IMX_BASE + 3)
+#define V4L2_CID_ROI_AREAS		(V4L2_CID_USER_IMX_BASE + 4)
+#define V4L2_CID_TRIGGER		(V4L2_CID_USER_IMX_BASE + 5)
+#define V4L2_CID_TRIGGER_TIMESTAMP	(V4L2_CID_USER_IMX_BASE + 6)
+#define V4L2_CID_TRIGGER_LATENCY	(V4L2_CID_USER_IMX_BASE + 7)
+#define V4L2_CID_TRIGGER_JITTER		(V4L2_CID_USER_IMX_BASE + 8)
+
+/* Elements of one rectangle of the ROI areas control */
+enum imx900_roi_field {
+	IMX900_ROI_LEFT,
+	IMX900_ROI_TOP,
+	IMX900_ROI_WIDTH,
+	IMX900_ROI_HEIGHT,
+	IMX900_ROI_FIELDS,
+};
 
 static const struct of_device_id imx900_of_match[] = {
 	{ .compatible = "framos,imx900" },
@@ -104,6 +134,51 @@ const char * const data_rate_menu[] = {
 	[IMX900_594_MBPS] = "594 Mbps/lane",
 };
 
+/* Readout modes, indexes of pimx900_mode_info[] */
+enum imx900_readout_mode {
+	IMX900_MODE_ALL_PIXEL,
+	IMX900_MODE_ROI,
+	IMX900_MODE_SUBSAMPLING2,
+	IMX900_MODE_SUBSAMPLING10,
+	IMX900_MODE_BINNING_CROP,
+};
+
+/* Default crop of each readout mode, in pixel array coordinates */
+static const struct v4l2_rect imx900_mode_crop[] = {
+	[IMX900_MODE_ALL_PIXEL] = {
+		0, 0, IMX900_DEFAULT_WIDTH, IMX900_DEFAULT_HEIGHT,
+	},
+	[IMX900_MODE_ROI] = {
+		IMX900_ROI_MODE_LEFT, IMX900_ROI_MODE_TOP,
+		IMX900_ROI_MODE_WIDTH, IMX900_ROI_MODE_HEIGHT,
+	},
+	[IMX900_MODE_SUBSAMPLING2] = {
+		0, 0, IMX900_DEFAULT_WIDTH, IMX900_DEFAULT_HEIGHT,
+	},
+	[IMX900_MODE_SUBSAMPLING10] = {
+		0, 0, IMX900_DEFAULT_WIDTH, IMX900_DEFAULT_HEIGHT,
+	},
+	/* binned 2x2 from the window at 8,32 */
+	[IMX900_MODE_BINNING_CROP] = {
+		16, 64, IMX900_BINNING_CROP_MODE_WIDTH * 2,
+		IMX900_BINNING_CROP_MODE_HEIGHT * 2,
+	},
+};
+
+static const struct vvsensor_crop_limits imx900_crop_limits = {
+	.bounds = { 0, 0, IMX900_DEFAULT_WIDTH, IMX900_DEFAULT_HEIGHT },
+	.min_width = IMX900_CROP_MIN_WIDTH,
+	.min_height = IMX900_CROP_MIN_HEIGHT,
+	.width_step = IMX900_CROP_WIDTH_STEP,
+	.height_step = IMX900_CROP_HEIGHT_STEP,
+	.left_step = IMX900_CROP_LEFT_STEP,
+	.top_step = IMX900_CROP_TOP_STEP,
+	.margin_left = 8,
+	.margin_top = 8,
+	.margin_width = 16,
+	.margin_height = 16,
+};
+
 static const char * const test_pattern_menu[] = {
 	[0]   = "No pattern",
 	[1]   = "Sequence Pattern 1",
@@ -172,6 +247,25 @@ const char * const shutter_mode_menu[] = {
 	[FAST_TRIGGER]	= "Fast trigger",
 };
 
+/*
+ * CSI-2 link frequencies reported through V4L2_CID_LINK_FREQ, the sensor
+ * rates are indexed by the data rate control and followed by the
+ * deserializer output rates of a GMSL link.
+ */
+static const s64 imx900_link_freq_menu[] = {
+	1188000000,
+	742500000,
+	594000000,
+	445500000,
+	297000000,
+	/* GMSL deserializer CSI rates */
+	500000000,
+	600000000,
+	750000000,
+};
+
+#define IMX900_LINK_FREQ_GMSL (IMX900_594_MBPS + 1)
+
 static const struct v4l2_ctrl_ops imx900_ctrl_ops;
 static struct v4l2_ctrl_config imx900_ctrl_data_rate[] = {
 	{
@@ -212,6 +306,74 @@ static struct v4l2_ctrl_config imx900_ctrl_shutter_mode[] = {
 	},
 };
 
+/*
+ * The ROI areas control is a list of up to IMX900_ROI_AREAS rectangles,
+ * each given as left, top, width, height. Rectangles with a zero width or
+ * height are unused, an all-zero list selects the single crop window. The
+ * rectangles must overlap or touch, as only one window slot is programmed.
+ */
+static struct v4l2_ctrl_config imx900_ctrl_roi_areas[] = {
+	{
+		.ops = &imx900_ctrl_ops,
+		.id = V4L2_CID_ROI_AREAS,
+		.name = "ROI areas",
+		.type = V4L2_CTRL_TYPE_U32,
+		.min = 0,
+		.max = IMX900_DEFAULT_WIDTH,
+		.def = 0,
+		.step = 1,
+		.dims = { IMX900_ROI_AREAS, IMX900_ROI_FIELDS },
+	},
+};
+
+/*
+ * The software trigger pulses the trigger GPIO for the exposure control
+ * time. The edge timestamp and the delay to the following CSIS frame start
+ * are reported in ns, CLOCK_MONOTONIC, the jitter is the spread of the
+ * delays since stream on.
+ */
+static struct v4l2_ctrl_config imx900_ctrl_trigger[] = {
+	{
+		.ops = &imx900_ctrl_ops,
+		.id = V4L2_CID_TRIGGER,
+		.name = "Software trigger",
+		.type = V4L2_CTRL_TYPE_BUTTON,
+	},
+};
+
+static struct v4l2_ctrl_config imx900_ctrl_trigger_stats[] = {
+	{
+		.ops = &imx900_ctrl_ops,
+		.id = V4L2_CID_TRIGGER_TIMESTAMP,
+		.name = "Trigger timestamp",
+		.type = V4L2_CTRL_TYPE_INTEGER64,
+		.min = 0,
+		.max = S64_MAX,
+		.step = 1,
+		.flags = V4L2_CTRL_FLAG_READ_ONLY | V4L2_CTRL_FLAG_VOLATILE,
+	},
+	{
+		.ops = &imx900_ctrl_ops,
+		.id = V4L2_CID_TRIGGER_LATENCY,
+		.name = "Trigger latency",
+		.type = V4L2_CTRL_TYPE_INTEGER64,
+		.min = 0,
+		.max = S64_MAX,
+		.step = 1,
+		.flags = V4L2_CTRL_FLAG_READ_ONLY | V4L2_CTRL_FLAG_VOLATILE,
+	},
+	{
+		.ops = &imx900_ctrl_ops,
+		.id = V4L2_CID_TRIGGER_JITTER,
+		.name = "Trigger jitter",
+		.type = V4L2_CTRL_TYPE_INTEGER64,
+		.min = 0,
+		.max = S64_MAX,
+		.step = 1,
+		.flags = V4L2_CTRL_FLAG_READ_ONLY | V4L2_CTRL_FLAG_VOLATILE,
+	},
+};
+
 struct imx900_ctrls {
 	struct v4l2_ctrl_handler handler;
 	struct v4l2_ctrl *exposure;
@@ -220,8 +382,67 @@ struct imx900_ctrls {
 	struct v4l2_ctrl *framerate;
 	struct v4l2_ctrl *black_level;
 	struct v4l2_ctrl *data_rate;
+	struct v4l2_ctrl *link_freq;
+	struct v4l2_ctrl *pixel_rate;
 	//struct v4l2_ctrl *sync_mode;
 	struct v4l2_ctrl *shutter_mode;
+	struct v4l2_ctrl *roi_areas;
+	struct v4l2_ctrl *trigger;
+};
+
+/*
+ * Software trigger. The GPIO drives XTRIG directly, or the deserializer
+ * MFP forwarded to the serializer GPIO10/XTRIG1 on a GMSL link.
+ */
+struct imx900_trigger {
+	struct gpio_desc *gpio;
+	struct hrtimer timer;
+	spinlock_t lock;
+	ktime_t ts;
+	bool pending;
+	u32 count;
+	s64 latency_ns;
+	s64 latency_min_ns;
+	s64 latency_max_ns;
+	struct notifier_block fs_nb;
+	bool fs_registered;
+};
+
+/* Rows or columns read out by one window of the ROI readout */
+struct imx900_roi_span {
+	u16 start;
+	u16 len;
+};
+
+/*
+ * The ROI areas reduced to horizontal and vertical windows. Only one window
+ * per direction is accepted until the further readout slots are verified.
+ */
+struct imx900_roi {
+	struct imx900_roi_span h[IMX900_ROI_AREAS];
+	struct imx900_roi_span v[IMX900_ROI_AREAS];
+	u32 num_h;
+	u32 num_v;
+};
+
+/* AE registers written at runtime, replayed after a mode restore */
+static const u16 imx900_shadow_regs[] = {
+	VMAX_LOW,
+	VMAX_MID,
+	VMAX_HIGH,
+	SHS_LOW,
+	SHS_MID,
+	SHS_HIGH,
+	GAIN_LOW,
+	GAIN_HIGH,
+	BLKLEVEL_LOW,
+	BLKLEVEL_HIGH,
+};
+
+/* Exposure and gain programmed by the last set_exp and set_gain, after clamping */
+struct imx900_applied {
+	u32 exp_lines;
+	u32 gain_reg;
 };
 
 struct imx900 {
@@ -235,6 +456,9 @@ struct imx900 {
 
 	struct v4l2_mbus_framefmt format;
 	vvcam_mode_info_t cur_mode;
+	struct v4l2_rect crop;
+	struct imx900_roi roi;
+	struct imx900_trigger trig;
 	struct mutex lock;
 	u32 stream_status;
 	u32 resume_status;
@@ -245,6 +469,11 @@ struct imx900 {
 	struct device *ser_dev;
 	struct device *dser_dev;
 	struct gmsl_link_ctx g_ctx;
+	u8 shadow_val[ARRAY_SIZE(imx900_shadow_regs)];
+	u32 shadow_valid;
+	bool mode_applied;
+	struct vvsensor_ctx vs;
+	struct imx900_applied applied;
 };
 
 #define client_to_imx900(client)\
@@ -262,10 +491,13 @@ static inline struct v4l2_subdev *ctrl_to_sd(struct v4l2_ctrl *ctrl)
 }
 
 static int imx900_set_dep_registers(struct imx900 *sensor);
+static bool imx900_crop_supported(struct imx900 *sensor);
+static void imx900_update_crop_size(struct imx900 *sensor);
+static int imx900_set_roi_areas(struct imx900 *sensor, const u32 *areas);
 
 static struct vvcam_mode_info_s pimx900_mode_info[] = {
 	{
-		.index			= 0,
+		.index			= IMX900_MODE_ALL_PIXEL,
 		.size			= {
 			.bounds_width  = IMX900_DEFAULT_WIDTH,
 			.bounds_height = IMX900_DEFAULT_HEIGHT,
@@ -309,7 +541,7 @@ static struct vvcam_mode_info_s pimx900_mode_info[] = {
 		.reg_data_count = ARRAY_SIZE(imx900_init_setting),
 	},
 	{
-		.index			= 1,
+		.index			= IMX900_MODE_ROI,
 		.size			= {
 			.bounds_width  = IMX900_ROI_MODE_WIDTH,
 			.bounds_height = IMX900_ROI_MODE_HEIGHT,
@@ -353,7 +585,7 @@ static struct vvcam_mode_info_s pimx900_mode_info[] = {
 		.reg_data_count = ARRAY_SIZE(imx900_init_setting),
 	},
 	{
-		.index		= 2,
+		.index		= IMX900_MODE_SUBSAMPLING2,
 		.size		= {
 			.bounds_width  = IMX900_SUBSAMPLING2_MODE_WIDTH,
 			.bounds_height = IMX900_SUBSAMPLING2_MODE_HEIGHT,
@@ -397,7 +629,7 @@ static struct vvcam_mode_info_s pimx900_mode_info[] = {
 		.reg_data_count = ARRAY_SIZE(imx900_init_setting),
 	},
 	{
-		.index			= 3,
+		.index			= IMX900_MODE_SUBSAMPLING10,
 		.size			= {
 			.bounds_width  = IMX900_SUBSAMPLING10_MODE_WIDTH,
 			.bounds_height = IMX900_SUBSAMPLING10_MODE_HEIGHT,
@@ -441,7 +673,7 @@ static struct vvcam_mode_info_s pimx900_mode_info[] = {
 		.reg_data_count = ARRAY_SIZE(imx900_init_setting),
 	},
 	{
-		.index		  = 4,
+		.index		  = IMX900_MODE_BINNING_CROP,
 		.size		   = {
 			.bounds_width  = IMX900_BINNING_CROP_MODE_WIDTH,
 			.bounds_height = IMX900_BINNING_CROP_MODE_HEIGHT,
@@ -486,6 +718,19 @@ static struct vvcam_mode_info_s pimx900_mode_info[] = {
 	},
 };
 
+static void imx900_shadow_update(struct imx900 *sensor, u16 reg, u8 val)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(imx900_shadow_regs); i++) {
+		if (imx900_shadow_regs[i] == reg) {
+			sensor->shadow_val[i] = val;
+			sensor->shadow_valid |= BIT(i);
+			return;
+		}
+	}
+}
+
 static int imx900_write_reg(struct imx900 *sensor, u16 reg, u8 val)
 {
 	struct device *dev = &sensor->i2c_client->dev;
@@ -515,6 +760,8 @@ static int imx900_write_reg(struct imx900 *sensor, u16 reg, u8 val)
 	if (num_retry > 0)
 		dev_warn(dev, "i2c communication passed after %d retries: reg=%x", num_retry, reg);
 
+	imx900_shadow_update(sensor, reg, val);
+
 	return 0;
 }
 
@@ -874,6 +1121,10 @@ static int imx900_set_sensor_mode(struct imx900 *sensor, void *pmode)
 		if (pimx900_mode_info[i].index == sensor_mode.index) {
 			memcpy(&sensor->cur_mode, &pimx900_mode_info[i],
 				sizeof(struct vvcam_mode_info_s));
+			vvsensor_afps_reset(&sensor->vs);
+			sensor->crop = imx900_mode_crop[sensor->cur_mode.index];
+			if (sensor->roi.num_h && imx900_crop_supported(sensor))
+				imx900_update_crop_size(sensor);
 			return 0;
 		}
 	}
@@ -991,23 +1242,23 @@ static int imx900_adjust_hmax_register(struct imx900 *sensor)
 			switch (numlanes) {
 			case IMX900_ONE_LANE_MODE:
 				if (sensor->chromacity == IMX900_COLOR) {
-					hmax = (sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) ? 0X152 : 0x22A;
+					hmax = (sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) ? 0X152 : 0x22A;
 				} else {//monochrome
-					hmax = ((sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) || (sensor->cur_mode.size.bounds_height == IMX900_BINNING_CROP_MODE_HEIGHT)) ? 0x128 : 0x22A;
+					hmax = ((sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) || (sensor->cur_mode.index == IMX900_MODE_BINNING_CROP)) ? 0x128 : 0x22A;
 				}
 			break;
 			case IMX900_TWO_LANE_MODE:
 				if (sensor->chromacity == IMX900_COLOR) {
 					hmax = 0x152;
 				} else {//monochrome
-					hmax = ((sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) || (sensor->cur_mode.size.bounds_height == IMX900_BINNING_CROP_MODE_HEIGHT)) ? 0x0A9 : 0x152;
+					hmax = ((sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) || (sensor->cur_mode.index == IMX900_MODE_BINNING_CROP)) ? 0x0A9 : 0x152;
 				}
 			break;
 			case IMX900_MAX_CSI_LANES:
 				if (sensor->chromacity == IMX900_COLOR) {
 					hmax = 0x152;
 				} else {//monochrome
-					hmax = ((sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) || (sensor->cur_mode.size.bounds_height == IMX900_BINNING_CROP_MODE_HEIGHT)) ? 0x0A9 : 0x152;
+					hmax = ((sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) || (sensor->cur_mode.index == IMX900_MODE_BINNING_CROP)) ? 0x0A9 : 0x152;
 				}
 			break;
 			default:
@@ -1020,23 +1271,23 @@ static int imx900_adjust_hmax_register(struct imx900 *sensor)
 			switch (numlanes) {
 			case IMX900_ONE_LANE_MODE:
 				if (sensor->chromacity == IMX900_COLOR) {
-					hmax = (sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) ? 0x16C : 0x2AB;
+					hmax = (sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) ? 0x16C : 0x2AB;
 				} else {//monochrome
-					hmax = ((sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) || (sensor->cur_mode.size.bounds_height == IMX900_BINNING_CROP_MODE_HEIGHT)) ? 0x168 : 0x2AB;
+					hmax = ((sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) || (sensor->cur_mode.index == IMX900_MODE_BINNING_CROP)) ? 0x168 : 0x2AB;
 				}
 			break;
 			case IMX900_TWO_LANE_MODE:
 				if (sensor->chromacity == IMX900_COLOR) {
 					hmax = 0x16C;
 				} else {//monochrome
-					hmax = ((sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) || (sensor->cur_mode.size.bounds_height == IMX900_BINNING_CROP_MODE_HEIGHT)) ? 0x0C7 : 0x16C;
+					hmax = ((sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) || (sensor->cur_mode.index == IMX900_MODE_BINNING_CROP)) ? 0x0C7 : 0x16C;
 				}
 			break;
 			case IMX900_MAX_CSI_LANES:
 				if (sensor->chromacity == IMX900_COLOR) {
 					hmax = 0x16C;
 				} else {//monochrome
-					hmax = ((sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) || (sensor->cur_mode.size.bounds_height == IMX900_BINNING_CROP_MODE_HEIGHT)) ? 0x0B6 : 0x16C;
+					hmax = ((sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) || (sensor->cur_mode.index == IMX900_MODE_BINNING_CROP)) ? 0x0B6 : 0x16C;
 				}
 			break;
 			default:
@@ -1049,23 +1300,23 @@ static int imx900_adjust_hmax_register(struct imx900 *sensor)
 			switch (numlanes) {
 			case IMX900_ONE_LANE_MODE:
 				if (sensor->chromacity == IMX900_COLOR) {
-					hmax = (sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) ? 0x262 : 0x32C;
+					hmax = (sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) ? 0x262 : 0x32C;
 				} else {//monochrome
-					hmax = ((sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) || (sensor->cur_mode.size.bounds_height == IMX900_BINNING_CROP_MODE_HEIGHT)) ? 0x1A9 : 0x32C;
+					hmax = ((sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) || (sensor->cur_mode.index == IMX900_MODE_BINNING_CROP)) ? 0x1A9 : 0x32C;
 				}
 			break;
 			case IMX900_TWO_LANE_MODE:
 				if (sensor->chromacity == IMX900_COLOR) {
 					hmax = 0x262;
 				} else {//monochrome
-					hmax = ((sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) || (sensor->cur_mode.size.bounds_height == IMX900_BINNING_CROP_MODE_HEIGHT)) ? 0x131 : 0x262;
+					hmax = ((sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) || (sensor->cur_mode.index == IMX900_MODE_BINNING_CROP)) ? 0x131 : 0x262;
 				}
 			break;
 			case IMX900_MAX_CSI_LANES:
 				if (sensor->chromacity == IMX900_COLOR) {
 					hmax = 0x262;
 				} else {//monochrome
-					hmax = ((sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) || (sensor->cur_mode.size.bounds_height == IMX900_BINNING_CROP_MODE_HEIGHT)) ? 0x131 : 0x262;
+					hmax = ((sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) || (sensor->cur_mode.index == IMX900_MODE_BINNING_CROP)) ? 0x131 : 0x262;
 				}
 			break;
 			default:
@@ -1084,20 +1335,20 @@ static int imx900_adjust_hmax_register(struct imx900 *sensor)
 		case MEDIA_BUS_FMT_SGBRG8_1X8:
 			switch (numlanes) {
 			case IMX900_ONE_LANE_MODE:
-				hmax = ((sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) || (sensor->cur_mode.size.bounds_height == IMX900_BINNING_CROP_MODE_HEIGHT)) ? 0x1CC : 0x369;
+				hmax = ((sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) || (sensor->cur_mode.index == IMX900_MODE_BINNING_CROP)) ? 0x1CC : 0x369;
 			break;
 			case IMX900_TWO_LANE_MODE:
 				if (sensor->chromacity == IMX900_COLOR) {
-					hmax = (sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) ? 0x152 : 0x1CC;
+					hmax = (sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) ? 0x152 : 0x1CC;
 				} else {//monochrome
-					hmax = ((sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) || (sensor->cur_mode.size.bounds_height == IMX900_BINNING_CROP_MODE_HEIGHT)) ? 0x0FE : 0x1CC;
+					hmax = ((sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) || (sensor->cur_mode.index == IMX900_MODE_BINNING_CROP)) ? 0x0FE : 0x1CC;
 				}
 			break;
 			case IMX900_MAX_CSI_LANES:
 				if (sensor->chromacity == IMX900_COLOR) {
 					hmax = 0x152;
 				} else {//monochrome
-					hmax = ((sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) || (sensor->cur_mode.size.bounds_height == IMX900_BINNING_CROP_MODE_HEIGHT)) ? 0x0A9 : 0x152;
+					hmax = ((sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) || (sensor->cur_mode.index == IMX900_MODE_BINNING_CROP)) ? 0x0A9 : 0x152;
 				}
 			break;
 			default:
@@ -1109,20 +1360,20 @@ static int imx900_adjust_hmax_register(struct imx900 *sensor)
 		case MEDIA_BUS_FMT_SGBRG10_1X10:
 			switch (numlanes) {
 			case IMX900_ONE_LANE_MODE:
-				hmax = ((sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) || (sensor->cur_mode.size.bounds_height == IMX900_BINNING_CROP_MODE_HEIGHT)) ? 0x234 : 0x438;
+				hmax = ((sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) || (sensor->cur_mode.index == IMX900_MODE_BINNING_CROP)) ? 0x234 : 0x438;
 			break;
 			case IMX900_TWO_LANE_MODE:
 				if (sensor->chromacity == IMX900_COLOR) {
-					hmax = (sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) ? 0x16C : 0x234;
+					hmax = (sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) ? 0x16C : 0x234;
 				} else {//monochrome
-					hmax = ((sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) || (sensor->cur_mode.size.bounds_height == IMX900_BINNING_CROP_MODE_HEIGHT)) ? 0x131 : 0x234;
+					hmax = ((sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) || (sensor->cur_mode.index == IMX900_MODE_BINNING_CROP)) ? 0x131 : 0x234;
 				}
 			break;
 			case IMX900_MAX_CSI_LANES:
 				if (sensor->chromacity == IMX900_COLOR) {
 					hmax = 0x16C;
 				} else {//monochrome
-					hmax = ((sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) || (sensor->cur_mode.size.bounds_height == IMX900_BINNING_CROP_MODE_HEIGHT)) ? 0x0B6 : 0x16C;
+					hmax = ((sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) || (sensor->cur_mode.index == IMX900_MODE_BINNING_CROP)) ? 0x0B6 : 0x16C;
 				}
 			break;
 			default:
@@ -1134,20 +1385,20 @@ static int imx900_adjust_hmax_register(struct imx900 *sensor)
 		case MEDIA_BUS_FMT_SGBRG12_1X12:
 			switch (numlanes) {
 			case IMX900_ONE_LANE_MODE:
-				hmax = ((sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) || (sensor->cur_mode.size.bounds_height == IMX900_BINNING_CROP_MODE_HEIGHT)) ? 0x29B : 0x506;
+				hmax = ((sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) || (sensor->cur_mode.index == IMX900_MODE_BINNING_CROP)) ? 0x29B : 0x506;
 			break;
 			case IMX900_TWO_LANE_MODE:
 				if (sensor->chromacity == IMX900_COLOR) {
-					hmax = (sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) ? 0x262 : 0x29B;
+					hmax = (sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) ? 0x262 : 0x29B;
 				} else {//monochrome
-					hmax = ((sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) || (sensor->cur_mode.size.bounds_height == IMX900_BINNING_CROP_MODE_HEIGHT)) ? 0x165 : 0x29B;
+					hmax = ((sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) || (sensor->cur_mode.index == IMX900_MODE_BINNING_CROP)) ? 0x165 : 0x29B;
 				}
 			break;
 			case IMX900_MAX_CSI_LANES:
 				if (sensor->chromacity == IMX900_COLOR) {
 					hmax = 0x262;
 				} else {//monochrome
-					hmax = ((sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) || (sensor->cur_mode.size.bounds_height == IMX900_BINNING_CROP_MODE_HEIGHT)) ? 0x131 : 0x262;
+					hmax = ((sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) || (sensor->cur_mode.index == IMX900_MODE_BINNING_CROP)) ? 0x131 : 0x262;
 				}
 			break;
 			default:
@@ -1166,20 +1417,20 @@ static int imx900_adjust_hmax_register(struct imx900 *sensor)
 		case MEDIA_BUS_FMT_SGBRG8_1X8:
 			switch (numlanes) {
 			case IMX900_ONE_LANE_MODE:
-				hmax = ((sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) || (sensor->cur_mode.size.bounds_height == IMX900_BINNING_CROP_MODE_HEIGHT)) ? 0x23B : 0x43F;
+				hmax = ((sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) || (sensor->cur_mode.index == IMX900_MODE_BINNING_CROP)) ? 0x23B : 0x43F;
 			break;
 			case IMX900_TWO_LANE_MODE:
 				if (sensor->chromacity == IMX900_COLOR) {
-					hmax = (sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) ? 0x152 : 0x23B;
+					hmax = (sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) ? 0x152 : 0x23B;
 				} else {//monochrome
-					hmax = ((sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) || (sensor->cur_mode.size.bounds_height == IMX900_BINNING_CROP_MODE_HEIGHT)) ? 0x139 : 0x23B;
+					hmax = ((sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) || (sensor->cur_mode.index == IMX900_MODE_BINNING_CROP)) ? 0x139 : 0x23B;
 				}
 			break;
 			case IMX900_MAX_CSI_LANES:
 				if (sensor->chromacity == IMX900_COLOR) {
 					hmax = 0x152;
 				} else {//monochrome
-					hmax = ((sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) || (sensor->cur_mode.size.bounds_height == IMX900_BINNING_CROP_MODE_HEIGHT)) ? 0x0B8 : 0x152;
+					hmax = ((sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) || (sensor->cur_mode.index == IMX900_MODE_BINNING_CROP)) ? 0x0B8 : 0x152;
 				}
 			break;
 			default:
@@ -1191,16 +1442,16 @@ static int imx900_adjust_hmax_register(struct imx900 *sensor)
 		case MEDIA_BUS_FMT_SGBRG10_1X10:
 			switch (numlanes) {
 			case IMX900_ONE_LANE_MODE:
-				hmax = ((sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) || (sensor->cur_mode.size.bounds_height == IMX900_BINNING_CROP_MODE_HEIGHT)) ? 0x2BC : 0x541;
+				hmax = ((sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) || (sensor->cur_mode.index == IMX900_MODE_BINNING_CROP)) ? 0x2BC : 0x541;
 			break;
 			case IMX900_TWO_LANE_MODE:
-				hmax = ((sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) || (sensor->cur_mode.size.bounds_height == IMX900_BINNING_CROP_MODE_HEIGHT)) ? 0x179 : 0x2BC;
+				hmax = ((sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) || (sensor->cur_mode.index == IMX900_MODE_BINNING_CROP)) ? 0x179 : 0x2BC;
 			break;
 			case IMX900_MAX_CSI_LANES:
 				if (sensor->chromacity == IMX900_COLOR) {
-					hmax = (sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) ? 0x16C : 0x17A;
+					hmax = (sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) ? 0x16C : 0x17A;
 				} else {//monochrome
-					hmax = ((sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) || (sensor->cur_mode.size.bounds_height == IMX900_BINNING_CROP_MODE_HEIGHT)) ? 0x0D8 : 0x17A;
+					hmax = ((sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) || (sensor->cur_mode.index == IMX900_MODE_BINNING_CROP)) ? 0x0D8 : 0x17A;
 				}
 			break;
 			default:
@@ -1212,20 +1463,20 @@ static int imx900_adjust_hmax_register(struct imx900 *sensor)
 		case MEDIA_BUS_FMT_SGBRG12_1X12:
 			switch (numlanes) {
 			case IMX900_ONE_LANE_MODE:
-				hmax = ((sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) || (sensor->cur_mode.size.bounds_height == IMX900_BINNING_CROP_MODE_HEIGHT)) ? 0x33D : 0x643;
+				hmax = ((sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) || (sensor->cur_mode.index == IMX900_MODE_BINNING_CROP)) ? 0x33D : 0x643;
 			break;
 			case IMX900_TWO_LANE_MODE:
 				if (sensor->chromacity == IMX900_COLOR) {
-					hmax = (sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) ? 0x262 : 0x33D;
+					hmax = (sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) ? 0x262 : 0x33D;
 				} else {//monochrome
-					hmax = ((sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) || (sensor->cur_mode.size.bounds_height == IMX900_BINNING_CROP_MODE_HEIGHT)) ? 0x1BA : 0x33D;
+					hmax = ((sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) || (sensor->cur_mode.index == IMX900_MODE_BINNING_CROP)) ? 0x1BA : 0x33D;
 				}
 			break;
 			case IMX900_MAX_CSI_LANES:
 				if (sensor->chromacity == IMX900_COLOR) {
 					hmax = 0x262;
 				} else {//monochrome
-					hmax = ((sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) || (sensor->cur_mode.size.bounds_height == IMX900_BINNING_CROP_MODE_HEIGHT)) ? 0x131 : 0x262;
+					hmax = ((sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) || (sensor->cur_mode.index == IMX900_MODE_BINNING_CROP)) ? 0x131 : 0x262;
 				}
 			break;
 			default:
@@ -1244,16 +1495,16 @@ static int imx900_adjust_hmax_register(struct imx900 *sensor)
 		case MEDIA_BUS_FMT_SGBRG8_1X8:
 			switch (numlanes) {
 			case IMX900_ONE_LANE_MODE:
-				hmax = ((sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) || (sensor->cur_mode.size.bounds_height == IMX900_BINNING_CROP_MODE_HEIGHT)) ? 0x2F4 : 0x5A4;
+				hmax = ((sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) || (sensor->cur_mode.index == IMX900_MODE_BINNING_CROP)) ? 0x2F4 : 0x5A4;
 			break;
 			case IMX900_TWO_LANE_MODE:
-				hmax = ((sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) || (sensor->cur_mode.size.bounds_height == IMX900_BINNING_CROP_MODE_HEIGHT)) ? 0x19C : 0x2F4;
+				hmax = ((sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) || (sensor->cur_mode.index == IMX900_MODE_BINNING_CROP)) ? 0x19C : 0x2F4;
 			break;
 			case IMX900_MAX_CSI_LANES:
 				if (sensor->chromacity == IMX900_COLOR) {
-					hmax = (sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) ? 0x152 : 0x19C;
+					hmax = (sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) ? 0x152 : 0x19C;
 				} else {//monochrome
-					hmax = ((sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) || (sensor->cur_mode.size.bounds_height == IMX900_BINNING_CROP_MODE_HEIGHT)) ? 0x0F0 : 0x19C;
+					hmax = ((sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) || (sensor->cur_mode.index == IMX900_MODE_BINNING_CROP)) ? 0x0F0 : 0x19C;
 				}
 			break;
 			default:
@@ -1265,16 +1516,16 @@ static int imx900_adjust_hmax_register(struct imx900 *sensor)
 		case MEDIA_BUS_FMT_SGBRG10_1X10:
 			switch (numlanes) {
 			case IMX900_ONE_LANE_MODE:
-				hmax = ((sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) || (sensor->cur_mode.size.bounds_height == IMX900_BINNING_CROP_MODE_HEIGHT)) ? 0x3A0 : 0x6FC;
+				hmax = ((sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) || (sensor->cur_mode.index == IMX900_MODE_BINNING_CROP)) ? 0x3A0 : 0x6FC;
 			break;
 			case IMX900_TWO_LANE_MODE:
-				hmax = ((sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) || (sensor->cur_mode.size.bounds_height == IMX900_BINNING_CROP_MODE_HEIGHT)) ? 0x1F2 : 0x3A0;
+				hmax = ((sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) || (sensor->cur_mode.index == IMX900_MODE_BINNING_CROP)) ? 0x1F2 : 0x3A0;
 			break;
 			case IMX900_MAX_CSI_LANES:
 				if (sensor->chromacity == IMX900_COLOR) {
-					hmax = (sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) ? 0x16C : 0x1F3;
+					hmax = (sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) ? 0x16C : 0x1F3;
 				} else {//monochrome
-					hmax = ((sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) || (sensor->cur_mode.size.bounds_height == IMX900_BINNING_CROP_MODE_HEIGHT)) ? 0x11B : 0x1F3;
+					hmax = ((sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) || (sensor->cur_mode.index == IMX900_MODE_BINNING_CROP)) ? 0x11B : 0x1F3;
 				}
 			break;
 			default:
@@ -1286,20 +1537,20 @@ static int imx900_adjust_hmax_register(struct imx900 *sensor)
 		case MEDIA_BUS_FMT_SGBRG12_1X12:
 			switch (numlanes) {
 			case IMX900_ONE_LANE_MODE:
-				hmax = ((sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) || (sensor->cur_mode.size.bounds_height == IMX900_BINNING_CROP_MODE_HEIGHT)) ? 0x44C : 0x854;
+				hmax = ((sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) || (sensor->cur_mode.index == IMX900_MODE_BINNING_CROP)) ? 0x44C : 0x854;
 			break;
 			case IMX900_TWO_LANE_MODE:
 				if (sensor->chromacity == IMX900_COLOR) {
-					hmax = (sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) ? 0x262 : 0x44C;
+					hmax = (sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) ? 0x262 : 0x44C;
 				} else {//monochrome
-					hmax = ((sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) || (sensor->cur_mode.size.bounds_height == IMX900_BINNING_CROP_MODE_HEIGHT)) ? 0x248 : 0x44C;
+					hmax = ((sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) || (sensor->cur_mode.index == IMX900_MODE_BINNING_CROP)) ? 0x248 : 0x44C;
 				}
 			break;
 			case IMX900_MAX_CSI_LANES:
 				if (sensor->chromacity == IMX900_COLOR) {
 					hmax = 0x262;
 				} else {//monochrome
-					hmax = ((sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) || (sensor->cur_mode.size.bounds_height == IMX900_BINNING_CROP_MODE_HEIGHT)) ? 0x147 : 0x262;
+					hmax = ((sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) || (sensor->cur_mode.index == IMX900_MODE_BINNING_CROP)) ? 0x147 : 0x262;
 				}
 			break;
 			default:
@@ -1318,13 +1569,13 @@ static int imx900_adjust_hmax_register(struct imx900 *sensor)
 		case MEDIA_BUS_FMT_SGBRG8_1X8:
 			switch (numlanes) {
 			case IMX900_ONE_LANE_MODE:
-				hmax = ((sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) || (sensor->cur_mode.size.bounds_height == IMX900_BINNING_CROP_MODE_HEIGHT)) ? 0x45E : 0x866;
+				hmax = ((sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) || (sensor->cur_mode.index == IMX900_MODE_BINNING_CROP)) ? 0x45E : 0x866;
 			break;
 			case IMX900_TWO_LANE_MODE:
-				hmax = ((sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) || (sensor->cur_mode.size.bounds_height == IMX900_BINNING_CROP_MODE_HEIGHT)) ? 0x258 : 0x45C;
+				hmax = ((sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) || (sensor->cur_mode.index == IMX900_MODE_BINNING_CROP)) ? 0x258 : 0x45C;
 			break;
 			case IMX900_MAX_CSI_LANES:
-				hmax = ((sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) || (sensor->cur_mode.size.bounds_height == IMX900_BINNING_CROP_MODE_HEIGHT)) ? 0x158 : 0x25A;
+				hmax = ((sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) || (sensor->cur_mode.index == IMX900_MODE_BINNING_CROP)) ? 0x158 : 0x25A;
 			break;
 			default:
 				pr_err("%s: unknown lane mode\n", __func__);
@@ -1335,13 +1586,13 @@ static int imx900_adjust_hmax_register(struct imx900 *sensor)
 		case MEDIA_BUS_FMT_SGBRG10_1X10:
 			switch (numlanes) {
 			case IMX900_ONE_LANE_MODE:
-				hmax = ((sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) || (sensor->cur_mode.size.bounds_height == IMX900_BINNING_CROP_MODE_HEIGHT)) ? 0x560 : 0xA6A;
+				hmax = ((sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) || (sensor->cur_mode.index == IMX900_MODE_BINNING_CROP)) ? 0x560 : 0xA6A;
 			break;
 			case IMX900_TWO_LANE_MODE:
-				hmax = ((sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) || (sensor->cur_mode.size.bounds_height == IMX900_BINNING_CROP_MODE_HEIGHT)) ? 0x2DA : 0x55E;
+				hmax = ((sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) || (sensor->cur_mode.index == IMX900_MODE_BINNING_CROP)) ? 0x2DA : 0x55E;
 			break;
 			case IMX900_MAX_CSI_LANES:
-				hmax = ((sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) || (sensor->cur_mode.size.bounds_height == IMX900_BINNING_CROP_MODE_HEIGHT)) ? 0x198 : 0x2DA;
+				hmax = ((sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) || (sensor->cur_mode.index == IMX900_MODE_BINNING_CROP)) ? 0x198 : 0x2DA;
 			break;
 			default:
 				pr_err("%s: unknown lane mode\n", __func__);
@@ -1352,16 +1603,16 @@ static int imx900_adjust_hmax_register(struct imx900 *sensor)
 		case MEDIA_BUS_FMT_SGBRG12_1X12:
 			switch (numlanes) {
 			case IMX900_ONE_LANE_MODE:
-				hmax = ((sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) || (sensor->cur_mode.size.bounds_height == IMX900_BINNING_CROP_MODE_HEIGHT)) ? 0x662 : 0xC6E;
+				hmax = ((sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) || (sensor->cur_mode.index == IMX900_MODE_BINNING_CROP)) ? 0x662 : 0xC6E;
 			break;
 			case IMX900_TWO_LANE_MODE:
-				hmax = ((sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) || (sensor->cur_mode.size.bounds_height == IMX900_BINNING_CROP_MODE_HEIGHT)) ? 0x35A : 0x660;
+				hmax = ((sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) || (sensor->cur_mode.index == IMX900_MODE_BINNING_CROP)) ? 0x35A : 0x660;
 			break;
 			case IMX900_MAX_CSI_LANES:
 				if (sensor->chromacity == IMX900_COLOR) {
-					hmax = (sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) ? 0x262 : 0x35C;
+					hmax = (sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) ? 0x262 : 0x35C;
 				} else {//monochrome
-					hmax = ((sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) || (sensor->cur_mode.size.bounds_height == IMX900_BINNING_CROP_MODE_HEIGHT)) ? 0x1D8 : 0x35C;
+					hmax = ((sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) || (sensor->cur_mode.index == IMX900_MODE_BINNING_CROP)) ? 0x1D8 : 0x35C;
 				}
 			break;
 			default:
@@ -1425,14 +1676,122 @@ static int imx900_change_data_rate(struct imx900 *sensor, u32 data_rate)
 		ret = imx900_write_reg_arry(sensor, (struct vvcam_sccb_data_s *)imx900_594_mbps, ARRAY_SIZE(imx900_594_mbps));
 		break;
 	}
-	if (!strcmp(sensor->gmsl, "gmsl")) {
-		pr_debug("%s: Setting dser clock for data rate %u\n", __func__, data_rate);
-		ret |= max96792_set_deser_clock(sensor->dser_dev, data_rate);
+	return ret;
+}
+
+
+/* Frame start after a trigger edge, called from the CSIS irq thread */
+static int imx900_trigger_fs_notify(struct notifier_block *nb,
+				    unsigned long sequence, void *data)
+{
+	struct imx900_trigger *trig = container_of(nb, struct imx900_trigger, fs_nb);
+	ktime_t fs_ts = *(ktime_t *)data;
+	unsigned long flags;
+	s64 ns, latency_ns;
+
+	spin_lock_irqsave(&trig->lock, flags);
+
+	if (trig->pending && ktime_after(fs_ts, trig->ts)) {
+		ns = ktime_to_ns(ktime_sub(fs_ts, trig->ts));
+		if (!trig->count || ns < trig->latency_min_ns)
+			trig->latency_min_ns = ns;
+		if (!trig->count || ns > trig->latency_max_ns)
+			trig->latency_max_ns = ns;
+		trig->latency_ns = ns;
+		trig->count++;
+		trig->pending = false;
 	}
+	latency_ns = trig->latency_ns;
 
-	return ret;
+	spin_unlock_irqrestore(&trig->lock, flags);
+
+	pr_debug("%s: frame %lu, latency %lld ns\n", __func__, sequence,
+		latency_ns);
+
+	return NOTIFY_OK;
+}
+
+static enum hrtimer_restart imx900_trigger_end(struct hrtimer *timer)
+{
+	struct imx900_trigger *trig = container_of(timer, struct imx900_trigger, timer);
+
+	gpiod_set_value(trig->gpio, 0);
+
+	return HRTIMER_NORESTART;
+}
+
+/*
+ * Pulse the trigger for the exposure time. The pulse end is timed by a
+ * hard irq hrtimer, a GPIO behind a sleeping bus falls back to a sleep
+ * with the jitter of the scheduler.
+ */
+static int imx900_fire_trigger(struct imx900 *sensor)
+{
+	struct imx900_trigger *trig = &sensor->trig;
+	u32 width_us = sensor->ctrls.exposure->val;
+	unsigned long flags;
+
+	if (!sensor->stream_status ||
+	    sensor->ctrls.shutter_mode->val == NORMAL_EXPO) {
+		pr_warn("%s: sensor isn't streaming in a trigger mode\n", __func__);
+		return -EINVAL;
+	}
+
+	if (hrtimer_active(&trig->timer))
+		return -EBUSY;
+
+	if (gpiod_cansleep(trig->gpio)) {
+		gpiod_set_value_cansleep(trig->gpio, 1);
+		spin_lock_irqsave(&trig->lock, flags);
+		trig->ts = ktime_get();
+		trig->pending = true;
+		spin_unlock_irqrestore(&trig->lock, flags);
+		fsleep(width_us);
+		gpiod_set_value_cansleep(trig->gpio, 0);
+		return 0;
+	}
+
+	spin_lock_irqsave(&trig->lock, flags);
+	gpiod_set_value(trig->gpio, 1);
+	trig->ts = ktime_get();
+	trig->pending = true;
+	hrtimer_start(&trig->timer, us_to_ktime(width_us), HRTIMER_MODE_REL_HARD);
+	spin_unlock_irqrestore(&trig->lock, flags);
+
+	return 0;
 }
 
+/* Measure the trigger latency on the frame starts of the CSIS receiver */
+static void imx900_trigger_stream(struct imx900 *sensor, bool enable)
+{
+	struct imx900_trigger *trig = &sensor->trig;
+	struct device *dev = &sensor->i2c_client->dev;
+	unsigned long flags;
+
+	if (!trig->gpio)
+		return;
+
+	if (!enable) {
+		hrtimer_cancel(&trig->timer);
+		gpiod_set_value_cansleep(trig->gpio, 0);
+		if (trig->fs_registered)
+			mipi_csis_frame_sync_unregister(dev, &trig->fs_nb);
+		trig->fs_registered = false;
+		return;
+	}
+
+	spin_lock_irqsave(&trig->lock, flags);
+	trig->pending = false;
+	trig->count = 0;
+	trig->latency_ns = 0;
+	trig->latency_min_ns = 0;
+	trig->latency_max_ns = 0;
+	spin_unlock_irqrestore(&trig->lock, flags);
+
+	trig->fs_registered = !mipi_csis_frame_sync_register(dev, &trig->fs_nb);
+	if (!trig->fs_registered)
+		pr_debug("%s: no CSIS frame start, latency isn't measured\n", __func__);
+}
 
 static int imx900_s_stream(struct v4l2_subdev *sd, int enable)
 {
@@ -1466,8 +1825,10 @@ static int imx900_s_stream(struct v4l2_subdev *sd, int enable)
 		imx900_write_reg(sensor, XMSTA, 0x00);
 		// 8 frame stabilisation - remove this?
 		msleep(300);
+		imx900_trigger_stream(sensor, true);
 	} else  {
 		pr_info("Disable stream\n");
+		imx900_trigger_stream(sensor, false);
 		if (!(strcmp(sensor->gmsl, "gmsl")))
 			max96792_stop_streaming(sensor->dser_dev, &sensor->i2c_client->dev);
 
@@ -1476,6 +1837,8 @@ static int imx900_s_stream(struct v4l2_subdev *sd, int enable)
 		imx900_write_reg(sensor, XMSTA, 0x01);
 	}
 
+	vvsensor_fq_stream(&sensor->vs, enable);
+
 	return 0;
 exit:
 	pr_err("%s: error setting stream\n", __func__);
@@ -1483,6 +1846,46 @@ exit:
 	return err;
 }
 
+/*
+ * Select the lowest GMSL link and deserializer CSI rates that carry the
+ * active mode, from the payload of one line per line time.
+ */
+static int imx900_gmsl_set_bandwidth(struct imx900 *sensor)
+{
+	struct device *dev = &sensor->i2c_client->dev;
+	u64 bandwidth;
+	u32 rate, prev_rate;
+	int err = 0;
+
+	if (strcmp(sensor->gmsl, "gmsl") || !sensor->cur_mode.ae_info.one_line_exp_time_ns)
+		return 0;
+
+	bandwidth = (u64)sensor->cur_mode.size.bounds_width *
+		sensor->cur_mode.bit_width * NSEC_PER_SEC;
+	bandwidth = div_u64(bandwidth, sensor->cur_mode.ae_info.one_line_exp_time_ns);
+	if (sensor->cur_mode.hdr_mode != SENSOR_MODE_LINEAR)
+		bandwidth *= 2;
+
+	rate = max96792_get_link_rate(bandwidth);
+	prev_rate = sensor->g_ctx.link_rate;
+	if (rate != prev_rate) {
+		err = max96793_set_link_rate(sensor->ser_dev, rate);
+		if (!err)
+			err = max96792_set_link_rate(sensor->dser_dev, dev, rate);
+		if (err) {
+			dev_err(dev, "%s: unable to change gmsl link rate\n", __func__);
+			/* put both ends back on the previous rate and relink */
+			if (max96793_set_link_rate(sensor->ser_dev, prev_rate) ||
+			    max96792_set_link_rate(sensor->dser_dev, dev, prev_rate))
+				dev_err(dev, "%s: unable to restore gmsl link rate\n",
+					__func__);
+			return err;
+		}
+	}
+
+	return max96792_set_csi_bandwidth(sensor->dser_dev, dev, bandwidth);
+}
+
 static int imx900_set_data_rate(struct imx900 *sensor, u32 data_rate)
 {
 	int ret = 0;
@@ -1505,6 +1908,10 @@ static int imx900_set_data_rate(struct imx900 *sensor, u32 data_rate)
 		return ret;
 	}
 
+	ret = imx900_gmsl_set_bandwidth(sensor);
+	if (ret)
+		return ret;
+
 	ret = imx900_set_dep_registers(sensor);
 	if (ret < 0) {
 		pr_err("%s:unable to write dep registers to image sensor\n", __func__);
@@ -1565,20 +1972,20 @@ static int imx900_configure_shutter(struct imx900 *sensor)
 		return -EINVAL;
 	}
 
-	switch (sensor->cur_mode.size.bounds_height) {
-	case IMX900_DEFAULT_HEIGHT:
+	switch (sensor->cur_mode.index) {
+	case IMX900_MODE_ALL_PIXEL:
 		vint_en |= 0x1C;
 		break;
-	case IMX900_ROI_MODE_HEIGHT:
+	case IMX900_MODE_ROI:
 		vint_en |= 0x1C;
 		break;
-	case IMX900_SUBSAMPLING2_MODE_HEIGHT:
+	case IMX900_MODE_SUBSAMPLING2:
 		vint_en |= (sensor->chromacity == IMX900_COLOR) ? 0x14 : 0x18;
 		break;
-	case IMX900_SUBSAMPLING10_MODE_HEIGHT:
+	case IMX900_MODE_SUBSAMPLING10:
 		vint_en |= 0x14;
 		break;
-	case IMX900_BINNING_CROP_MODE_HEIGHT:
+	case IMX900_MODE_BINNING_CROP:
 		vint_en |= 0x18;
 		break;
 	}
@@ -1646,6 +2053,8 @@ static int imx900_set_exp(struct imx900 *sensor, u32 exp, unsigned int which_con
 	int ret = 0;
 	s32 integration_time_line;
 	s32 frame_length;
+	u32 vmax;
+	struct vvsensor_afps_frame afps;
 	u32 integration_offset = IMX900_INTEGRATION_OFFSET;
 	s32 reg_shs;
 	u8 min_reg_shs;
@@ -1662,10 +2071,14 @@ static int imx900_set_exp(struct imx900 *sensor, u32 exp, unsigned int which_con
 	else // from V4L2 control
 		integration_time_line = (exp - integration_offset) * IMX900_K_FACTOR / sensor->cur_mode.ae_info.one_line_exp_time_ns;
 
-	if (integration_time_line > sensor->cur_mode.ae_info.max_integration_line) {
+	vmax = vvsensor_afps_propose(&sensor->vs, max_t(s32, integration_time_line, 0), 1, &afps);
+	if (vmax)
+		frame_length = vmax;
+
+	if (integration_time_line > afps.max_integration_line) {
 		pr_info("%s: setting integration time to max value %u\n", __func__,
-			sensor->cur_mode.ae_info.max_integration_line);
-		integration_time_line = sensor->cur_mode.ae_info.max_integration_line;
+			afps.max_integration_line);
+		integration_time_line = afps.max_integration_line;
 		}
 
 	if (integration_time_line < sensor->cur_mode.ae_info.min_integration_line) {
@@ -1688,10 +2101,19 @@ static int imx900_set_exp(struct imx900 *sensor, u32 exp, unsigned int which_con
 
 	pr_debug("enter %s exposure register: %u integration_time_line: %u frame lenght %u\n", __func__, reg_shs, integration_time_line, frame_length);
 	ret = imx900_write_reg(sensor, REGHOLD, 1);
+	if (vmax) {
+		ret |= imx900_write_reg(sensor, VMAX_HIGH, (vmax >> 16) & 0xff);
+		ret |= imx900_write_reg(sensor, VMAX_MID, (vmax >> 8) & 0xff);
+		ret |= imx900_write_reg(sensor, VMAX_LOW, vmax & 0xff);
+	}
 	ret |= imx900_write_reg(sensor, SHS_HIGH, (reg_shs >> 16) & 0xff);
 	ret |= imx900_write_reg(sensor, SHS_MID, (reg_shs >> 8) & 0xff);
 	ret |= imx900_write_reg(sensor, SHS_LOW, reg_shs & 0xff);
 	ret |= imx900_write_reg(sensor, REGHOLD, 0);
+	/* the frame length is only the new one once it is written */
+	if (!ret)
+		vvsensor_afps_commit(&sensor->vs, &afps);
+	sensor->applied.exp_lines = frame_length - reg_shs;
 
 	if (ret < 0)
 		pr_err("%s Failed to set exposure exp: %u, shs register:  %u\n", __func__, exp, reg_shs);
@@ -1761,6 +2183,7 @@ static int imx900_set_gain(struct imx900 *sensor, u32 gain, unsigned int which_c
 	ret |= imx900_write_reg(sensor, GAIN_HIGH, (gain_reg>>8) & 0xff);
 	ret |= imx900_write_reg(sensor, GAIN_LOW, gain_reg & 0xff);
 	ret |= imx900_write_reg(sensor, REGHOLD, 0);
+	sensor->applied.gain_reg = gain_reg;
 
 	return ret;
 }
@@ -1841,6 +2264,7 @@ static int imx900_set_fps(struct imx900 *sensor, u32 fps, u8 which_control)
 		}
 	}
 	sensor->cur_mode.ae_info.curr_frm_len_lines = fps_reg;
+	vvsensor_afps_reset(&sensor->vs);
 	return ret;
 }
 
@@ -1888,8 +2312,29 @@ fail:
 	return err;
 }
 
+/* Lines of a frame on top of the read out ones, per readout mode */
+static u32 imx900_frame_len_offset(struct imx900 *sensor)
+{
+	switch (sensor->cur_mode.index) {
+	case IMX900_MODE_SUBSAMPLING2:
+		return (sensor->chromacity == IMX900_COLOR) ? 34 : 38;
+	case IMX900_MODE_SUBSAMPLING10:
+		return 34;
+	case IMX900_MODE_BINNING_CROP:
+		return 38;
+	default:
+		return 56;
+	}
+}
+
+/*
+ * Minimum frame length and maximum frame rate of the active window. The
+ * new limit is also reported through the frame rate control.
+ * Called with sensor->lock held.
+ */
 static int imx900_update_framerate_range(struct imx900 *sensor)
 {
+	vvcam_ae_info_t *ae_info = &sensor->cur_mode.ae_info;
 	u8 gmrwt, gmrwt2, gmtwt, gsdly;
 	int err;
 
@@ -1904,32 +2349,22 @@ static int imx900_update_framerate_range(struct imx900 *sensor)
 		return err;
 	}
 
-	switch (sensor->cur_mode.size.bounds_height) {
-	case IMX900_DEFAULT_HEIGHT:
-		sensor->cur_mode.ae_info.curr_frm_len_lines = IMX900_DEFAULT_HEIGHT + gmrwt + gmrwt2*2 + gmtwt + gsdly + 56;
-		break;
-	case IMX900_ROI_MODE_HEIGHT:
-		sensor->cur_mode.ae_info.curr_frm_len_lines = IMX900_ROI_MODE_HEIGHT + gmrwt + gmrwt2*2 + gmtwt + gsdly + 56;
-		break;
-	case IMX900_SUBSAMPLING2_MODE_HEIGHT:
-		if (sensor->chromacity == IMX900_COLOR)
-			sensor->cur_mode.ae_info.curr_frm_len_lines = IMX900_SUBSAMPLING2_MODE_HEIGHT + gmrwt + gmrwt2*2 + gmtwt + gsdly + 34;
-		else
-			sensor->cur_mode.ae_info.curr_frm_len_lines = IMX900_SUBSAMPLING2_MODE_HEIGHT + gmrwt + gmrwt2*2 + gmtwt + gsdly + 38;
-		break;
-	case IMX900_SUBSAMPLING10_MODE_HEIGHT:
-		sensor->cur_mode.ae_info.curr_frm_len_lines = IMX900_SUBSAMPLING10_MODE_HEIGHT + gmrwt + gmrwt2*2 + gmtwt + gsdly + 34;
-		break;
-	case IMX900_BINNING_CROP_MODE_HEIGHT:
-		sensor->cur_mode.ae_info.curr_frm_len_lines = IMX900_BINNING_CROP_MODE_HEIGHT + gmrwt + gmrwt2*2 + gmtwt + gsdly + 38;
-		break;
-	}
+	ae_info->curr_frm_len_lines = sensor->cur_mode.size.bounds_height +
+		gmrwt + gmrwt2*2 + gmtwt + gsdly + imx900_frame_len_offset(sensor);
 
-	sensor->cur_mode.ae_info.max_fps = (IMX900_G_FACTOR * IMX900_M_FACTOR) /
-									 (sensor->cur_mode.ae_info.curr_frm_len_lines * sensor->cur_mode.ae_info.one_line_exp_time_ns);
+	/* fps in the 1/1024 units of the mode table */
+	ae_info->max_fps = div_u64(IMX900_G_FACTOR << 10,
+			ae_info->curr_frm_len_lines * ae_info->one_line_exp_time_ns);
+	if (ae_info->cur_fps > ae_info->max_fps)
+		ae_info->cur_fps = ae_info->max_fps;
 
-	return 0;
+	pr_debug("%s: %u lines, max fps %u\n", __func__,
+		ae_info->curr_frm_len_lines, ae_info->max_fps >> 10);
 
+	return __v4l2_ctrl_modify_range(sensor->ctrls.framerate,
+			sensor->ctrls.framerate->minimum, ae_info->max_fps >> 10, 1,
+			min_t(s64, sensor->ctrls.framerate->default_value,
+			      ae_info->max_fps >> 10));
 }
 
 static int imx900_set_ratio(struct imx900 *sensor, void *pratio)
@@ -1961,6 +2396,10 @@ static int imx900_s_ctrl(struct v4l2_ctrl *ctrl)
 
 	/* v4l2_ctrl_lock() locks our own mutex */
 
+	/* the areas change the mode geometry, also while powered off */
+	if (ctrl->id == V4L2_CID_ROI_AREAS)
+		return imx900_set_roi_areas(sensor, ctrl->p_new.p_u32);
+
 	/*
 	 * If the device is not powered up by the host driver do
 	 * not apply any controls to H/W at this time. Instead
@@ -1991,6 +2430,9 @@ static int imx900_s_ctrl(struct v4l2_ctrl *ctrl)
 	case V4L2_CID_SHUTTER_MODE:
 		ret = imx900_set_shutter_mode(sensor, ctrl->val);
 		break;
+	case V4L2_CID_TRIGGER:
+		ret = imx900_fire_trigger(sensor);
+		break;
 	default:
 		ret = -EINVAL;
 		break;
@@ -1999,7 +2441,81 @@ static int imx900_s_ctrl(struct v4l2_ctrl *ctrl)
 	return ret;
 }
 
+static u32 imx900_csi_lanes(struct imx900 *sensor)
+{
+	if (!strcmp(sensor->gmsl, "gmsl") && sensor->g_ctx.num_csi_lanes)
+		return sensor->g_ctx.num_csi_lanes;
+
+	return sensor->cur_mode.mipi_info.mipi_lane;
+}
+
+static int imx900_link_freq_index(struct imx900 *sensor)
+{
+	struct device *dev = &sensor->i2c_client->dev;
+	s64 freq;
+	u32 i;
+
+	if (strcmp(sensor->gmsl, "gmsl"))
+		return sensor->ctrls.data_rate->val;
+
+	/* the CSI receiver sees the deserializer rate, not the sensor one */
+	freq = (s64)max96792_get_csi_rate(sensor->dser_dev) * 1000000 / 2;
+	for (i = IMX900_LINK_FREQ_GMSL; i < ARRAY_SIZE(imx900_link_freq_menu); i++) {
+		if (imx900_link_freq_menu[i] == freq)
+			return i;
+	}
+
+	dev_warn(dev, "%s: deserializer CSI rate %lld Hz is not in the link frequency menu\n",
+		 __func__, freq);
+
+	return -EINVAL;
+}
+
+static int imx900_g_volatile_ctrl(struct v4l2_ctrl *ctrl)
+{
+	struct v4l2_subdev *sd = ctrl_to_sd(ctrl);
+	struct imx900 *sensor = to_imx900_dev(sd);
+	unsigned long flags;
+	int idx;
+
+	switch (ctrl->id) {
+	case V4L2_CID_LINK_FREQ:
+		idx = imx900_link_freq_index(sensor);
+		if (idx < 0)
+			return idx;
+		ctrl->val = idx;
+		break;
+	case V4L2_CID_PIXEL_RATE:
+		idx = imx900_link_freq_index(sensor);
+		if (idx < 0)
+			return idx;
+		ctrl->val64 = div_u64(imx900_link_freq_menu[idx] * 2 *
+			imx900_csi_lanes(sensor), sensor->cur_mode.bit_width);
+		break;
+	case V4L2_CID_TRIGGER_TIMESTAMP:
+		spin_lock_irqsave(&sensor->trig.lock, flags);
+		ctrl->val64 = ktime_to_ns(sensor->trig.ts);
+		spin_unlock_irqrestore(&sensor->trig.lock, flags);
+		break;
+	case V4L2_CID_TRIGGER_LATENCY:
+		spin_lock_irqsave(&sensor->trig.lock, flags);
+		ctrl->val64 = sensor->trig.latency_ns;
+		spin_unlock_irqrestore(&sensor->trig.lock, flags);
+		break;
+	case V4L2_CID_TRIGGER_JITTER:
+		spin_lock_irqsave(&sensor->trig.lock, flags);
+		ctrl->val64 = sensor->trig.latency_max_ns - sensor->trig.latency_min_ns;
+		spin_unlock_irqrestore(&sensor->trig.lock, flags);
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
 static const struct v4l2_ctrl_ops imx900_ctrl_ops = {
+	.g_volatile_ctrl = imx900_g_volatile_ctrl,
 	.s_ctrl = imx900_s_ctrl,
 };
 
@@ -2131,23 +2647,23 @@ static int imx900_set_mode_additional(struct imx900 *sensor)
 
 	pr_debug("enter %s function\n", __func__);
 
-	switch (sensor->cur_mode.size.bounds_height) {
-	case IMX900_DEFAULT_HEIGHT:
+	switch (sensor->cur_mode.index) {
+	case IMX900_MODE_ALL_PIXEL:
 		err = imx900_write_reg_arry(sensor, (struct vvcam_sccb_data_s *)mode_allPixel_roi, ARRAY_SIZE(mode_allPixel_roi));
 	break;
-	case IMX900_ROI_MODE_HEIGHT:
+	case IMX900_MODE_ROI:
 		err = imx900_write_reg_arry(sensor, (struct vvcam_sccb_data_s *)mode_allPixel_roi, ARRAY_SIZE(mode_allPixel_roi));
 	break;
-	case IMX900_SUBSAMPLING2_MODE_HEIGHT:
+	case IMX900_MODE_SUBSAMPLING2:
 		if (sensor->chromacity == IMX900_COLOR)
 			err = imx900_write_reg_arry(sensor, (struct vvcam_sccb_data_s *)mode_subsampling2_color, ARRAY_SIZE(mode_subsampling2_color));
 		else
 			err = imx900_write_reg_arry(sensor, (struct vvcam_sccb_data_s *)mode_subsampling2_binning_mono, ARRAY_SIZE(mode_subsampling2_binning_mono));
 	break;
-	case IMX900_SUBSAMPLING10_MODE_HEIGHT:
+	case IMX900_MODE_SUBSAMPLING10:
 		err = imx900_write_reg_arry(sensor, (struct vvcam_sccb_data_s *)mode_subsampling10, ARRAY_SIZE(mode_subsampling10));
 	break;
-	case IMX900_BINNING_CROP_MODE_HEIGHT:
+	case IMX900_MODE_BINNING_CROP:
 		err = imx900_write_reg_arry(sensor, (struct vvcam_sccb_data_s *)mode_subsampling2_binning_mono, ARRAY_SIZE(mode_subsampling2_binning_mono));
 	break;
 	}
@@ -2166,13 +2682,13 @@ static int imx900_write_mode_dep_chromacity(struct imx900 *sensor, struct vvcam_
 	int err = 0;
 
 	if (sensor->chromacity == IMX900_COLOR) {
-		if (sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT)
+		if (sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2)
 			err = imx900_write_reg_arry(sensor, table1, 8);
 		else
 			err = imx900_write_reg_arry(sensor, table2, 8);
 	} else {//monochrome
-		if ((sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT)
-		|| (sensor->cur_mode.size.bounds_height == IMX900_BINNING_CROP_MODE_HEIGHT))
+		if ((sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2)
+		|| (sensor->cur_mode.index == IMX900_MODE_BINNING_CROP))
 			err = imx900_write_reg_arry(sensor, table3, 8);
 		else
 			err = imx900_write_reg_arry(sensor, table2, 8);
@@ -2839,6 +3355,7 @@ static int imx900_gmsl_serdes_setup(struct imx900 *priv)
 		pr_err("serializer gmsl setup failed\n");
 		goto error;
 	}
+	priv->g_ctx.link_rate = GMSL_LINK_RATE_12G;
 
 	/* setup serdes addressing and control pipeline */
 	err = max96792_setup_link(priv->dser_dev, &priv->i2c_client->dev);
@@ -2887,6 +3404,34 @@ static void imx900_gmsl_serdes_reset(struct imx900 *priv)
 	mutex_unlock(&priv->lock);
 }
 
+static void imx900_gmsl_link_notify(struct device *s_dev, u32 event)
+{
+	struct i2c_client *client = to_i2c_client(s_dev);
+	struct imx900 *sensor = client_to_imx900(client);
+	struct v4l2_event ev = {
+		.type = GMSL_V4L2_EVENT_LINK,
+	};
+
+	dev_dbg(s_dev, "%s: gmsl link event %u\n", __func__, event);
+
+	ev.u.data[0] = event;
+	if (sensor->sd.devnode)
+		v4l2_event_queue(sensor->sd.devnode, &ev);
+}
+
+static int imx900_subscribe_event(struct v4l2_subdev *sd, struct v4l2_fh *fh,
+				struct v4l2_event_subscription *sub)
+{
+	switch (sub->type) {
+	case GMSL_V4L2_EVENT_LINK:
+		return v4l2_event_subscribe(fh, sub, 4, NULL);
+	case V4L2_EVENT_CTRL:
+		return v4l2_ctrl_subdev_subscribe_event(sd, fh, sub);
+	default:
+		return -EINVAL;
+	}
+}
+
 static int imx900_enum_mbus_code(struct v4l2_subdev *sd,
 					struct v4l2_subdev_state *state,
 					struct v4l2_subdev_mbus_code_enum *code)
@@ -2904,27 +3449,174 @@ static int imx900_enum_mbus_code(struct v4l2_subdev *sd,
 	return 0;
 }
 
-static int imx900_set_fmt(struct v4l2_subdev *sd,
-			  struct v4l2_subdev_state *state,
-			  struct v4l2_subdev_format *fmt)
+/* Only the all-pixel readout takes an arbitrary ROI window */
+static bool imx900_crop_supported(struct imx900 *sensor)
 {
-	int ret = 0;
-	struct i2c_client *client = v4l2_get_subdevdata(sd);
-	struct imx900 *sensor = client_to_imx900(client);
+	return sensor->cur_mode.index == IMX900_MODE_ALL_PIXEL ||
+	       sensor->cur_mode.index == IMX900_MODE_ROI;
+}
 
-	mutex_lock(&sensor->lock);
-	pr_debug("enter %s function\n", __func__);
-	if ((fmt->format.width != sensor->cur_mode.size.bounds_width) ||
-		(fmt->format.height != sensor->cur_mode.size.bounds_height)) {
-		pr_err("%s:set sensor format %dx%d error\n",
-			__func__, fmt->format.width, fmt->format.height);
-		mutex_unlock(&sensor->lock);
+static int imx900_span_cmp(const void *a, const void *b)
+{
+	const struct imx900_roi_span *sa = a, *sb = b;
+
+	return sa->start - sb->start;
+}
+
+/* Sort the windows and merge the overlapping or adjacent ones */
+static u32 imx900_merge_spans(struct imx900_roi_span *span, u32 num)
+{
+	struct imx900_roi_span *last;
+	u32 i, out = 0;
+
+	sort(span, num, sizeof(*span), imx900_span_cmp, NULL);
+
+	for (i = 0; i < num; i++) {
+		last = out ? &span[out - 1] : NULL;
+		if (last && span[i].start <= last->start + last->len) {
+			last->len = max_t(u32, last->start + last->len,
+					  span[i].start + span[i].len) - last->start;
+			continue;
+		}
+		span[out++] = span[i];
+	}
+
+	return out;
+}
+
+static u32 imx900_spans_len(const struct imx900_roi_span *span, u32 num)
+{
+	u32 i, len = 0;
+
+	for (i = 0; i < num; i++)
+		len += span[i].len;
+
+	return len;
+}
+
+/*
+ * Turn the rectangles of the ROI areas control into horizontal and
+ * vertical windows. The windows are widened to the size steps of the
+ * readout, so that merged windows keep to them as well.
+ */
+static int imx900_parse_roi_areas(const u32 *areas, struct imx900_roi *roi)
+{
+	const u32 *r;
+	u32 i, end;
+
+	memset(roi, 0, sizeof(*roi));
+
+	for (i = 0; i < IMX900_ROI_AREAS; i++) {
+		r = &areas[i * IMX900_ROI_FIELDS];
+		if (!r[IMX900_ROI_WIDTH] || !r[IMX900_ROI_HEIGHT])
+			continue;
+
+		if (r[IMX900_ROI_LEFT] + r[IMX900_ROI_WIDTH] > IMX900_DEFAULT_WIDTH ||
+		    r[IMX900_ROI_TOP] + r[IMX900_ROI_HEIGHT] > IMX900_DEFAULT_HEIGHT)
+			return -EINVAL;
+
+		end = round_up(r[IMX900_ROI_LEFT] + r[IMX900_ROI_WIDTH],
+			       IMX900_CROP_WIDTH_STEP);
+		roi->h[roi->num_h].start = round_down(r[IMX900_ROI_LEFT],
+						      IMX900_CROP_WIDTH_STEP);
+		roi->h[roi->num_h].len = end - roi->h[roi->num_h].start;
+		roi->num_h++;
+
+		end = round_up(r[IMX900_ROI_TOP] + r[IMX900_ROI_HEIGHT],
+			       IMX900_CROP_HEIGHT_STEP);
+		roi->v[roi->num_v].start = round_down(r[IMX900_ROI_TOP],
+						      IMX900_CROP_HEIGHT_STEP);
+		roi->v[roi->num_v].len = end - roi->v[roi->num_v].start;
+		roi->num_v++;
+	}
+
+	if (!roi->num_h)
+		return 0;
+
+	roi->num_h = imx900_merge_spans(roi->h, roi->num_h);
+	roi->num_v = imx900_merge_spans(roi->v, roi->num_v);
+
+	if (roi->num_h > 1 || roi->num_v > 1) {
+		pr_err("%s: ROI areas must merge into one window\n", __func__);
 		return -EINVAL;
 	}
 
-	imx900_get_format_code(sensor, &fmt->format.code);
-	fmt->format.field = V4L2_FIELD_NONE;
-	sensor->format = fmt->format;
+	if (imx900_spans_len(roi->h, roi->num_h) < IMX900_CROP_MIN_WIDTH ||
+	    imx900_spans_len(roi->v, roi->num_v) < IMX900_CROP_MIN_HEIGHT) {
+		pr_err("%s: ROI areas below the minimum frame size\n", __func__);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static void imx900_roi_bounds(const struct imx900_roi *roi, struct v4l2_rect *r)
+{
+	const struct imx900_roi_span *h = &roi->h[roi->num_h - 1];
+	const struct imx900_roi_span *v = &roi->v[roi->num_v - 1];
+
+	r->left = roi->h[0].start;
+	r->top = roi->v[0].start;
+	r->width = h->start + h->len - r->left;
+	r->height = v->start + v->len - r->top;
+}
+
+/* The mode output is the crop window, or the ROI areas packed together */
+static void imx900_update_crop_size(struct imx900 *sensor)
+{
+	u32 width = sensor->crop.width;
+	u32 height = sensor->crop.height;
+
+	if (sensor->roi.num_h) {
+		width = imx900_spans_len(sensor->roi.h, sensor->roi.num_h);
+		height = imx900_spans_len(sensor->roi.v, sensor->roi.num_v);
+	}
+
+	vvsensor_crop_size(&imx900_crop_limits, width, height,
+			&sensor->cur_mode.size, &sensor->format);
+}
+
+static int imx900_write_crop(struct imx900 *sensor)
+{
+	const struct v4l2_rect *r = &sensor->crop;
+	struct v4l2_rect roi;
+	int ret = 0;
+
+	if (!imx900_crop_supported(sensor))
+		return 0;
+
+	if (sensor->roi.num_h) {
+		imx900_roi_bounds(&sensor->roi, &roi);
+		r = &roi;
+	} else if (v4l2_rect_equal(r, &imx900_mode_crop[sensor->cur_mode.index])) {
+		/* the default window is programmed by the mode tables */
+		return 0;
+	}
+
+	pr_debug("%s: %ux%u at %d,%d\n", __func__,
+		r->width, r->height, r->left, r->top);
+
+	ret = imx900_write_reg(sensor, FID0_ROI, 0x03);
+	ret |= imx900_write_reg(sensor, FID0_ROIPH1_LOW, IMX900_TO_LOW_BYTE(r->left));
+	ret |= imx900_write_reg(sensor, FID0_ROIPH1_HIGH, IMX900_TO_MID_BYTE(r->left));
+	ret |= imx900_write_reg(sensor, FID0_ROIPV1_LOW, IMX900_TO_LOW_BYTE(r->top));
+	ret |= imx900_write_reg(sensor, FID0_ROIPV1_HIGH, IMX900_TO_MID_BYTE(r->top));
+	ret |= imx900_write_reg(sensor, FID0_ROIWH1_LOW, IMX900_TO_LOW_BYTE(r->width));
+	ret |= imx900_write_reg(sensor, FID0_ROIWH1_HIGH, IMX900_TO_MID_BYTE(r->width));
+	ret |= imx900_write_reg(sensor, FID0_ROIWV1_LOW, IMX900_TO_LOW_BYTE(r->height));
+	ret |= imx900_write_reg(sensor, FID0_ROIWV1_HIGH, IMX900_TO_MID_BYTE(r->height));
+	ret |= imx900_write_reg(sensor, VOPB_VBLK_HWID_LOW, IMX900_TO_LOW_BYTE(r->width));
+	ret |= imx900_write_reg(sensor, VOPB_VBLK_HWID_HIGH, IMX900_TO_MID_BYTE(r->width));
+	ret |= imx900_write_reg(sensor, FINFO_HWIDTH_LOW, IMX900_TO_LOW_BYTE(r->width));
+	ret |= imx900_write_reg(sensor, FINFO_HWIDTH_HIGH, IMX900_TO_MID_BYTE(r->width));
+
+	return ret;
+}
+
+/* Called with sensor->lock held */
+static int imx900_apply_mode(struct imx900 *sensor)
+{
+	int ret = 0;
 
 	ret = imx900_write_reg_arry(sensor,
 		(struct vvcam_sccb_data_s *)sensor->cur_mode.preg_data,
@@ -2932,63 +3624,58 @@ static int imx900_set_fmt(struct v4l2_subdev *sd,
 	
 	if (ret < 0) {
 		pr_err("%s:imx900_write_reg_arry error\n", __func__);
-		mutex_unlock(&sensor->lock);
 		return -EINVAL;
 	}
 
 	ret = imx900_chromacity_mode(sensor);
 	if (ret < 0) {
 		pr_err("%s:unable to get chromacity information\n", __func__);
-		mutex_unlock(&sensor->lock);
 		return -EINVAL;
 	}
 
 	ret = imx900_set_pixel_format(sensor);
 	if (ret < 0) {
 		pr_err("%s:imx900_write_reg_arry error, failed to set pixel format\n", __func__);
-		mutex_unlock(&sensor->lock);
 		return -EINVAL;
 	}
 
 	ret = imx900_set_mode_additional(sensor);
 	if (ret < 0) {
 		pr_err("%s:unable to set additional sensor mode settings\n", __func__);
-		mutex_unlock(&sensor->lock);
 		return -EINVAL;
 	}
 
 	ret = imx900_configure_triggering_pins(sensor);
 	if (ret < 0) {
 		pr_err("%s:imx900_write_reg_arry error, unable configure XVS/XHS pins\n", __func__);
-		mutex_unlock(&sensor->lock);
 		return -EINVAL;
 	}
 
-	if (sensor->cur_mode.size.bounds_height == IMX900_DEFAULT_HEIGHT) {
+	if (sensor->cur_mode.index == IMX900_MODE_ALL_PIXEL) {
 		ret = imx900_write_reg_arry(sensor, (struct vvcam_sccb_data_s *)mode_2064x1552, ARRAY_SIZE(mode_2064x1552));
 		if (ret < 0) {
 			pr_err("%s:imx900_write_reg_arry error, failed to set up resolution\n", __func__);
 			return -EINVAL;
 		}
-	} else if (sensor->cur_mode.size.bounds_height == IMX900_ROI_MODE_HEIGHT) {
+	} else if (sensor->cur_mode.index == IMX900_MODE_ROI) {
 		ret = imx900_write_reg_arry(sensor, (struct vvcam_sccb_data_s *)mode_1920x1080, ARRAY_SIZE(mode_1920x1080));
 		if (ret < 0) {
 			pr_err("%s:imx900_write_reg_arry error, failed to set up resolution\n", __func__);
 			return -EINVAL;
 		}
-	} else if (sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING2_MODE_HEIGHT) {
+	} else if (sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING2) {
 		ret = imx900_write_reg_arry(sensor, (struct vvcam_sccb_data_s *)mode_1032x776, ARRAY_SIZE(mode_1032x776));
 		if (ret < 0) {
 			pr_err("%s:imx900_write_reg_arry error, failed to set up resolution\n", __func__);
 			return -EINVAL;
 		}
-	} else if (sensor->cur_mode.size.bounds_height == IMX900_SUBSAMPLING10_MODE_HEIGHT) {
+	} else if (sensor->cur_mode.index == IMX900_MODE_SUBSAMPLING10) {
 		ret = imx900_write_reg_arry(sensor, (struct vvcam_sccb_data_s *)mode_2064x154, ARRAY_SIZE(mode_2064x154));
 		if (ret < 0) {
 			pr_err("%s:imx900_write_reg_arry error, failed to set up resolution\n", __func__);
 			return -EINVAL;
 		}
-	} else if (sensor->cur_mode.size.bounds_height == IMX900_BINNING_CROP_MODE_HEIGHT) {
+	} else if (sensor->cur_mode.index == IMX900_MODE_BINNING_CROP) {
 		ret = imx900_write_reg_arry(sensor, (struct vvcam_sccb_data_s *)mode_1024x720, ARRAY_SIZE(mode_1024x720));
 		if (ret < 0) {
 			pr_err("%s:imx900_write_reg_arry error, failed to set up resolution\n", __func__);
@@ -2996,6 +3683,12 @@ static int imx900_set_fmt(struct v4l2_subdev *sd,
 		}
 	}
 
+	ret = imx900_write_crop(sensor);
+	if (ret < 0) {
+		pr_err("%s:unable to set up crop window\n", __func__);
+		return -EINVAL;
+	}
+
 	ret = imx900_s_ctrl(sensor->ctrls.data_rate);
 	if (ret < 0) {
 		pr_err("%s:unable to set data rate\n", __func__);
@@ -3005,33 +3698,108 @@ static int imx900_set_fmt(struct v4l2_subdev *sd,
 	ret = imx900_set_dep_registers(sensor);
 	if (ret < 0) {
 		pr_err("%s:unable to write dep registers to image sensor\n", __func__);
-		mutex_unlock(&sensor->lock);
 		return -EINVAL;
 	}
 
 	ret = imx900_configure_shutter(sensor);
 	if (ret < 0) {
 		pr_err("%s:unable to set mode\n", __func__);
-		mutex_unlock(&sensor->lock);
 		return -EINVAL;
 	}
 
 	ret = imx900_calculate_line_time(sensor);
 	if (ret < 0) {
 		pr_err("%s:unable to calculate line time\n", __func__);
-		mutex_unlock(&sensor->lock);
 		return -EINVAL;
 	}
 
 	ret = imx900_update_framerate_range(sensor);
 	if (ret < 0) {
 		pr_err("%s:unable to update framerate range\n", __func__);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int imx900_shadow_replay(struct imx900 *sensor)
+{
+	int ret;
+	int i;
+
+	if (!sensor->shadow_valid)
+		return 0;
+
+	ret = imx900_write_reg(sensor, REGHOLD, 1);
+	for (i = 0; i < ARRAY_SIZE(imx900_shadow_regs); i++) {
+		if (sensor->shadow_valid & BIT(i))
+			ret |= imx900_write_reg(sensor, imx900_shadow_regs[i],
+					sensor->shadow_val[i]);
+	}
+	ret |= imx900_write_reg(sensor, REGHOLD, 0);
+
+	return ret;
+}
+
+/*
+ * Reprogram the sensor after it lost its registers: mode tables first,
+ * then the controls that are not part of them, then the last AE values.
+ * Called with sensor->lock held.
+ */
+static int imx900_restore_mode(struct imx900 *sensor)
+{
+	u8 shadow_val[ARRAY_SIZE(imx900_shadow_regs)];
+	u32 shadow_valid = sensor->shadow_valid;
+	int ret;
+
+	/* applying the mode rewrites some shadowed registers with defaults */
+	memcpy(shadow_val, sensor->shadow_val, sizeof(shadow_val));
+
+	ret = imx900_apply_mode(sensor);
+
+	memcpy(sensor->shadow_val, shadow_val, sizeof(shadow_val));
+	sensor->shadow_valid = shadow_valid;
+
+	if (ret < 0)
+		return ret;
+
+	if (sensor->ctrls.test_pattern->val)
+		ret |= imx900_set_test_pattern(sensor,
+				sensor->ctrls.test_pattern->val);
+	ret |= imx900_shadow_replay(sensor);
+
+	return ret;
+}
+
+static int imx900_set_fmt(struct v4l2_subdev *sd,
+			  struct v4l2_subdev_state *state,
+			  struct v4l2_subdev_format *fmt)
+{
+	int ret = 0;
+	struct i2c_client *client = v4l2_get_subdevdata(sd);
+	struct imx900 *sensor = client_to_imx900(client);
+
+	mutex_lock(&sensor->lock);
+	pr_debug("enter %s function\n", __func__);
+	if ((fmt->format.width != sensor->cur_mode.size.bounds_width) ||
+		(fmt->format.height != sensor->cur_mode.size.bounds_height)) {
+		pr_err("%s:set sensor format %dx%d error\n",
+			__func__, fmt->format.width, fmt->format.height);
 		mutex_unlock(&sensor->lock);
 		return -EINVAL;
 	}
 
+	imx900_get_format_code(sensor, &fmt->format.code);
+	fmt->format.field = V4L2_FIELD_NONE;
+	sensor->format = fmt->format;
+
+	sensor->shadow_valid = 0;
+	ret = imx900_apply_mode(sensor);
+	if (ret == 0)
+		sensor->mode_applied = true;
+
 	mutex_unlock(&sensor->lock);
-	return 0;
+	return ret;
 }
 
 static int imx900_get_fmt(struct v4l2_subdev *sd,
@@ -3048,6 +3816,168 @@ static int imx900_get_fmt(struct v4l2_subdev *sd,
 	return 0;
 }
 
+static int imx900_get_selection(struct v4l2_subdev *sd,
+				struct v4l2_subdev_state *state,
+				struct v4l2_subdev_selection *sel)
+{
+	struct imx900 *sensor = to_imx900_dev(sd);
+	struct v4l2_rect crop;
+	int ret;
+
+	mutex_lock(&sensor->lock);
+	crop = sensor->crop;
+	if (sensor->roi.num_h)
+		imx900_roi_bounds(&sensor->roi, &crop);
+	ret = vvsensor_crop_get_selection(&imx900_crop_limits, &crop,
+			&imx900_mode_crop[sensor->cur_mode.index], sel);
+	mutex_unlock(&sensor->lock);
+
+	return ret;
+}
+
+/*
+ * Program an ROI window of the all-pixel readout. The frame length and
+ * frame rate limits of the mode are recalculated for the new height.
+ */
+static int imx900_set_selection(struct v4l2_subdev *sd,
+				struct v4l2_subdev_state *state,
+				struct v4l2_subdev_selection *sel)
+{
+	struct imx900 *sensor = to_imx900_dev(sd);
+	int ret = 0;
+
+	if (sel->target != V4L2_SEL_TGT_CROP)
+		return -EINVAL;
+
+	mutex_lock(&sensor->lock);
+
+	if (!imx900_crop_supported(sensor)) {
+		/* fixed window of the subsampling and binning modes */
+		sel->r = sensor->crop;
+		goto out;
+	}
+
+	/* the ROI areas control owns the window until it is cleared */
+	if (sensor->roi.num_h) {
+		ret = -EBUSY;
+		goto out;
+	}
+
+	ret = vvsensor_crop_set_selection(&imx900_crop_limits, &sensor->crop,
+			sensor->stream_status, sel);
+	if (ret <= 0)
+		goto out;
+
+	ret = 0;
+	imx900_update_crop_size(sensor);
+
+	if (sensor->mode_applied && sensor->powered_on) {
+		sensor->shadow_valid = 0;
+		ret = imx900_apply_mode(sensor);
+	}
+
+out:
+	mutex_unlock(&sensor->lock);
+	return ret;
+}
+
+/*
+ * Program the readout from the ROI areas control. Called from s_ctrl with
+ * sensor->lock held. The frame size and frame rate limits of the mode
+ * follow the new geometry.
+ */
+static int imx900_set_roi_areas(struct imx900 *sensor, const u32 *areas)
+{
+	struct imx900_roi roi;
+	int ret;
+
+	ret = imx900_parse_roi_areas(areas, &roi);
+	if (ret)
+		return ret;
+
+	if (!memcmp(&roi, &sensor->roi, sizeof(roi)))
+		return 0;
+
+	if (sensor->stream_status)
+		return -EBUSY;
+
+	sensor->roi = roi;
+	if (!imx900_crop_supported(sensor))
+		return 0;
+
+	imx900_update_crop_size(sensor);
+
+	if (sensor->mode_applied && sensor->powered_on) {
+		sensor->shadow_valid = 0;
+		return imx900_apply_mode(sensor);
+	}
+
+	return 0;
+}
+
+static int imx900_vs_set_exp(struct vvsensor_ctx *ctx, u32 exp)
+{
+	return imx900_set_exp(container_of(ctx, struct imx900, vs), exp, 0);
+}
+
+static int imx900_vs_set_gain(struct vvsensor_ctx *ctx, u32 gain)
+{
+	return imx900_set_gain(container_of(ctx, struct imx900, vs), gain, 0);
+}
+
+static int imx900_vs_set_fps(struct vvsensor_ctx *ctx, u32 fps)
+{
+	return imx900_set_fps(container_of(ctx, struct imx900, vs), fps, 0);
+}
+
+static const struct vvsensor_ops imx900_vs_ops = {
+	.set_exp  = imx900_vs_set_exp,
+	.set_gain = imx900_vs_set_gain,
+	.set_fps  = imx900_vs_set_fps,
+};
+
+/* Exposure of lines in the units of VVSENSORIOC_S_EXP, us << 10 */
+static u32 imx900_lines_to_exp(struct imx900 *sensor, u32 lines)
+{
+	return div_u64((u64)lines * sensor->cur_mode.ae_info.one_line_exp_time_ns << 10,
+		       IMX900_K_FACTOR) +
+	       (IMX900_INTEGRATION_OFFSET << 10);
+}
+
+static u32 imx900_lines_to_ns(struct imx900 *sensor, u32 lines)
+{
+	return lines * sensor->cur_mode.ae_info.one_line_exp_time_ns +
+	       IMX900_INTEGRATION_OFFSET * 1000;
+}
+
+/* Gain register in the units of VVSENSORIOC_S_GAIN */
+static u32 imx900_gain_reg_to_gain(u32 gain_reg)
+{
+	return gain_reg2times[min_t(u32, gain_reg, IMX900_GAIN_REG_LEN - 1)];
+}
+
+static int imx900_s_exp_ae(struct imx900 *sensor, void __user *arg)
+{
+	struct vvcam_exp_ae_s exp_ae;
+	int ret;
+
+	if (copy_from_user(&exp_ae, arg, sizeof(exp_ae)))
+		return -EFAULT;
+
+	ret = imx900_set_exp(sensor, exp_ae.exp, 0);
+	if (ret)
+		return ret;
+
+	exp_ae.exp = imx900_lines_to_exp(sensor, sensor->applied.exp_lines);
+	exp_ae.lines = sensor->applied.exp_lines;
+	exp_ae.ns = imx900_lines_to_ns(sensor, sensor->applied.exp_lines);
+	exp_ae.ae_info = sensor->cur_mode.ae_info;
+	if (copy_to_user(arg, &exp_ae, sizeof(exp_ae)))
+		return -EFAULT;
+
+	return 0;
+}
+
 static long imx900_priv_ioctl(struct v4l2_subdev *sd,
 							  unsigned int cmd,
 							  void *arg)
@@ -3112,6 +4042,9 @@ static long imx900_priv_ioctl(struct v4l2_subdev *sd,
 		break;
 	case VVSENSORIOC_S_EXP:
 		ret = imx900_set_exp(sensor, *(u32 *)arg, 0);
+		if (!ret)
+			ret = put_user(imx900_lines_to_exp(sensor, sensor->applied.exp_lines),
+				       (u32 __user *)arg);
 		break;
 	case VVSENSORIOC_S_VSEXP:
 		ret = 0;
@@ -3121,6 +4054,9 @@ static long imx900_priv_ioctl(struct v4l2_subdev *sd,
 		break;
 	case VVSENSORIOC_S_GAIN:
 		ret = imx900_set_gain(sensor, *(u32 *)arg, 0);
+		if (!ret)
+			ret = put_user(imx900_gain_reg_to_gain(sensor->applied.gain_reg),
+				       (u32 __user *)arg);
 		break;
 	case VVSENSORIOC_S_VSGAIN:
 		ret = 0;
@@ -3149,6 +4085,19 @@ static long imx900_priv_ioctl(struct v4l2_subdev *sd,
 	case VVSENSORIOC_S_DATA_RATE:
 		ret = imx900_set_data_rate(sensor, *(u32 *)arg);
 		break;
+	case VVSENSORIOC_S_FRAME_QUEUE:
+		ret = vvsensor_s_frame_queue(&sensor->vs,
+					     sensor->stream_status, arg);
+		break;
+	case VVSENSORIOC_G_FRAME_QUEUE:
+		ret = vvsensor_g_frame_queue(&sensor->vs, arg);
+		break;
+	case VVSENSORIOC_S_MIN_AFPS:
+		ret = vvsensor_set_min_afps(&sensor->vs, *(u32 *)arg);
+		break;
+	case VVSENSORIOC_S_EXP_AE:
+		ret = imx900_s_exp_ae(sensor, arg);
+		break;
 	case VVSENSORIOC_S_SHUTTER_MODE:
 		ret = imx900_set_shutter_mode(sensor, *(u32 *)arg);
 		break;
@@ -3160,19 +4109,88 @@ static long imx900_priv_ioctl(struct v4l2_subdev *sd,
 	return ret;
 }
 
+/* VVSENSORIOC_S_STREAM calls imx900_s_stream() with the lock held */
+static int imx900_video_s_stream(struct v4l2_subdev *sd, int enable)
+{
+	struct imx900 *sensor = to_imx900_dev(sd);
+	struct device *dev = &sensor->i2c_client->dev;
+	int ret;
+
+	if (enable) {
+		ret = pm_runtime_resume_and_get(dev);
+		if (ret < 0)
+			return ret;
+	}
+
+	mutex_lock(&sensor->lock);
+	ret = imx900_s_stream(sd, enable);
+	mutex_unlock(&sensor->lock);
+
+	if (!enable || ret) {
+		pm_runtime_mark_last_busy(dev);
+		pm_runtime_put_autosuspend(dev);
+	}
+
+	return ret;
+}
+
+/* An open subdev node keeps the sensor powered for the vvcam ioctls */
+static int imx900_open(struct v4l2_subdev *sd, struct v4l2_subdev_fh *fh)
+{
+	struct imx900 *sensor = to_imx900_dev(sd);
+
+	return pm_runtime_resume_and_get(&sensor->i2c_client->dev);
+}
+
+static int imx900_close(struct v4l2_subdev *sd, struct v4l2_subdev_fh *fh)
+{
+	struct imx900 *sensor = to_imx900_dev(sd);
+
+	pm_runtime_mark_last_busy(&sensor->i2c_client->dev);
+	pm_runtime_put_autosuspend(&sensor->i2c_client->dev);
+
+	return 0;
+}
+
+static const struct v4l2_subdev_internal_ops imx900_internal_ops = {
+	.open = imx900_open,
+	.close = imx900_close,
+};
+
 static const struct v4l2_subdev_video_ops imx900_subdev_video_ops = {
-	.s_stream = imx900_s_stream,
+	.s_stream = imx900_video_s_stream,
 };
 
+static int imx900_get_mbus_config(struct v4l2_subdev *sd, unsigned int pad,
+				struct v4l2_mbus_config *cfg)
+{
+	struct imx900 *sensor = to_imx900_dev(sd);
+
+	/* the receiver can not be set up for an unknown link frequency */
+	if (imx900_link_freq_index(sensor) < 0)
+		return -EINVAL;
+
+	cfg->type = V4L2_MBUS_CSI2_DPHY;
+	cfg->bus.mipi_csi2.flags = 0;
+	cfg->bus.mipi_csi2.num_data_lanes = imx900_csi_lanes(sensor);
+
+	return 0;
+}
+
 static const struct v4l2_subdev_pad_ops imx900_subdev_pad_ops = {
 	.enum_mbus_code = imx900_enum_mbus_code,
 	.set_fmt = imx900_set_fmt,
 	.get_fmt = imx900_get_fmt,
+	.get_selection = imx900_get_selection,
+	.set_selection = imx900_set_selection,
+	.get_mbus_config = imx900_get_mbus_config,
 };
 
 static const struct v4l2_subdev_core_ops imx900_subdev_core_ops = {
 	.s_power = imx900_s_power,
 	.ioctl = imx900_priv_ioctl,
+	.subscribe_event = imx900_subscribe_event,
+	.unsubscribe_event = v4l2_event_subdev_unsubscribe,
 };
 
 static const struct v4l2_subdev_ops imx900_subdev_ops = {
@@ -3231,6 +4249,8 @@ static int imx900_probe(struct i2c_client *client)
 	mutex_init(&sensor->lock);
 
 	sensor->i2c_client = client;
+	vvsensor_init(&sensor->vs, &client->dev, &sensor->lock, &imx900_vs_ops,
+		      &sensor->cur_mode);
 	if (strcmp(sensor->gmsl, "gmsl")) {
 		sensor->rst_gpio = of_get_named_gpio(dev->of_node, "rst-gpios", 0);
 		if (!gpio_is_valid(sensor->rst_gpio))
@@ -3248,6 +4268,16 @@ static int imx900_probe(struct i2c_client *client)
 		}
 	}
 
+	sensor->trig.gpio = devm_gpiod_get_optional(dev, "trigger", GPIOD_OUT_LOW);
+	if (IS_ERR(sensor->trig.gpio)) {
+		dev_warn(dev, "Failed to get trigger pin\n");
+		sensor->trig.gpio = NULL;
+	}
+	spin_lock_init(&sensor->trig.lock);
+	hrtimer_init(&sensor->trig.timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL_HARD);
+	sensor->trig.timer.function = imx900_trigger_end;
+	sensor->trig.fs_nb.notifier_call = imx900_trigger_fs_notify;
+
 	retval = of_property_read_u32(dev->of_node, "csi_id", &(sensor->csi_id));
 	if (retval) {
 		dev_err(dev, "csi id missing or invalid\n");
@@ -3318,6 +4348,11 @@ static int imx900_probe(struct i2c_client *client)
 
 		sensor->dser_dev = &dser_i2c->dev;
 
+		/* resume order: deserializer, serializer, sensor */
+		device_link_add(dev, sensor->ser_dev, DL_FLAG_STATELESS);
+		device_link_add(sensor->ser_dev, sensor->dser_dev,
+				DL_FLAG_STATELESS);
+
 		/* populate g_ctx from DT */
 		gmsl = of_get_child_by_name(node, "gmsl-link");
 		if (gmsl == NULL) {
@@ -3420,6 +4455,7 @@ static int imx900_probe(struct i2c_client *client)
 		}
 
 		sensor->g_ctx.s_dev = dev;
+		sensor->g_ctx.notify = imx900_gmsl_link_notify;
 
 		//TODO:?mutex_init(&serdes_lock__);
 		/* Pair sensor to serializer dev */
@@ -3466,7 +4502,8 @@ static int imx900_probe(struct i2c_client *client)
 
 	sd = &sensor->sd;
 	v4l2_i2c_subdev_init(sd, client, &imx900_subdev_ops);
-	sd->flags |= V4L2_SUBDEV_FL_HAS_DEVNODE;
+	sd->internal_ops = &imx900_internal_ops;
+	sd->flags |= V4L2_SUBDEV_FL_HAS_DEVNODE | V4L2_SUBDEV_FL_HAS_EVENTS;
 	sd->dev = &client->dev;
 	sd->entity.ops = &imx900_sd_media_ops;
 	sd->entity.function = MEDIA_ENT_F_CAM_SENSOR;
@@ -3479,9 +4516,10 @@ static int imx900_probe(struct i2c_client *client)
 
 	memcpy(&sensor->cur_mode, &pimx900_mode_info[0],
 		sizeof(struct vvcam_mode_info_s));
+	sensor->crop = imx900_mode_crop[IMX900_MODE_ALL_PIXEL];
 
 	/* initialize controls */
-	retval = v4l2_ctrl_handler_init(&sensor->ctrls.handler, 7);
+	retval = v4l2_ctrl_handler_init(&sensor->ctrls.handler, 14);
 	if (retval < 0) {
 		dev_err(&client->dev,
 			"%s : ctrl handler init Failed\n", __func__);
@@ -3509,9 +4547,25 @@ static int imx900_probe(struct i2c_client *client)
 	//sensor->ctrls.sync_mode = v4l2_ctrl_new_custom(&sensor->ctrls.handler, imx900_ctrl_sync_mode, NULL);
 	sensor->ctrls.framerate = v4l2_ctrl_new_custom(&sensor->ctrls.handler, imx900_ctrl_framerate, NULL);
 	sensor->ctrls.shutter_mode = v4l2_ctrl_new_custom(&sensor->ctrls.handler, imx900_ctrl_shutter_mode, NULL);
+	sensor->ctrls.roi_areas = v4l2_ctrl_new_custom(&sensor->ctrls.handler, imx900_ctrl_roi_areas, NULL);
+	if (sensor->trig.gpio) {
+		sensor->ctrls.trigger = v4l2_ctrl_new_custom(&sensor->ctrls.handler, imx900_ctrl_trigger, NULL);
+		for (i = 0; i < ARRAY_SIZE(imx900_ctrl_trigger_stats); i++)
+			v4l2_ctrl_new_custom(&sensor->ctrls.handler, &imx900_ctrl_trigger_stats[i], NULL);
+	}
 	sensor->ctrls.test_pattern = v4l2_ctrl_new_std_menu_items(&sensor->ctrls.handler, &imx900_ctrl_ops, V4L2_CID_TEST_PATTERN,
 					ARRAY_SIZE(test_pattern_menu) - 1, 0, 0, test_pattern_menu);
 
+	sensor->ctrls.link_freq = v4l2_ctrl_new_int_menu(&sensor->ctrls.handler, &imx900_ctrl_ops, V4L2_CID_LINK_FREQ,
+					ARRAY_SIZE(imx900_link_freq_menu) - 1, imx900_ctrl_data_rate[0].def, imx900_link_freq_menu);
+	if (sensor->ctrls.link_freq)
+		sensor->ctrls.link_freq->flags |= V4L2_CTRL_FLAG_VOLATILE |
+						  V4L2_CTRL_FLAG_READ_ONLY;
+	sensor->ctrls.pixel_rate = v4l2_ctrl_new_std(&sensor->ctrls.handler, &imx900_ctrl_ops, V4L2_CID_PIXEL_RATE,
+					1, S64_MAX, 1, 1);
+	if (sensor->ctrls.pixel_rate)
+		sensor->ctrls.pixel_rate->flags |= V4L2_CTRL_FLAG_VOLATILE;
+
 	sensor->sd.ctrl_handler = &sensor->ctrls.handler;
 	if (sensor->ctrls.handler.error) {
 		retval = sensor->ctrls.handler.error;
@@ -3526,15 +4580,28 @@ static int imx900_probe(struct i2c_client *client)
 		goto free_ctrls;
 	}
 
+	/* the sensor is powered, keep it so until probe is done */
+	pm_runtime_set_active(dev);
+	pm_runtime_get_noresume(dev);
+	pm_runtime_enable(dev);
+
 	retval = v4l2_async_register_subdev_sensor(sd);
 	if (retval < 0) {
 		dev_err(&client->dev, "%s--Async register failed, ret=%d\n",
 			__func__, retval);
+		pm_runtime_disable(dev);
+		pm_runtime_set_suspended(dev);
+		pm_runtime_put_noidle(dev);
 		goto probe_err_free_entiny;
 	}
 
 	pr_debug("%s camera mipi imx900, is found\n", __func__);
 
+	pm_runtime_set_autosuspend_delay(dev, 1000);
+	pm_runtime_use_autosuspend(dev);
+	pm_runtime_mark_last_busy(dev);
+	pm_runtime_put_autosuspend(dev);
+
 	return 0;
 
 free_ctrls:
@@ -3557,6 +4624,9 @@ static void imx900_remove(struct i2c_client *client)
 
 	pr_debug("enter %s function\n", __func__);
 
+	/* the Hi-Z write below needs the sensor out of reset */
+	pm_runtime_get_sync(&client->dev);
+
 	err = imx900_write_reg(sensor, SYNCSEL, 0xF0);
 	if (err < 0)
 		pr_warn("%s: failed to set XVS XHS to Hi-Z\n", __func__);
@@ -3564,11 +4634,18 @@ static void imx900_remove(struct i2c_client *client)
 	if (!(strcmp(sensor->gmsl, "gmsl"))) {
 		imx900_gmsl_serdes_reset(sensor);
 		max96792_sdev_unregister(sensor->dser_dev, &sensor->i2c_client->dev);
+		device_link_remove(&client->dev, sensor->ser_dev);
+		device_link_remove(sensor->ser_dev, sensor->dser_dev);
 		max96793_sdev_unpair(sensor->ser_dev, &sensor->i2c_client->dev);
 	}
 
+	hrtimer_cancel(&sensor->trig.timer);
+	vvsensor_cleanup(&sensor->vs);
 	v4l2_async_unregister_subdev(sd);
 	media_entity_cleanup(&sd->entity);
+	pm_runtime_disable(&client->dev);
+	pm_runtime_set_suspended(&client->dev);
+	pm_runtime_put_noidle(&client->dev);
 	imx900_power_off(sensor);
 	mutex_destroy(&sensor->lock);
 }
@@ -3578,9 +4655,11 @@ static int __maybe_unused imx900_suspend(struct device *dev)
 	struct i2c_client *client = to_i2c_client(dev);
 	struct imx900 *sensor = client_to_imx900(client);
 
+	mutex_lock(&sensor->lock);
 	sensor->resume_status = sensor->stream_status;
 	if (sensor->resume_status)
 		imx900_s_stream(&sensor->sd, 0);
+	mutex_unlock(&sensor->lock);
 
 	return 0;
 }
@@ -3589,15 +4668,66 @@ static int __maybe_unused imx900_resume(struct device *dev)
 {
 	struct i2c_client *client = to_i2c_client(dev);
 	struct imx900 *sensor = client_to_imx900(client);
+	int ret = 0;
 
+	/* serdes registers are restored by their own resume (device links) */
+	mutex_lock(&sensor->lock);
+	if (sensor->mode_applied && sensor->powered_on)
+		ret = imx900_restore_mode(sensor);
+
+	if (ret < 0) {
+		mutex_unlock(&sensor->lock);
+		dev_err(dev, "%s: failed to restore sensor mode\n", __func__);
+		return ret;
+	}
+
+	/* resume to first frame is measured by the CSIS driver */
 	if (sensor->resume_status)
 		imx900_s_stream(&sensor->sd, 1);
+	mutex_unlock(&sensor->lock);
 
 	return 0;
 }
 
+/*
+ * Runtime PM holds a directly connected sensor in reset while unused. On a
+ * GMSL link the sensor is powered with the serializer, and a deserializer
+ * power cycle takes seconds, so the link stays up.
+ */
+static int __maybe_unused imx900_runtime_suspend(struct device *dev)
+{
+	struct imx900 *sensor = client_to_imx900(to_i2c_client(dev));
+
+	if (!strcmp(sensor->gmsl, "gmsl"))
+		return 0;
+
+	return imx900_power_off(sensor);
+}
+
+static int __maybe_unused imx900_runtime_resume(struct device *dev)
+{
+	struct imx900 *sensor = client_to_imx900(to_i2c_client(dev));
+	int ret;
+
+	if (!strcmp(sensor->gmsl, "gmsl"))
+		return 0;
+
+	ret = imx900_power_on(sensor);
+	if (ret < 0)
+		return ret;
+
+	/* the reset dropped the mode, replay it with the shadowed AE */
+	mutex_lock(&sensor->lock);
+	if (sensor->mode_applied)
+		ret = imx900_restore_mode(sensor);
+	mutex_unlock(&sensor->lock);
+
+	return ret;
+}
+
 static const struct dev_pm_ops imx900_pm_ops = {
 	SET_SYSTEM_SLEEP_PM_OPS(imx900_suspend, imx900_resume)
+	SET_RUNTIME_PM_OPS(imx900_runtime_suspend, imx900_runtime_resume, NULL)
 };
 
 static const struct i2c_device_id imx900_id[] = {
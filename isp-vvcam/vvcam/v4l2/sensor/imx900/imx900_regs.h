@@ -47,6 +47,13 @@
 #define FID0_ROIWV1_LOW         0x3126
 #define FID0_ROIWV1_HIGH        0x3127
 
+/*
+ * Rectangles taken by the ROI areas control. Only the first window slot,
+ * FID0_ROI and the FID0_ROI*1 registers, is documented, so the rectangles
+ * have to merge into a single readout window.
+ */
+#define IMX900_ROI_AREAS        8
+
 #define ADBIT_MONOSEL           0x3200
 #define HREVERSE_VREVERSE       0x3204
 
@@ -157,6 +164,8 @@
 
 #define IMX900_ROI_MODE_WIDTH       1936
 #define IMX900_ROI_MODE_HEIGHT      1096
+#define IMX900_ROI_MODE_LEFT        72
+#define IMX900_ROI_MODE_TOP         240
 
 #define IMX900_SUBSAMPLING2_MODE_WIDTH   1032
 #define IMX900_SUBSAMPLING2_MODE_HEIGHT  776
@@ -681,10 +690,10 @@ static struct vvcam_sccb_data_s mode_1920x1080[] = {
 
 	{FID0_ROI,  0x03},
 
-	{FID0_ROIPH1_LOW,   IMX900_TO_LOW_BYTE(72)},
-	{FID0_ROIPH1_HIGH,  IMX900_TO_MID_BYTE(72)},
-	{FID0_ROIPV1_LOW,   IMX900_TO_LOW_BYTE(240)},
-	{FID0_ROIPV1_HIGH,  IMX900_TO_MID_BYTE(240)},
+	{FID0_ROIPH1_LOW,   IMX900_TO_LOW_BYTE(IMX900_ROI_MODE_LEFT)},
+	{FID0_ROIPH1_HIGH,  IMX900_TO_MID_BYTE(IMX900_ROI_MODE_LEFT)},
+	{FID0_ROIPV1_LOW,   IMX900_TO_LOW_BYTE(IMX900_ROI_MODE_TOP)},
+	{FID0_ROIPV1_HIGH,  IMX900_TO_MID_BYTE(IMX900_ROI_MODE_TOP)},
 
 	{FID0_ROIWH1_LOW,   IMX900_TO_LOW_BYTE(IMX900_ROI_MODE_WIDTH)},
 	{FID0_ROIWH1_HIGH,  IMX900_TO_MID_BYTE(IMX900_ROI_MODE_WIDTH)},
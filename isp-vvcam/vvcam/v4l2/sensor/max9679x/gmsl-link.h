@@ -36,6 +36,11 @@
 #define GMSL_SERDES_CSI_LINK_A 0x1
 #define GMSL_SERDES_CSI_LINK_B 0x2
 
+/* Forward link rates, as encoded in the serdes TX_RATE/RX_RATE fields */
+#define GMSL_LINK_RATE_3G 0x1
+#define GMSL_LINK_RATE_6G 0x2
+#define GMSL_LINK_RATE_12G 0x3
+
 /* Didn't find kernel defintions, for now adding here */
 #define GMSL_CSI_DT_RAW_12 0x2C
 #define GMSL_CSI_DT_UED_U1 0x30
@@ -43,6 +48,17 @@
 
 #define GMSL_ST_ID_UNUSED 0xFF
 
+/* Link health events reported by the deserializer to its sources */
+#define GMSL_LINK_EVENT_LOCK_LOST 0x1
+#define GMSL_LINK_EVENT_RELINKED 0x2
+#define GMSL_LINK_EVENT_RELINK_FAILED 0x3
+
+/*
+ * Private V4L2 event queued on the sensor subdev for link health events,
+ * u.data[0] holds one of the GMSL_LINK_EVENT_* values.
+ */
+#define GMSL_V4L2_EVENT_LINK (V4L2_EVENT_PRIVATE_START + 0x100)
+
 /**
  * Maximum number of data streams (\ref gmsl_stream elements) in a GMSL link
  * (\ref gmsl_link_ctx).
@@ -85,6 +101,26 @@ struct gmsl_link_ctx {
 	struct gmsl_stream streams[GMSL_DEV_MAX_NUM_DATA_STREAMS];
 	/* An array of information about the data streams in the link. */
 	struct device *s_dev; // Sensor device handle.
+	__u32 st_code;
+	/*
+	 * Media bus code last programmed on the serializer. Set by the
+	 * serializer driver in stream setup; used by the deserializer
+	 * driver to restart its video pipe only when the BPP changes.
+	 */
+	__u32 link_rate; // Programmed forward link rate (GMSL_LINK_RATE_*).
+	__u32 sync_group; // XVS sync group id, 0 when not synchronized.
+	bool sync_master; // Sensor drives XVS for its sync group.
+	/*
+	 * Releases a deferred sync master (XMSTA), called by the
+	 * deserializer once all slaves of the group are streaming,
+	 * without any serdes lock held.
+	 */
+	int (*sync_start)(struct device *s_dev);
+	/*
+	 * Optional link health callback, called by the deserializer
+	 * from its monitor work without any serdes lock held.
+	 */
+	void (*notify)(struct device *s_dev, __u32 event);
 };
 
 /** @} */
@@ -5,16 +5,20 @@
  * max96792.c - max96792 GMSL Deserializer driver
  */
 //#define DEBUG 1
+#include <linux/debugfs.h>
 #include <linux/delay.h>
 #include <linux/device.h>
 #include <linux/gpio.h>
 #include <linux/i2c.h>
+#include <linux/math64.h>
 #include <linux/module.h>
 #include <linux/of.h>
 #include <linux/of_device.h>
 #include <linux/of_gpio.h>
 #include <linux/regmap.h>
+#include <linux/seq_file.h>
 #include <linux/version.h>
+#include <linux/workqueue.h>
 
 #include "max96792.h"
 
@@ -38,6 +42,18 @@
 #define MAX96792_PIPE_X_DST_3_MAP_ADDR 0x414
 
 #define MAX96792_CTRL0_ADDR 0x10
+#define MAX96792_CTRL3_ADDR 0x13
+
+/*
+ * error counters, cleared on read: line code decode errors of the two
+ * links and idle word errors. The FEC/ECC and packet CRC counters are not
+ * covered, their addresses are not in the register set this driver uses.
+ */
+#define MAX96792_CNT0_ADDR 0x22
+#define MAX96792_CNT1_ADDR 0x23
+#define MAX96792_CNT2_ADDR 0x24
+
+#define MAX96792_PIPE_Y_VIDEO_RX8_ADDR 0x11A
 
 /* data defines */
 #define MAX96792_CSI_MODE_4X2 0x1
@@ -57,6 +73,14 @@
 
 #define MAX96792_RESET_ALL 0x80
 
+#define MAX96792_CTRL3_LOCKED (0x01 << 3)
+#define MAX96792_VIDEO_RX8_VID_SEQ_ERR (0x01 << 4)
+#define MAX96792_VIDEO_RX8_VID_LOCK (0x01 << 6)
+
+/* link health monitor */
+#define MAX96792_LINK_POLL_MS 100
+#define MAX96792_RELINK_LOCK_RETRIES 10
+
 /* Dual GMSL MAX96792A/B */
 #define MAX96792_MAX_SOURCES 2
 
@@ -88,9 +112,49 @@
 
 //#define DISABLE_ERR_REPORTING
 
+/* XVS sync groups */
+#define MAX96792_SYNC_MAX_MEMBERS 8
+#define MAX96792_SYNC_TIMEOUT_MS 1000
+
+/* link rate selection, share of the link rate left for video */
+#define MAX96792_LINK_VIDEO_PCT 80
+/* CSI output margin for blanking and packet overhead */
+#define MAX96792_CSI_MARGIN_PCT 125
+#define MAX96792_CSI_RATE_DEF 12 // 1200 Mbps
+
+static unsigned int link_poll_ms = MAX96792_LINK_POLL_MS;
+module_param(link_poll_ms, uint, 0644);
+MODULE_PARM_DESC(link_poll_ms, "GMSL link health poll period in ms, 0 disables");
+
+static unsigned int sync_timeout_ms = MAX96792_SYNC_TIMEOUT_MS;
+module_param(sync_timeout_ms, uint, 0644);
+MODULE_PARM_DESC(sync_timeout_ms, "Max time a sync master waits for its slaves in ms");
+
+static bool auto_link_rate = true;
+module_param(auto_link_rate, bool, 0644);
+MODULE_PARM_DESC(auto_link_rate, "Select link and CSI rates from the mode bandwidth");
+
+struct max96792_link_rate {
+	u32 rate;
+	u32 mbps;
+};
+
+static const struct max96792_link_rate max96792_link_rates[] = {
+	{ GMSL_LINK_RATE_3G, 3000 },
+	{ GMSL_LINK_RATE_6G, 6000 },
+	{ GMSL_LINK_RATE_12G, 12000 },
+};
+
+/* CSI data rates per lane in 100 Mbps units, lowest first */
+static const u8 max96792_csi_rates[] = { 10, 12, 15 };
+
+static struct dentry *max96792_debugfs_root;
+
 struct max96792_source_ctx {
 	struct gmsl_link_ctx *g_ctx;
 	bool st_enabled;
+	bool st_setup;
+	u32 st_code;
 };
 
 struct pipe_ctx {
@@ -101,6 +165,19 @@ struct pipe_ctx {
 	u32 st_id_sel;
 };
 
+struct max96792_link_stats {
+	u32 lock_lost;
+	u32 relink;
+	u32 relink_failed;
+	u32 dec_err_a;
+	u32 dec_err_b;
+	u32 idle_err;
+	u32 vid_seq_err;
+	u32 vid_unlock;
+	bool locked;
+	bool vid_locked;
+};
+
 struct max96792 {
 	struct i2c_client *i2c_client;
 	struct regmap *regmap;
@@ -116,11 +193,16 @@ struct max96792 {
 	bool link_setup;
 	struct pipe_ctx pipe[MAX96792_MAX_PIPES];
 	u8 csi_mode;
+	u8 csi_rate;
 	u8 lane_mp1;
 	u8 lane_mp2;
 	int reset_gpio;
 	int pw_ref;
 	struct regulator *vdd_cam_1v2;
+	struct delayed_work link_work;
+	bool link_monitor;
+	struct max96792_link_stats stats;
+	struct dentry *debugfs_dir;
 };
 
 static int max96792_write_reg(struct device *dev,
@@ -147,6 +229,29 @@ static int max96792_write_reg(struct device *dev,
 	return err;
 }
 
+static int max96792_read_reg(struct device *dev,
+	u16 addr, u8 *val)
+{
+	struct max96792 *priv;
+	unsigned int reg_val;
+	int err;
+
+	priv = dev_get_drvdata(dev);
+
+	err = regmap_read(priv->regmap, addr, &reg_val);
+	if (err)
+		dev_err(dev,
+		"%s:i2c read failed, 0x%x\n",
+		__func__, addr);
+	else
+		*val = reg_val & 0xFF;
+
+	/* delay before next i2c command as required for SERDES link */
+	usleep_range(100, 110);
+
+	return err;
+}
+
 static int max96792_get_sdev_idx(struct device *dev,
 			struct device *s_dev, int *idx)
 {
@@ -207,9 +312,13 @@ static void max96792_reset_ctx(struct max96792 *priv)
 	priv->num_src_found = 0;
 	priv->src_link = 0;
 	priv->splitter_enabled = false;
+	priv->link_monitor = false;
 	max96792_pipes_reset(priv);
-	for (i = 0; i < priv->num_src; i++)
+	for (i = 0; i < priv->num_src; i++) {
 		priv->sources[i].st_enabled = false;
+		priv->sources[i].st_setup = false;
+		priv->sources[i].st_code = 0;
+	}
 }
 
 int max96792_power_on(struct device *dev, struct gmsl_link_ctx *g_ctx)
@@ -387,24 +496,98 @@ EXPORT_SYMBOL(max96792_gmsl3_setup);
 #define PIPE_Y
 //#define PIPE_Z
 
-int max96792_set_deser_clock(struct device *dev, int data_rate)
+/* rate in 100 Mbps units, written with the DPLL predefined frequency enable */
+static int max96792_write_csi_rate(struct device *dev, u8 rate)
 {
+	struct max96792 *priv = dev_get_drvdata(dev);
 	int err = 0;
 
+	err = max96792_write_reg(dev, 0x1D00, 0xF4);
+	err |= max96792_write_reg(dev, 0x320, 0x20 | (rate & 0x1F));
+	err |= max96792_write_reg(dev, 0x1D00, 0xF5);
+	if (!err)
+		priv->csi_rate = rate;
+
+	return err;
+}
+
+int max96792_set_deser_clock(struct device *dev, int data_rate)
+{
 	dev_dbg(dev, "enter %s function\n", __func__);
 
-	err = max96792_write_reg(dev, 0x1D00, 0xF4);
 	if (data_rate > 2)
-		err |= max96792_write_reg(dev, 0x320, 0x2A);
-	else
-		err |= max96792_write_reg(dev, 0x320, 0x2C);
+		return max96792_write_csi_rate(dev, 10);
 
-	err |= max96792_write_reg(dev, 0x1D00, 0xF5);
-	
-	return err;
+	return max96792_write_csi_rate(dev, 12);
 }
 EXPORT_SYMBOL(max96792_set_deser_clock);
 
+u32 max96792_get_link_rate(u64 bandwidth)
+{
+	u32 mbps = div_u64(bandwidth, 1000000);
+	int i;
+
+	if (!auto_link_rate)
+		return GMSL_LINK_RATE_12G;
+
+	for (i = 0; i < ARRAY_SIZE(max96792_link_rates); i++) {
+		if (mbps * 100 <=
+			max96792_link_rates[i].mbps * MAX96792_LINK_VIDEO_PCT)
+			return max96792_link_rates[i].rate;
+	}
+
+	pr_warn("%s: %u Mbps exceeds the link capacity\n", __func__, mbps);
+
+	return GMSL_LINK_RATE_12G;
+}
+EXPORT_SYMBOL(max96792_get_link_rate);
+
+int max96792_set_csi_bandwidth(struct device *dev, struct device *s_dev,
+	u64 bandwidth)
+{
+	struct max96792 *priv = dev_get_drvdata(dev);
+	u32 mbps = div_u64(bandwidth, 1000000);
+	u32 lanes;
+	u8 rate = MAX96792_CSI_RATE_DEF;
+	int err = 0;
+	int i;
+
+	err = max96792_get_sdev_idx(dev, s_dev, &i);
+	if (err)
+		return err;
+
+	mutex_lock(&priv->lock);
+
+	lanes = priv->sources[i].g_ctx->num_csi_lanes;
+	if (auto_link_rate && lanes) {
+		mbps = DIV_ROUND_UP(mbps * MAX96792_CSI_MARGIN_PCT, 100 * lanes);
+		for (i = 0; i < ARRAY_SIZE(max96792_csi_rates); i++) {
+			rate = max96792_csi_rates[i];
+			if (mbps <= rate * 100)
+				break;
+		}
+		if (i == ARRAY_SIZE(max96792_csi_rates))
+			dev_warn(dev, "%s: %u Mbps per lane exceeds the csi rate\n",
+				__func__, mbps);
+	}
+
+	dev_dbg(dev, "%s: csi rate %u Mbps\n", __func__, rate * 100);
+	err = max96792_write_csi_rate(dev, rate);
+
+	mutex_unlock(&priv->lock);
+
+	return err;
+}
+EXPORT_SYMBOL(max96792_set_csi_bandwidth);
+
+u32 max96792_get_csi_rate(struct device *dev)
+{
+	struct max96792 *priv = dev_get_drvdata(dev);
+
+	return READ_ONCE(priv->csi_rate) * 100;
+}
+EXPORT_SYMBOL(max96792_get_csi_rate);
+
 int max96792_setup_control(struct device *dev, struct device *s_dev)
 {
 	struct max96792 *priv = dev_get_drvdata(dev);
@@ -473,10 +656,7 @@ int max96792_setup_control(struct device *dev, struct device *s_dev)
 #endif
 
 	max96792_write_reg(dev, 0x31D, 0x38); //0x38 works
-	// csi frequency definition reset to 1500
-	max96792_write_reg(dev, 0x1D00, 0xF4);
-	max96792_write_reg(dev, 0x320, 0x2C);
-	max96792_write_reg(dev, 0x1D00, 0xF5);
+	max96792_write_csi_rate(dev, MAX96792_CSI_RATE_DEF);
 
 #ifdef ROBUST
 	/* robust operation */
@@ -560,6 +740,209 @@ int max96792_xvs_setup(struct device *dev, bool direction)
 }
 EXPORT_SYMBOL(max96792_xvs_setup);
 
+/*
+ * Sync groups span several deserializers, one per sensor, so membership
+ * is kept module wide. The master sensor XVS is forwarded from its
+ * deserializer MFP0 to the MFP0 of every slave deserializer.
+ */
+struct max96792_sync_member {
+	struct gmsl_link_ctx *g_ctx;
+	bool armed;
+	bool pending;
+};
+
+static struct max96792_sync_member sync_members[MAX96792_SYNC_MAX_MEMBERS];
+static DEFINE_MUTEX(sync_lock);
+
+static void max96792_sync_timeout(struct work_struct *work);
+static DECLARE_DELAYED_WORK(sync_work, max96792_sync_timeout);
+
+/* Called with sync_lock held */
+static struct max96792_sync_member *max96792_sync_find(struct device *s_dev)
+{
+	int i;
+
+	for (i = 0; i < MAX96792_SYNC_MAX_MEMBERS; i++) {
+		if (sync_members[i].g_ctx &&
+			sync_members[i].g_ctx->s_dev == s_dev)
+			return &sync_members[i];
+	}
+
+	return NULL;
+}
+
+/* Called with sync_lock held */
+static bool max96792_sync_slaves_armed(u32 group)
+{
+	struct gmsl_link_ctx *g_ctx;
+	int i;
+
+	for (i = 0; i < MAX96792_SYNC_MAX_MEMBERS; i++) {
+		g_ctx = sync_members[i].g_ctx;
+		if (g_ctx && g_ctx->sync_group == group &&
+			!g_ctx->sync_master && !sync_members[i].armed)
+			return false;
+	}
+
+	return true;
+}
+
+static void max96792_sync_timeout(struct work_struct *work)
+{
+	struct gmsl_link_ctx *start_ctx[MAX96792_SYNC_MAX_MEMBERS];
+	int num_start = 0;
+	int i;
+
+	mutex_lock(&sync_lock);
+	for (i = 0; i < MAX96792_SYNC_MAX_MEMBERS; i++) {
+		if (!sync_members[i].pending)
+			continue;
+
+		sync_members[i].pending = false;
+		start_ctx[num_start++] = sync_members[i].g_ctx;
+	}
+	mutex_unlock(&sync_lock);
+
+	for (i = 0; i < num_start; i++) {
+		dev_warn(start_ctx[i]->s_dev,
+			"%s: sync slaves not streaming, starting master\n",
+			__func__);
+		start_ctx[i]->sync_start(start_ctx[i]->s_dev);
+	}
+}
+
+int max96792_sync_join(struct device *dev, struct gmsl_link_ctx *g_ctx)
+{
+	struct max96792_sync_member *member;
+	int err = 0;
+	int i;
+
+	if (!dev || !g_ctx || !g_ctx->s_dev || !g_ctx->sync_group ||
+		!g_ctx->sync_start) {
+		dev_err(dev, "%s: invalid input params\n", __func__);
+		return -EINVAL;
+	}
+
+	mutex_lock(&sync_lock);
+
+	for (i = 0; i < MAX96792_SYNC_MAX_MEMBERS; i++) {
+		struct gmsl_link_ctx *m_ctx = sync_members[i].g_ctx;
+
+		if (g_ctx->sync_master && m_ctx && m_ctx != g_ctx &&
+			m_ctx->sync_group == g_ctx->sync_group &&
+			m_ctx->sync_master) {
+			dev_err(dev, "%s: sync group %u already has a master\n",
+				__func__, g_ctx->sync_group);
+			err = -EBUSY;
+			goto error;
+		}
+	}
+
+	member = max96792_sync_find(g_ctx->s_dev);
+	for (i = 0; !member && i < MAX96792_SYNC_MAX_MEMBERS; i++) {
+		if (!sync_members[i].g_ctx)
+			member = &sync_members[i];
+	}
+
+	if (!member) {
+		dev_err(dev, "%s: sync groups are full\n", __func__);
+		err = -ENOMEM;
+		goto error;
+	}
+	member->g_ctx = g_ctx;
+	member->armed = false;
+	member->pending = false;
+
+	/* master deser drives MFP0, slave deser forwards it over the link */
+	err = max96792_xvs_setup(dev,
+		g_ctx->sync_master ? max96792_OUT : max96792_IN);
+	if (err)
+		member->g_ctx = NULL;
+	else
+		dev_info(dev, "%s: sync group %u %s\n", __func__,
+			g_ctx->sync_group, g_ctx->sync_master ? "master" : "slave");
+
+error:
+	mutex_unlock(&sync_lock);
+	return err;
+}
+EXPORT_SYMBOL(max96792_sync_join);
+
+void max96792_sync_leave(struct device *dev, struct device *s_dev)
+{
+	struct max96792_sync_member *member;
+
+	mutex_lock(&sync_lock);
+	member = max96792_sync_find(s_dev);
+	if (member) {
+		member->g_ctx = NULL;
+		member->armed = false;
+		member->pending = false;
+	}
+	mutex_unlock(&sync_lock);
+}
+EXPORT_SYMBOL(max96792_sync_leave);
+
+bool max96792_sync_stream(struct device *dev, struct device *s_dev,
+	bool enable)
+{
+	struct max96792_sync_member *member;
+	struct gmsl_link_ctx *start_ctx = NULL;
+	bool start = true;
+	u32 group = 0;
+	int i;
+
+	mutex_lock(&sync_lock);
+
+	member = max96792_sync_find(s_dev);
+	if (!member)
+		goto unlock;
+
+	member->armed = enable;
+	member->pending = false;
+	if (!enable)
+		goto unlock;
+
+	group = member->g_ctx->sync_group;
+
+	if (member->g_ctx->sync_master) {
+		if (!max96792_sync_slaves_armed(group)) {
+			dev_dbg(dev, "%s: deferring sync group %u master\n",
+				__func__, group);
+			member->pending = true;
+			start = false;
+			mod_delayed_work(system_wq, &sync_work,
+				msecs_to_jiffies(sync_timeout_ms));
+		}
+		goto unlock;
+	}
+
+	/* last slave in, release the waiting master */
+	if (!max96792_sync_slaves_armed(group))
+		goto unlock;
+
+	for (i = 0; i < MAX96792_SYNC_MAX_MEMBERS; i++) {
+		if (sync_members[i].pending &&
+			sync_members[i].g_ctx->sync_group == group) {
+			sync_members[i].pending = false;
+			start_ctx = sync_members[i].g_ctx;
+			break;
+		}
+	}
+
+unlock:
+	mutex_unlock(&sync_lock);
+
+	if (start_ctx) {
+		dev_dbg(dev, "%s: starting sync group %u master\n",
+			__func__, group);
+		start_ctx->sync_start(start_ctx->s_dev);
+	}
+
+	return start;
+}
+EXPORT_SYMBOL(max96792_sync_stream);
+
 int max96792_reset_control(struct device *dev, struct device *s_dev)
 {
 	struct max96792 *priv = dev_get_drvdata(dev);
@@ -651,6 +1034,8 @@ int max96792_sdev_register(struct device *dev, struct gmsl_link_ctx *g_ctx)
 
 	priv->sources[priv->num_src].g_ctx = g_ctx;
 	priv->sources[priv->num_src].st_enabled = false;
+	priv->sources[priv->num_src].st_setup = false;
+	priv->sources[priv->num_src].st_code = 0;
 
 	priv->num_src++;
 
@@ -710,6 +1095,205 @@ struct reg_pair {
 	u8 val;
 };
 
+static void max96792_pipe_restart(struct device *dev)
+{
+#ifdef PIPE_Y
+	max96792_write_reg(dev, 0x112, 0x30); //toggle packet detector for different BPP
+	msleep(100);
+	max96792_write_reg(dev, 0x112, 0x31); //pipeY disable sequence and packet detect
+#endif
+#ifdef PIPE_Z
+	max96792_write_reg(dev, 0x124, 0x20);
+	msleep(100);
+	max96792_write_reg(dev, 0x124, 0x21);
+#endif
+}
+
+static int max96792_read_link_status(struct device *dev)
+{
+	struct max96792 *priv = dev_get_drvdata(dev);
+	struct max96792_link_stats *stats = &priv->stats;
+	u8 ctrl3 = 0;
+	u8 cnt[3] = {0};
+	u8 vid_rx8 = 0;
+	bool vid_locked;
+	int err = 0;
+
+	err = max96792_read_reg(dev, MAX96792_CTRL3_ADDR, &ctrl3);
+	err |= max96792_read_reg(dev, MAX96792_CNT0_ADDR, &cnt[0]);
+	err |= max96792_read_reg(dev, MAX96792_CNT1_ADDR, &cnt[1]);
+	err |= max96792_read_reg(dev, MAX96792_CNT2_ADDR, &cnt[2]);
+#ifdef PIPE_Y
+	err |= max96792_read_reg(dev, MAX96792_PIPE_Y_VIDEO_RX8_ADDR, &vid_rx8);
+#endif
+	if (err)
+		return err;
+
+	stats->locked = !!(ctrl3 & MAX96792_CTRL3_LOCKED);
+	stats->dec_err_a += cnt[0];
+	stats->dec_err_b += cnt[1];
+	stats->idle_err += cnt[2];
+
+	if (vid_rx8 & MAX96792_VIDEO_RX8_VID_SEQ_ERR)
+		stats->vid_seq_err++;
+
+	vid_locked = !!(vid_rx8 & MAX96792_VIDEO_RX8_VID_LOCK);
+	if (stats->vid_locked && !vid_locked)
+		stats->vid_unlock++;
+	stats->vid_locked = vid_locked;
+
+	return 0;
+}
+
+/*
+ * Minimal recovery after lock loss: one-shot reset of the active GMSL link
+ * and a video pipe restart. Serializer and deserializer register setup is
+ * kept, so the full serdes setup is not needed unless the serializer lost
+ * power, which is reported as GMSL_LINK_EVENT_RELINK_FAILED.
+ */
+static int max96792_relink(struct device *dev, u32 link)
+{
+	struct max96792 *priv = dev_get_drvdata(dev);
+	u8 ctrl3 = 0;
+	int retry;
+	int err = 0;
+
+	err = max96792_write_link(dev, link);
+	if (err)
+		return err;
+
+	for (retry = 0; retry < MAX96792_RELINK_LOCK_RETRIES; retry++) {
+		err = max96792_read_reg(dev, MAX96792_CTRL3_ADDR, &ctrl3);
+		if (!err && (ctrl3 & MAX96792_CTRL3_LOCKED))
+			break;
+		msleep(10);
+	}
+
+	if (retry == MAX96792_RELINK_LOCK_RETRIES)
+		return -ETIMEDOUT;
+
+	priv->stats.locked = true;
+	max96792_pipe_restart(dev);
+
+	return 0;
+}
+
+int max96792_set_link_rate(struct device *dev, struct device *s_dev,
+	u32 rate)
+{
+	struct max96792 *priv = dev_get_drvdata(dev);
+	struct gmsl_link_ctx *g_ctx;
+	int err = 0;
+	int i;
+
+	if (rate < GMSL_LINK_RATE_3G || rate > GMSL_LINK_RATE_12G)
+		return -EINVAL;
+
+	err = max96792_get_sdev_idx(dev, s_dev, &i);
+	if (err)
+		return err;
+
+	mutex_lock(&priv->lock);
+
+	g_ctx = priv->sources[i].g_ctx;
+
+	err = max96792_write_reg(dev, 0x01, rate & 0x03); // RX_RATE
+	if (err)
+		goto ret;
+
+	err = max96792_relink(dev, g_ctx->serdes_csi_link);
+	if (err) {
+		dev_err(dev, "%s: no lock at link rate %u\n", __func__, rate);
+		goto ret;
+	}
+
+	g_ctx->link_rate = rate;
+	dev_info(dev, "%s: link rate %u Mbps\n", __func__,
+		max96792_link_rates[rate - 1].mbps);
+
+ret:
+	mutex_unlock(&priv->lock);
+
+	return err;
+}
+EXPORT_SYMBOL(max96792_set_link_rate);
+
+static void max96792_link_monitor(struct work_struct *work)
+{
+	struct max96792 *priv = container_of(to_delayed_work(work),
+					struct max96792, link_work);
+	struct device *dev = &priv->i2c_client->dev;
+	struct gmsl_link_ctx *notify_ctx[MAX96792_MAX_SOURCES];
+	struct gmsl_link_ctx *g_ctx;
+	int num_notify = 0;
+	u32 event = 0;
+	u32 link = 0;
+	int i;
+
+	mutex_lock(&priv->lock);
+
+	if (!priv->link_monitor)
+		goto ret;
+
+	if (max96792_read_link_status(dev))
+		goto resched;
+
+	if (priv->stats.locked)
+		goto resched;
+
+	priv->stats.lock_lost++;
+	dev_warn_ratelimited(dev, "%s: gmsl link lock lost, relinking\n",
+		__func__);
+
+	for (i = 0; i < priv->max_src; i++) {
+		g_ctx = priv->sources[i].g_ctx;
+		if (!g_ctx || !priv->sources[i].st_enabled)
+			continue;
+
+		if (!link)
+			link = g_ctx->serdes_csi_link;
+		if (g_ctx->notify)
+			notify_ctx[num_notify++] = g_ctx;
+	}
+
+	/* sensors learn about the loss before the relink, not after it */
+	mutex_unlock(&priv->lock);
+
+	for (i = 0; i < num_notify; i++)
+		notify_ctx[i]->notify(notify_ctx[i]->s_dev,
+			GMSL_LINK_EVENT_LOCK_LOST);
+
+	mutex_lock(&priv->lock);
+
+	/* streaming stopped while the sensors were notified */
+	if (!priv->link_monitor) {
+		num_notify = 0;
+		goto ret;
+	}
+
+	if (max96792_relink(dev, link)) {
+		priv->stats.relink_failed++;
+		event = GMSL_LINK_EVENT_RELINK_FAILED;
+		dev_err_ratelimited(dev, "%s: gmsl relink failed\n", __func__);
+	} else {
+		priv->stats.relink++;
+		event = GMSL_LINK_EVENT_RELINKED;
+		dev_info(dev, "%s: gmsl link recovered\n", __func__);
+	}
+
+resched:
+	if (link_poll_ms)
+		schedule_delayed_work(&priv->link_work,
+			msecs_to_jiffies(link_poll_ms));
+	else
+		priv->link_monitor = false;
+ret:
+	mutex_unlock(&priv->lock);
+
+	for (i = 0; i < num_notify; i++)
+		notify_ctx[i]->notify(notify_ctx[i]->s_dev, event);
+}
+
 int max96792_start_streaming(struct device *dev, struct device *s_dev)
 {
 	struct max96792 *priv = dev_get_drvdata(dev);
@@ -722,16 +1306,20 @@ int max96792_start_streaming(struct device *dev, struct device *s_dev)
 
 	mutex_lock(&priv->lock);
 
-#ifdef PIPE_Y
-	max96792_write_reg(dev, 0x112, 0x30); //toggle packet detector for different BPP
-	msleep(100);
-	max96792_write_reg(dev, 0x112, 0x31); //pipeY disable sequence and packet detect
-#endif
-#ifdef PIPE_Z
-	max96792_write_reg(dev, 0x124, 0x20);
-	msleep(100);
-	max96792_write_reg(dev, 0x124, 0x21);
-#endif
+	/* the packet detector only needs a toggle when the BPP changes */
+	if (priv->sources[i].st_code != priv->sources[i].g_ctx->st_code) {
+		max96792_pipe_restart(dev);
+		priv->sources[i].st_code = priv->sources[i].g_ctx->st_code;
+	}
+
+	priv->sources[i].st_enabled = true;
+	if (!priv->link_monitor && link_poll_ms) {
+		priv->stats.locked = true;
+		priv->stats.vid_locked = false;
+		priv->link_monitor = true;
+		schedule_delayed_work(&priv->link_work,
+			msecs_to_jiffies(link_poll_ms));
+	}
 
 	mutex_unlock(&priv->lock);
 
@@ -742,7 +1330,7 @@ EXPORT_SYMBOL(max96792_start_streaming);
 int max96792_stop_streaming(struct device *dev, struct device *s_dev)
 {
 	struct max96792 *priv = dev_get_drvdata(dev);
-	struct gmsl_link_ctx *g_ctx;
+	bool monitor_stop = true;
 	int err = 0;
 	int i = 0;
 
@@ -751,10 +1339,22 @@ int max96792_stop_streaming(struct device *dev, struct device *s_dev)
 		return err;
 
 	mutex_lock(&priv->lock);
-	g_ctx = priv->sources[i].g_ctx;
+
+	priv->sources[i].st_enabled = false;
+	for (i = 0; i < priv->max_src; i++) {
+		if (priv->sources[i].st_enabled)
+			monitor_stop = false;
+	}
+
+	if (monitor_stop)
+		priv->link_monitor = false;
 
 	mutex_unlock(&priv->lock);
 
+	/* monitor work takes the lock, so it is cancelled unlocked */
+	if (monitor_stop)
+		cancel_delayed_work_sync(&priv->link_work);
+
 	return 0;
 }
 EXPORT_SYMBOL(max96792_stop_streaming);
@@ -773,6 +1373,10 @@ int max96792_setup_streaming(struct device *dev, struct device *s_dev)
 
 	mutex_lock(&priv->lock);
 
+	/* lane setup only depends on g_ctx, which is fixed after register */
+	if (priv->sources[i].st_setup)
+		goto ret;
+
 	g_ctx = priv->sources[i].g_ctx;
 
 	/* Derive CSI lane map register */
@@ -821,6 +1425,8 @@ int max96792_setup_streaming(struct device *dev, struct device *s_dev)
 	else
 		max96792_write_reg(dev, 0x474, 0x09);
 
+	priv->sources[i].st_setup = true;
+
 ret:
 	mutex_unlock(&priv->lock);
 	return err;
@@ -870,6 +1476,8 @@ static int max96792_parse_dt(struct max96792 *priv,
 		return -EINVAL;
 	}
 
+	priv->csi_rate = MAX96792_CSI_RATE_DEF;
+
 	err = of_property_read_u32(node, "max-src", &value);
 	if (err < 0) {
 		dev_err(&client->dev, "No max-src info\n");
@@ -901,10 +1509,54 @@ static int max96792_parse_dt(struct max96792 *priv,
 	return 0;
 }
 
+static int max96792_link_status_show(struct seq_file *s, void *data)
+{
+	struct max96792 *priv = s->private;
+	struct max96792_link_stats *stats = &priv->stats;
+
+	mutex_lock(&priv->lock);
+	seq_printf(s, "monitor:       %s\n", priv->link_monitor ? "on" : "off");
+	seq_printf(s, "link_locked:   %u\n", stats->locked);
+	seq_printf(s, "video_locked:  %u\n", stats->vid_locked);
+	seq_printf(s, "lock_lost:     %u\n", stats->lock_lost);
+	seq_printf(s, "relink:        %u\n", stats->relink);
+	seq_printf(s, "relink_failed: %u\n", stats->relink_failed);
+	seq_printf(s, "dec_err_a:     %u\n", stats->dec_err_a);
+	seq_printf(s, "dec_err_b:     %u\n", stats->dec_err_b);
+	seq_printf(s, "idle_err:      %u\n", stats->idle_err);
+	seq_printf(s, "vid_seq_err:   %u\n", stats->vid_seq_err);
+	seq_printf(s, "vid_unlock:    %u\n", stats->vid_unlock);
+	mutex_unlock(&priv->lock);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(max96792_link_status);
+
+static bool max96792_volatile_reg(struct device *dev, unsigned int reg)
+{
+	/*
+	 * status and clear-on-read counters must not be served from cache,
+	 * CTRL0 holds self-clearing one-shot/reset bits that must not be
+	 * replayed on resume
+	 */
+	switch (reg) {
+	case MAX96792_CTRL0_ADDR:
+	case MAX96792_CTRL3_ADDR:
+	case MAX96792_CNT0_ADDR:
+	case MAX96792_CNT1_ADDR:
+	case MAX96792_CNT2_ADDR:
+	case MAX96792_PIPE_Y_VIDEO_RX8_ADDR:
+		return true;
+	default:
+		return false;
+	}
+}
+
 static struct regmap_config max96792_regmap_config = {
 	.reg_bits = 16,
 	.val_bits = 8,
 	.cache_type = REGCACHE_RBTREE,
+	.volatile_reg = max96792_volatile_reg,
 };
 
 
@@ -942,9 +1594,15 @@ static int max96792_probe(struct i2c_client *client)
 	}
 
 	mutex_init(&priv->lock);
+	INIT_DELAYED_WORK(&priv->link_work, max96792_link_monitor);
 
 	dev_set_drvdata(&client->dev, priv);
 
+	priv->debugfs_dir = debugfs_create_dir(dev_name(&client->dev),
+					max96792_debugfs_root);
+	debugfs_create_file("link_status", 0444, priv->debugfs_dir, priv,
+			&max96792_link_status_fops);
+
 	/* dev communication gets validated when GMSL link setup is done */
 	dev_info(&client->dev, "%s: success\n", __func__);
 
@@ -960,12 +1618,83 @@ static void max96792_remove(struct i2c_client *client)
 
 	if (client != NULL) {
 		priv = dev_get_drvdata(&client->dev);
-		devm_kfree(&client->dev, priv);
+		cancel_delayed_work_sync(&priv->link_work);
+		debugfs_remove_recursive(priv->debugfs_dir);
 		mutex_destroy(&priv->lock);
+		devm_kfree(&client->dev, priv);
 		client = NULL;
 	}
 }
 
+static int __maybe_unused max96792_suspend(struct device *dev)
+{
+	struct max96792 *priv = dev_get_drvdata(dev);
+
+	cancel_delayed_work_sync(&priv->link_work);
+
+	mutex_lock(&priv->lock);
+	regcache_cache_only(priv->regmap, true);
+	regcache_mark_dirty(priv->regmap);
+	mutex_unlock(&priv->lock);
+
+	return 0;
+}
+
+static int __maybe_unused max96792_resume(struct device *dev)
+{
+	struct max96792 *priv = dev_get_drvdata(dev);
+	int err = 0;
+	int i;
+
+	mutex_lock(&priv->lock);
+
+	regcache_cache_only(priv->regmap, false);
+
+	/* nothing was programmed yet, setup_control will do it */
+	if (!priv->sdev_ref)
+		goto unlock;
+
+	/*
+	 * keep the CSI PHYs in standby while the cached configuration is
+	 * written back, the cached 0x1D00 value releases them at the end
+	 */
+	regcache_cache_bypass(priv->regmap, true);
+	err = max96792_write_reg(dev, 0x1D00, 0xF4);
+	regcache_cache_bypass(priv->regmap, false);
+	if (err) {
+		dev_err(dev, "%s: unable to put the CSI PHYs in standby\n",
+			__func__);
+		goto unlock;
+	}
+
+	err = regcache_sync(priv->regmap);
+	if (err) {
+		dev_err(dev, "%s: register restore failed\n", __func__);
+		goto unlock;
+	}
+
+	/* CTRL0 is not cached, reselect the link and relock it */
+	if (priv->link_setup && priv->num_src_found)
+		err = max96792_write_link(dev, priv->src_link);
+
+	/* rearm the packet detector on the next stream start */
+	for (i = 0; i < priv->num_src; i++)
+		priv->sources[i].st_code = 0;
+
+	if (priv->link_monitor && link_poll_ms)
+		schedule_delayed_work(&priv->link_work,
+			msecs_to_jiffies(link_poll_ms));
+
+unlock:
+	mutex_unlock(&priv->lock);
+
+	return err;
+}
+
+static const struct dev_pm_ops max96792_pm_ops = {
+	SET_SYSTEM_SLEEP_PM_OPS(max96792_suspend, max96792_resume)
+};
+
 static const struct i2c_device_id max96792_id[] = {
 	{ "max96792", 0 },
 	{ },
@@ -978,6 +1707,7 @@ static struct i2c_driver max96792_i2c_driver = {
 		.name = "max96792",
 		.owner = THIS_MODULE,
 		.of_match_table = of_match_ptr(max96792_of_match),
+		.pm = &max96792_pm_ops,
 	},
 	.probe = max96792_probe,
 	.remove = max96792_remove,
@@ -986,12 +1716,16 @@ static struct i2c_driver max96792_i2c_driver = {
 
 static int __init max96792_init(void)
 {
+	max96792_debugfs_root = debugfs_create_dir("max96792", NULL);
+
 	return i2c_add_driver(&max96792_i2c_driver);
 }
 
 static void __exit max96792_exit(void)
 {
+	cancel_delayed_work_sync(&sync_work);
 	i2c_del_driver(&max96792_i2c_driver);
+	debugfs_remove_recursive(max96792_debugfs_root);
 }
 
 module_init(max96792_init);
@@ -93,6 +93,7 @@ int max96792_sdev_unregister(struct device *dev, struct device *s_dev);
 /**
  * Performs internal pipeline configuration for a link in context to set up
  * streaming, and puts the deserializer link in ready-to-stream state.
+ * The configuration is written once per registered source.
  *
  * @param [in]  dev	The deserializer device handle.
  * @param [in]  s_dev	The sensor device handle.
@@ -105,6 +106,10 @@ int max96792_setup_streaming(struct device *dev, struct device *s_dev);
  * @brief Enables streaming.
  *
  * This function is to be called by the sensor client driver.
+ * Restarts the video pipe packet detector if the serializer BPP changed
+ * since the last start, and starts the link health monitor, which relinks
+ * on lock loss and reports GMSL_LINK_EVENT_* through the source's
+ * @c gmsl_link_ctx notify callback.
  *
  * @param [in]  dev	The deserializer device handle.
  * @param [in]  s_dev	The sensor device handle.
@@ -155,6 +160,48 @@ int max96792_gmsl3_setup(struct device *dev);
 
 int max96792_xvs_setup(struct device *dev, bool direction);
 
+/**
+ * @brief  Adds a sensor source to its XVS sync group.
+ *
+ * The group id, role and master start callback are taken from @p g_ctx.
+ * A group has at most one master, the sensor driving XVS; the master
+ * deserializer outputs XVS on MFP0, slave deserializers forward their
+ * MFP0 input to the serializer. The serializer side is set up by the
+ * sensor driver.
+ *
+ * @param [in]  dev	The deserializer device handle.
+ * @param [in]  g_ctx	The sensor's GMSL link context.
+ *
+ * @return  0 for success, or a negative error code otherwise.
+ */
+int max96792_sync_join(struct device *dev, struct gmsl_link_ctx *g_ctx);
+
+/**
+ * @brief  Removes a sensor source from its XVS sync group.
+ *
+ * @param [in]  dev	The deserializer device handle.
+ * @param [in]  s_dev	The sensor device handle.
+ */
+void max96792_sync_leave(struct device *dev, struct device *s_dev);
+
+/**
+ * @brief  Synchronizes the stream start of a sync group.
+ *
+ * To be called by the sensor on stream on/off. A master only starts once
+ * all slaves of its group are streaming: if they are not, the call
+ * returns false and the group calls the master's @c sync_start callback
+ * when the last slave starts, or after the sync_timeout_ms module param.
+ * Slaves should release XMSTA before calling this.
+ *
+ * @param [in]  dev	The deserializer device handle.
+ * @param [in]  s_dev	The sensor device handle.
+ * @param [in]  enable	Stream on or off.
+ *
+ * @return  true if the sensor may start now, false if deferred.
+ */
+bool max96792_sync_stream(struct device *dev, struct device *s_dev,
+	bool enable);
+
 /**
  * @brief  Sets deserializer clock for different datarates.
  *
@@ -167,6 +214,52 @@ int max96792_xvs_setup(struct device *dev, bool direction);
 
 int max96792_set_deser_clock(struct device *dev, int data_rate);
 
+/**
+ * @brief  Returns the lowest forward link rate that carries a stream.
+ *
+ * @param [in]  bandwidth	Stream bandwidth during active lines, in bit/s.
+ *
+ * @return  One of the GMSL_LINK_RATE_* values.
+ */
+u32 max96792_get_link_rate(u64 bandwidth);
+
+/**
+ * @brief  Changes the deserializer forward link rate and relocks the link
+ * of a sensor. The serializer must be set to the same rate first with
+ * max96793_set_link_rate().
+ *
+ * @param [in]  dev	The deserializer device handle.
+ * @param [in]  s_dev	The sensor device handle.
+ * @param [in]  rate	One of the GMSL_LINK_RATE_* values.
+ *
+ * @return  0 for success, or -1 otherwise.
+ */
+int max96792_set_link_rate(struct device *dev, struct device *s_dev,
+	u32 rate);
+
+/**
+ * @brief  Sets the lowest deserializer CSI data rate that carries a stream
+ * on the CSI lanes of a sensor.
+ *
+ * @param [in]  dev		The deserializer device handle.
+ * @param [in]  s_dev		The sensor device handle.
+ * @param [in]  bandwidth	Stream bandwidth during active lines, in bit/s.
+ *
+ * @return  0 for success, or -1 otherwise.
+ */
+int max96792_set_csi_bandwidth(struct device *dev, struct device *s_dev,
+	u64 bandwidth);
+
+/**
+ * @brief  Returns the data rate currently programmed on the deserializer
+ * CSI output.
+ *
+ * @param [in]  dev	The deserializer device handle.
+ *
+ * @return  The data rate in Mbps per lane.
+ */
+u32 max96792_get_csi_rate(struct device *dev);
+
 enum {
 	max96792_OUT,
 	max96792_IN,
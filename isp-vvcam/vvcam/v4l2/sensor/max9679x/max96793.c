@@ -217,6 +217,45 @@ int max96793_gmsl3_setup(struct device *dev)
 }
 EXPORT_SYMBOL(max96793_gmsl3_setup);
 
+int max96793_set_link_rate(struct device *dev, u32 rate)
+{
+	struct max96793 *priv = dev_get_drvdata(dev);
+	int err = 0;
+
+	dev_dbg(dev, "%s: rate %u\n", __func__, rate);
+
+	mutex_lock(&priv->lock);
+
+	err = max96793_write_reg(dev, 0x01, (rate << 2) & 0x0C); // TX_RATE
+	if (err)
+		goto error;
+
+	/* the link drops on the reset, the write is not acknowledged */
+	max96793_write_reg(dev, max96793_CTRL0_ADDR, 0x21);
+
+error:
+	mutex_unlock(&priv->lock);
+
+	return err;
+}
+EXPORT_SYMBOL(max96793_set_link_rate);
+
+static void max96793_set_bpp(struct device *dev, u32 code)
+{
+	if (code == MEDIA_BUS_FMT_SRGGB10_1X10
+		|| code == MEDIA_BUS_FMT_SGBRG10_1X10) {
+		max96793_write_reg(dev, 0x31E, 0x2A);	// software override bpp on pipe Z
+		max96793_write_reg(dev, 0x111, 0x4A);	// BPP = 10
+		dev_dbg(dev, "%s: 10 bpp\n", __func__);
+
+	} else if (code == MEDIA_BUS_FMT_SRGGB12_1X12
+		|| code == MEDIA_BUS_FMT_SGBRG12_1X12){
+		max96793_write_reg(dev, 0x31E, 0x2C);	// software override bpp on pipe Z
+		max96793_write_reg(dev, 0x111, 0x4C);	// BPP = 12
+		dev_dbg(dev, "%s: 12 bpp\n", __func__);
+	}
+}
+
 int max96793_setup_streaming(struct device *dev, u32 code)
 {
 	struct max96793 *priv = dev_get_drvdata(dev);
@@ -234,8 +273,6 @@ int max96793_setup_streaming(struct device *dev, u32 code)
 				"%s: ++\n",
 				__func__);
 
-	priv->g_client.st_done = false;
-
 	mutex_lock(&priv->lock);
 
 	if (!priv->g_client.g_ctx) {
@@ -244,13 +281,22 @@ int max96793_setup_streaming(struct device *dev, u32 code)
 		goto error;
 	}
 
+	g_ctx = priv->g_client.g_ctx;
+
 	if (priv->g_client.st_done) {
-		dev_dbg(dev, "%s: stream setup is already done\n", __func__);
+		if (g_ctx->st_code == code) {
+			dev_dbg(dev, "%s: stream setup is already done\n", __func__);
+			goto error;
+		}
+
+		/* lane and pipe setup only depend on g_ctx, redo the BPP part */
+		max96793_write_reg(dev, MAX96793_MIPI_RX0_ADDR, 0x08);
+		max96793_write_reg(dev, MAX96793_MIPI_RX0_ADDR, 0x00);
+		max96793_set_bpp(dev, code);
+		g_ctx->st_code = code;
 		goto error;
 	}
 
-	g_ctx = priv->g_client.g_ctx;
-
 	//reset mipi
 	max96793_write_reg(dev, MAX96793_MIPI_RX0_ADDR, 0x08);
 	max96793_write_reg(dev, MAX96793_MIPI_RX0_ADDR, 0x00);
@@ -271,18 +317,7 @@ int max96793_setup_streaming(struct device *dev, u32 code)
 		if (g_ctx->streams[i].st_id_sel != GMSL_ST_ID_UNUSED)
 			port_sel |= (1 << g_ctx->streams[i].st_id_sel);
 
-	if (code == MEDIA_BUS_FMT_SRGGB10_1X10
-		|| code == MEDIA_BUS_FMT_SGBRG10_1X10) {
-		max96793_write_reg(dev, 0x31E, 0x2A);	// software override bpp on pipe Z
-		max96793_write_reg(dev, 0x111, 0x4A);	// BPP = 10
-		dev_dbg(dev, "%s: 10 bpp\n", __func__);
-
-	} else if (code == MEDIA_BUS_FMT_SRGGB12_1X12
-		|| code == MEDIA_BUS_FMT_SGBRG12_1X12){
-		max96793_write_reg(dev, 0x31E, 0x2C);	// software override bpp on pipe Z
-		max96793_write_reg(dev, 0x111, 0x4C);	// BPP = 12
-		dev_dbg(dev, "%s: 12 bpp\n", __func__);
-	}
+	max96793_set_bpp(dev, code);
 
 	max96793_write_reg(dev, 0x312, 0x04);	// Double EMB8 on pipe Z
 	max96793_write_reg(dev, 0x110, 0x28);	// Disable AUTO_BPP
@@ -299,6 +334,7 @@ int max96793_setup_streaming(struct device *dev, u32 code)
 	max96793_write_reg(dev, MAX96793_CSI_PORT_SEL_ADDR, 0x64); // enable CSI on port B
 	max96793_write_reg(dev, MAX96793_ENABLE_PORTBZ_ADDR, 0x43); // Select port B for pipe Z
 
+	g_ctx->st_code = code;
 	priv->g_client.st_done = true;
 
 error:
@@ -521,10 +557,17 @@ error:
 }
 EXPORT_SYMBOL(max96793_sdev_unpair);
 
+static bool max96793_volatile_reg(struct device *dev, unsigned int reg)
+{
+	/* CTRL0 holds self-clearing one-shot/reset bits, never replay it */
+	return reg == max96793_CTRL0_ADDR;
+}
+
 static struct regmap_config max96793_regmap_config = {
 	.reg_bits = 16,
 	.val_bits = 8,
 	.cache_type = REGCACHE_RBTREE,
+	.volatile_reg = max96793_volatile_reg,
 };
 
 static int max96793_probe(struct i2c_client *client)
@@ -585,6 +628,58 @@ static void max96793_remove(struct i2c_client *client)
 
 }
 
+static int __maybe_unused max96793_suspend(struct device *dev)
+{
+	struct max96793 *priv = dev_get_drvdata(dev);
+
+	mutex_lock(&priv->lock);
+	regcache_cache_only(priv->regmap, true);
+	regcache_mark_dirty(priv->regmap);
+	mutex_unlock(&priv->lock);
+
+	return 0;
+}
+
+static int __maybe_unused max96793_resume(struct device *dev)
+{
+	struct max96793 *priv = dev_get_drvdata(dev);
+	struct gmsl_link_ctx *g_ctx;
+	int err = 0;
+
+	mutex_lock(&priv->lock);
+
+	regcache_cache_only(priv->regmap, false);
+
+	/* nothing was programmed yet, setup_control will do it */
+	g_ctx = priv->g_client.g_ctx;
+	if (!g_ctx || !g_ctx->serdev_found)
+		goto unlock;
+
+	err = regcache_sync(priv->regmap);
+	if (err) {
+		dev_err(dev, "%s: register restore failed\n", __func__);
+		goto unlock;
+	}
+
+	/* apply the restored link settings */
+	if (g_ctx->serdes_csi_link == GMSL_SERDES_CSI_LINK_A)
+		err = max96793_write_reg(dev, max96793_CTRL0_ADDR, 0x21);
+	else
+		err = max96793_write_reg(dev, max96793_CTRL0_ADDR, 0x22);
+
+	/* delay to settle link */
+	msleep(100);
+
+unlock:
+	mutex_unlock(&priv->lock);
+
+	return err;
+}
+
+static const struct dev_pm_ops max96793_pm_ops = {
+	SET_SYSTEM_SLEEP_PM_OPS(max96793_suspend, max96793_resume)
+};
+
 static const struct i2c_device_id max96793_id[] = {
 	{ "max96793", 0 },
 	{ },
@@ -601,6 +696,7 @@ static struct i2c_driver max96793_i2c_driver = {
 	.driver = {
 		.name = "max96793",
 		.owner = THIS_MODULE,
+		.pm = &max96793_pm_ops,
 	},
 	.probe = max96793_probe,
 	.remove = max96793_remove,
@@ -106,7 +106,8 @@ int max96793_sdev_unpair(struct device *dev, struct device *s_dev);
 
 /**
  * Sets up the serializer device's internal pipeline for a specified
- * sensor/serializer pair.
+ * sensor/serializer pair. Once set up, only a change of @p code is
+ * programmed again.
  *
  * @param  [in]  dev	The serializer device handle.
  * @param  [in]  code	Code format of the sensor (RGGB, GBRG, ...).
@@ -117,6 +118,18 @@ int max96793_setup_streaming(struct device *dev, u32 code);
 
 int max96793_gmsl3_setup(struct device *dev);
 
+/**
+ * Changes the serializer forward link rate and resets the link. The
+ * link drops until the deserializer is set to the same rate with
+ * max96792_set_link_rate().
+ *
+ * @param  [in]  dev	The serializer device handle.
+ * @param  [in]  rate	One of the GMSL_LINK_RATE_* values.
+ *
+ * @return  0 for success, or -1 otherwise.
+ */
+int max96793_set_link_rate(struct device *dev, u32 rate);
+
 int max96793_gpio10_xtrig1_setup(struct device *dev, char *image_sensor_type);
 
 int max96793_xvs_setup(struct device *dev, bool direction);
@@ -33,6 +33,7 @@ vvcam: $(VVCAM_KERNELENVSH) $(VVCAM_SRC_PATH)
 	cp $(VVCAM_SRC_PATH)/sensor/os08a20/os08a20.ko $(VVCAM_OUT);
 	cp $(VVCAM_SRC_PATH)/sensor/max9679x/max96792.ko $(VVCAM_OUT);
 	cp $(VVCAM_SRC_PATH)/sensor/max9679x/max96793.ko $(VVCAM_OUT);
+	cp $(VVCAM_PATH)/vvcam/common/vvsensor_common.ko $(VVCAM_OUT);
 	cp $(VVCAM_SRC_PATH)/video/vvcam-video.ko $(VVCAM_OUT);
 	cp $(VVCAM_SRC_PATH)/isp/vvcam-isp.ko $(VVCAM_OUT);
 	cp $(VVCAM_SRC_PATH)/dwe/vvcam-dwe.ko $(VVCAM_OUT);
@@ -19,6 +19,7 @@
  */
 
 #include <linux/clk.h>
+#include <linux/debugfs.h>
 #include <linux/delay.h>
 #include <linux/errno.h>
 #include <linux/interrupt.h>
@@ -26,6 +27,8 @@
 #include <linux/irq.h>
 #include <linux/kernel.h>
 #include <linux/mfd/syscon.h>
+#include <linux/miscdevice.h>
+#include <linux/mm.h>
 #include <linux/module.h>
 #include <linux/of.h>
 #include <linux/of_address.h>
@@ -34,12 +37,17 @@
 #include <linux/pm_runtime.h>
 #include <linux/regmap.h>
 #include <linux/regulator/consumer.h>
+#include <linux/seq_file.h>
 #include <linux/slab.h>
+#include <linux/sort.h>
 #include <linux/spinlock.h>
+#include <linux/vmalloc.h>
 #include <linux/videodev2.h>
 #include <linux/v4l2-mediabus.h>
 #include <linux/reset.h>
 #include <linux/version.h>
+#include <linux/imx8-mipi-csi2-sam.h>
+#include <media/v4l2-ctrls.h>
 #include <media/v4l2-subdev.h>
 #include <media/v4l2-device.h>
 #include <media/v4l2-event.h>
@@ -50,6 +58,19 @@
 #define CSIS0_MAX_LANES			4
 #define CSIS1_MAX_LANES			2
 
+/* frame intervals kept for the debugfs statistics */
+#define CSIS_FI_WINDOW			128
+/* consecutive late frames after which the frame rate is taken as changed */
+#define CSIS_FI_RESEED			4
+
+/* runtime PM autosuspend delay */
+#define CSIS_AUTOSUSPEND_MS		2000
+
+/* HS-settle calibration */
+#define CSIS_SETTLE_CAL_RATES		8
+#define CSIS_HS_SETTLE_MAX		0x3f
+#define CSIS_SETTLE_DWELL_MS		50
+
 #define MIPI_CSIS_OF_NODE_NAME		"csi"
 
 #define MIPI_CSIS_VC0_PAD_SINK		0
@@ -63,6 +84,9 @@
 #define MIPI_CSIS_VC3_PAD_SOURCE	7
 #define MIPI_CSIS_VCX_PADS_NUM		8
 
+/* image channels, each filters one virtual channel and data type */
+#define MIPI_CSIS_MAX_CHANNELS		4
+
 
 #define MIPI_CSIS_DEF_PIX_WIDTH		1920
 #define MIPI_CSIS_DEF_PIX_HEIGHT	1080
@@ -75,6 +99,7 @@
 /* CSIS common control */
 #define MIPI_CSIS_CMN_CTRL			0x04
 #define MIPI_CSIS_CMN_CTRL_UPDATE_SHADOW	(1 << 16)
+#define MIPI_CSIS_CMN_CTRL_UPDATE_SHADOW_CH(n)	(1 << (16 + (n)))
 #define MIPI_CSIS_CMN_CTRL_HDR_MODE		(1 << 11)
 #define MIPI_CSIS_CMN_CTRL_INTER_MODE		(3 << 10)
 #define MIPI_CSIS_CMN_CTRL_LANE_NR_OFFSET	8
@@ -89,6 +114,7 @@
 #define MIPI_CSIS_CLK_CTRL_CLKGATE_TRAIL_CH2(x)	(x << 24)
 #define MIPI_CSIS_CLK_CTRL_CLKGATE_TRAIL_CH1(x)	(x << 20)
 #define MIPI_CSIS_CLK_CTRL_CLKGATE_TRAIL_CH0(x)	(x << 16)
+#define MIPI_CSIS_CLK_CTRL_CLKGATE_TRAIL_CH(n, x)	((x) << (16 + 4 * (n)))
 #define MIPI_CSIS_CLK_CTRL_CLKGATE_EN_MSK	(0xf << 4)
 #define MIPI_CSIS_CLK_CTRL_WCLK_SRC		(1 << 0)
 
@@ -98,6 +124,7 @@
 #define MIPI_CSIS_INTMSK_EVEN_AFTER		(1 << 30)
 #define MIPI_CSIS_INTMSK_ODD_BEFORE		(1 << 29)
 #define MIPI_CSIS_INTMSK_ODD_AFTER		(1 << 28)
+#define MIPI_CSIS_INTMSK_NON_IMAGE_DATA		(0xf << 28)
 #define MIPI_CSIS_INTMSK_FRAME_START		(1 << 24)
 #define MIPI_CSIS_INTMSK_FRAME_END		(1 << 20)
 #define MIPI_CSIS_INTMSK_ERR_SOT_HS		(1 << 16)
@@ -176,6 +203,8 @@
 #define MIPI_CSIS_ISPCONFIG_CH3_PIXEL_MODE_MASK		(0x3 << 12)
 #define MIPI_CSIS_ISPCONFIG_CH3_PIXEL_MODE_SHIFT	12
 
+#define MIPI_CSIS_ISPCONFIG_CH(n)			(0x40 + 0x10 * (n))
+
 #define PIXEL_MODE_SINGLE_PIXEL_MODE			0x0
 #define PIXEL_MODE_DUAL_PIXEL_MODE			0x1
 #define PIXEL_MODE_QUAD_PIXEL_MODE			0x2
@@ -195,12 +224,14 @@
 /* User defined formats, x = 1...4 */
 #define MIPI_CSIS_ISPCFG_FMT_USER(x)		((0x30 + x - 1) << 2)
 #define MIPI_CSIS_ISPCFG_FMT_MASK		(0x3f << 2)
+#define MIPI_CSIS_ISPCFG_VC_MASK		(0x3 << 0)
 
 /* ISP Image Resolution register */
 #define MIPI_CSIS_ISPRESOL_CH0			0x44
 #define MIPI_CSIS_ISPRESOL_CH1			0x54
 #define MIPI_CSIS_ISPRESOL_CH2			0x64
 #define MIPI_CSIS_ISPRESOL_CH3			0x74
+#define MIPI_CSIS_ISPRESOL_CH(n)		(0x44 + 0x10 * (n))
 #define CSIS_MAX_PIX_WIDTH			0xffff
 #define CSIS_MAX_PIX_HEIGHT			0xffff
 
@@ -209,6 +240,7 @@
 #define MIPI_CSIS_ISPSYNC_CH1			0x58
 #define MIPI_CSIS_ISPSYNC_CH2			0x68
 #define MIPI_CSIS_ISPSYNC_CH3			0x78
+#define MIPI_CSIS_ISPSYNC_CH(n)			(0x48 + 0x10 * (n))
 
 #define MIPI_CSIS_ISPSYNC_HSYNC_LINTV_OFFSET	18
 #define MIPI_CSIS_ISPSYNC_VSYNC_SINTV_OFFSET 	12
@@ -277,7 +309,6 @@ struct csi_state;
 struct mipi_csis_event {
 	u32 mask;
 	const char * const name;
-	unsigned int counter;
 };
 
 /**
@@ -295,11 +326,31 @@ struct csis_pix_format {
 	u8 data_alignment;
 };
 
+/* virtual channel and data type filtered by one CSIS image channel */
+struct csis_route {
+	u8 vc;
+	u32 fmt_reg;
+};
+
+/* calibrated HS-settle for one data rate in Mbps per lane */
+struct csis_settle_cal {
+	u32 rate;
+	u32 hs_settle;
+};
+
 struct csis_pktbuf {
 	u32 *data;
 	unsigned int len;
 };
 
+/* embedded data of one frame, handed from the hard irq to the thread */
+struct csis_emb_data {
+	u32 sequence;
+	ktime_t timestamp;
+	const u8 *data;
+	u32 len;
+};
+
 struct csis_hw_reset1 {
 	struct regmap *src;
 	u8 req_src;
@@ -365,6 +416,9 @@ static const struct mipi_csis_event mipi_csis_events[] = {
 };
 #define MIPI_CSIS_NUM_EVENTS ARRAY_SIZE(mipi_csis_events)
 
+/* INTSRC bit to mipi_csis_events index + 1, 0 for bits not counted */
+static u8 mipi_csis_event_map[32];
+
 /**
  * struct csi_state - the driver's internal state data structure
  * @lock: mutex serializing the subdev and power management operations,
@@ -384,11 +438,60 @@ static const struct mipi_csis_event mipi_csis_events[] = {
  * @num_lanes: number of MIPI-CSI data lanes used
  * @max_num_lanes: maximum number of MIPI-CSI data lanes supported
  * @wclk_ext: CSI wrapper clock: 0 - bus clock, 1 - external SCLK_CAM
+ * @routes: virtual channel and data type of each used image channel
+ * @num_routes: number of used image channels, channel n feeds the VCn source pad
  * @csis_fmt: current CSIS pixel format
  * @format: common media bus format for the source and sink pad
- * @slock: spinlock protecting structure members below
+ * @slock: spinlock protecting @pkt_buf and the hard irq to thread handoff
  * @pkt_buf: the frame embedded (non-image) data buffer
- * @events: MIPI-CSIS event (error) counters
+ * @events: MIPI-CSIS event (error) counters, indexed as mipi_csis_events
+ * @resume_ts: system resume time in ns, cleared on the first frame start after it
+ * @resume_latency_us: last measured resume to first frame start latency
+ * @resume_latency_max_us: longest measured resume to first frame start latency
+ * @fs_ts: time of the last frame start, protected by mipi_csis_fs_lock
+ * @frame_us: last frame start period
+ * @skew_us: last frame start skew to the other CSIS instance
+ * @skew_max_us: largest absolute skew since stream on
+ * @skew_valid: @skew_us and @skew_max_us hold a measurement
+ * @irq_status: INTSRC bits latched by the hard irq handler for the thread
+ * @irq_ts: time of the last frame start interrupt
+ * @irq_fs_ts: time of the frame start latched for the thread
+ * @irq_fs_seq: sequence of the frame start latched for the thread
+ * @irq_max_ns: longest hard irq handler run time since stream on
+ * @sequence: number of frame starts since stream on
+ * @emb_ring: embedded data ring mapped by user space, NULL if unavailable
+ * @emb_misc: misc device exporting @emb_ring
+ * @emb_name: name of @emb_misc
+ * @emb_users: open count of @emb_misc
+ * @src_node: device node of the connected sensor
+ * @fs_notifier: in-kernel frame start notifier chain
+ * @fs_users: number of @fs_notifier entries
+ * @emb_buf: embedded data copied from the packet RAM by the irq thread
+ * @irq_pkt_pending: a non-image data packet waits for the irq thread
+ * @irq_pkt_status: INTSRC of that packet, selects the even or odd packet RAM
+ * @irq_pkt_seq: frame sequence of that packet
+ * @irq_pkt_ts: frame start time of that packet
+ * @pkt_overruns: packets dropped as the next frames overwrote them
+ * @fi_us: last frame intervals, protected by mipi_csis_fs_lock
+ * @fi_head: next @fi_us entry to write
+ * @fi_count: number of valid @fi_us entries
+ * @fi_avg_us: running average frame interval, late frames excluded
+ * @late_frames: frames whose interval exceeded 1.5x @fi_avg_us
+ * @late_run: consecutive late frames, @fi_avg_us is re-seeded after
+ *	CSIS_FI_RESEED of them
+ * @stream_ts: stream on time
+ * @debugfs_dir: debugfs directory of this instance
+ * @hs_settle_dt: HS-RX settle time from the device tree
+ * @num_lanes_dt: number of MIPI-CSI data lanes from the device tree
+ * @settle_cal: calibrated HS-RX settle times, protected by @lock
+ * @settle_cal_busy: a calibration sweep is running, protected by @lock
+ * @pm_resumes: number of runtime resumes
+ * @pm_suspends: number of runtime suspends
+ * @pm_resume_max_us: longest runtime resume
+ * @stream_count: number of stream starts
+ * @streaming: the stream is on, protected by @lock
+ * @regs_snap: register snapshot taken at the last stream on, protected by @lock
+ * @regs_blob: debugfs view of @regs_snap
  */
 struct csi_state {
 	struct v4l2_subdev	sd;
@@ -417,13 +520,60 @@ struct csi_state {
 	u32 max_num_lanes;
 	u8 wclk_ext;
 
-	u8 vchannel;
+	struct csis_route routes[MIPI_CSIS_MAX_CHANNELS];
+	u8 num_routes;
 	const struct csis_pix_format *csis_fmt;
 	struct v4l2_mbus_framefmt format;
 
 	spinlock_t slock;
 	struct csis_pktbuf pkt_buf;
-	struct mipi_csis_event events[MIPI_CSIS_NUM_EVENTS];
+	atomic64_t events[MIPI_CSIS_NUM_EVENTS];
+	atomic64_t resume_ts;
+	s64 resume_latency_us;
+	s64 resume_latency_max_us;
+	ktime_t fs_ts;
+	s64 frame_us;
+	s64 skew_us;
+	s64 skew_max_us;
+	bool skew_valid;
+	u32 irq_status;
+	ktime_t irq_ts;
+	ktime_t irq_fs_ts;
+	u32 irq_fs_seq;
+	s64 irq_max_ns;
+	u32 sequence;
+	struct csis_emb_ring *emb_ring;
+	struct miscdevice emb_misc;
+	char emb_name[16];
+	atomic_t emb_users;
+	struct device_node *src_node;
+	struct blocking_notifier_head fs_notifier;
+	atomic_t fs_users;
+	u8 *emb_buf;
+	bool irq_pkt_pending;
+	u32 irq_pkt_status;
+	u32 irq_pkt_seq;
+	ktime_t irq_pkt_ts;
+	u32 pkt_overruns;
+	u32 fi_us[CSIS_FI_WINDOW];
+	u32 fi_head;
+	u32 fi_count;
+	u32 fi_avg_us;
+	u32 late_frames;
+	u32 late_run;
+	ktime_t stream_ts;
+	struct dentry *debugfs_dir;
+	u32 hs_settle_dt;
+	u32 num_lanes_dt;
+	struct csis_settle_cal settle_cal[CSIS_SETTLE_CAL_RATES];
+	bool settle_cal_busy;
+	u32 pm_resumes;
+	u32 pm_suspends;
+	s64 pm_resume_max_us;
+	u32 stream_count;
+	bool streaming;
+	struct csis_regs_snapshot *regs_snap;
+	struct debugfs_blob_wrapper regs_blob;
 
 	struct v4l2_async_connection asd;
 	struct v4l2_async_notifier  subdev_notifier;
@@ -450,6 +600,18 @@ static int debug;
 module_param(debug, int, 0644);
 MODULE_PARM_DESC(debug, "Debug level (0-2)");
 
+static unsigned int emb_data_len = CSIS_EMB_DATA_SIZE;
+module_param(emb_data_len, uint, 0644);
+MODULE_PARM_DESC(emb_data_len, "Embedded data bytes copied to the ring per frame");
+
+static int autosuspend_ms = CSIS_AUTOSUSPEND_MS;
+module_param(autosuspend_ms, int, 0444);
+MODULE_PARM_DESC(autosuspend_ms, "Runtime PM autosuspend delay in ms, negative to stay powered");
+
+/* frame start times of all instances, for synchronized sensor skew */
+static struct csi_state *mipi_csis_instances[CSIS_MAX_ENTITIES];
+static DEFINE_SPINLOCK(mipi_csis_fs_lock);
+
 static const struct csis_pix_format mipi_csis_formats[] = {
 	{
 		.code = MEDIA_BUS_FMT_YUYV8_2X8,
@@ -525,63 +687,98 @@ static const struct csis_pix_format mipi_csis_formats[] = {
 #define mipi_csis_write(__csis, __r, __v) writel(__v, __csis->regs + __r)
 #define mipi_csis_read(__csis, __r) readl(__csis->regs + __r)
 
+struct mipi_csis_reg {
+	u32 offset;
+	const char * const name;
+};
+
+static const struct mipi_csis_reg mipi_csis_regs[] = {
+	{ 0x00, "CSIS_VERSION" },
+	{ 0x04, "CSIS_CMN_CTRL" },
+	{ 0x08, "CSIS_CLK_CTRL" },
+	{ 0x10, "CSIS_INTMSK" },
+	{ 0x14, "CSIS_INTSRC" },
+	{ 0x20, "CSIS_DPHYSTATUS" },
+	{ 0x24, "CSIS_DPHYCTRL" },
+	{ 0x30, "CSIS_DPHYBCTRL_L" },
+	{ 0x34, "CSIS_DPHYBCTRL_H" },
+	{ 0x38, "CSIS_DPHYSCTRL_L" },
+	{ 0x3C, "CSIS_DPHYSCTRL_H" },
+	{ 0x40, "CSIS_ISPCONFIG_CH0" },
+	{ 0x50, "CSIS_ISPCONFIG_CH1" },
+	{ 0x60, "CSIS_ISPCONFIG_CH2" },
+	{ 0x70, "CSIS_ISPCONFIG_CH3" },
+	{ 0x44, "CSIS_ISPRESOL_CH0" },
+	{ 0x54, "CSIS_ISPRESOL_CH1" },
+	{ 0x64, "CSIS_ISPRESOL_CH2" },
+	{ 0x74, "CSIS_ISPRESOL_CH3" },
+	{ 0x48, "CSIS_ISPSYNC_CH0" },
+	{ 0x58, "CSIS_ISPSYNC_CH1" },
+	{ 0x68, "CSIS_ISPSYNC_CH2" },
+	{ 0x78, "CSIS_ISPSYNC_CH3" },
+};
+
+/* offsets in the csi-gpr gasket syscon */
+static const struct mipi_csis_reg mipi_csis_gasket_regs[] = {
+	{ DISP_MIX_GASKET_0_CTRL, "GPR_GASKET_0_CTRL" },
+	{ DISP_MIX_GASKET_0_HSIZE, "GPR_GASKET_0_HSIZE" },
+	{ DISP_MIX_GASKET_0_VSIZE, "GPR_GASKET_0_VSIZE" },
+};
+
+#define CSIS_SNAP_NUM_REGS	(ARRAY_SIZE(mipi_csis_regs) + \
+				 ARRAY_SIZE(mipi_csis_gasket_regs))
+#define CSIS_SNAP_SIZE		struct_size_t(struct csis_regs_snapshot, \
+					      regs, CSIS_SNAP_NUM_REGS)
+
 static void dump_csis_regs(struct csi_state *state, const char *label)
 {
-	struct {
-		u32 offset;
-		const char * const name;
-	} registers[] = {
-		{ 0x00, "CSIS_VERSION" },
-		{ 0x04, "CSIS_CMN_CTRL" },
-		{ 0x08, "CSIS_CLK_CTRL" },
-		{ 0x10, "CSIS_INTMSK" },
-		{ 0x14, "CSIS_INTSRC" },
-		{ 0x20, "CSIS_DPHYSTATUS" },
-		{ 0x24, "CSIS_DPHYCTRL" },
-		{ 0x30, "CSIS_DPHYBCTRL_L" },
-		{ 0x34, "CSIS_DPHYBCTRL_H" },
-		{ 0x38, "CSIS_DPHYSCTRL_L" },
-		{ 0x3C, "CSIS_DPHYSCTRL_H" },
-		{ 0x40, "CSIS_ISPCONFIG_CH0" },
-		{ 0x50, "CSIS_ISPCONFIG_CH1" },
-		{ 0x60, "CSIS_ISPCONFIG_CH2" },
-		{ 0x70, "CSIS_ISPCONFIG_CH3" },
-		{ 0x44, "CSIS_ISPRESOL_CH0" },
-		{ 0x54, "CSIS_ISPRESOL_CH1" },
-		{ 0x64, "CSIS_ISPRESOL_CH2" },
-		{ 0x74, "CSIS_ISPRESOL_CH3" },
-		{ 0x48, "CSIS_ISPSYNC_CH0" },
-		{ 0x58, "CSIS_ISPSYNC_CH1" },
-		{ 0x68, "CSIS_ISPSYNC_CH2" },
-		{ 0x78, "CSIS_ISPSYNC_CH3" },
-	};
 	u32 i;
 
 	v4l2_dbg(2, debug, &state->sd, "--- %s ---\n", label);
 
-	for (i = 0; i < ARRAY_SIZE(registers); i++) {
-		u32 cfg = mipi_csis_read(state, registers[i].offset);
-		v4l2_dbg(2, debug, &state->sd, "%20s[%x]: 0x%.8x\n", registers[i].name, registers[i].offset, cfg);
+	for (i = 0; i < ARRAY_SIZE(mipi_csis_regs); i++) {
+		u32 cfg = mipi_csis_read(state, mipi_csis_regs[i].offset);
+		v4l2_dbg(2, debug, &state->sd, "%20s[%x]: 0x%.8x\n", mipi_csis_regs[i].name, mipi_csis_regs[i].offset, cfg);
 	}
 }
 
 static void dump_gasket_regs(struct csi_state *state, const char *label)
 {
-	struct {
-		u32 offset;
-		const char * const name;
-	} registers[] = {
-		{ 0x60, "GPR_GASKET_0_CTRL" },
-		{ 0x64, "GPR_GASKET_0_HSIZE" },
-		{ 0x68, "GPR_GASKET_0_VSIZE" },
-	};
 	u32 i, cfg;
 
 	v4l2_dbg(2, debug, &state->sd, "--- %s ---\n", label);
 
-	for (i = 0; i < ARRAY_SIZE(registers); i++) {
-		regmap_read(state->gasket, registers[i].offset, &cfg);
-		v4l2_dbg(2, debug, &state->sd, "%20s[%x]: 0x%.8x\n", registers[i].name, registers[i].offset, cfg);
+	for (i = 0; i < ARRAY_SIZE(mipi_csis_gasket_regs); i++) {
+		regmap_read(state->gasket, mipi_csis_gasket_regs[i].offset, &cfg);
+		v4l2_dbg(2, debug, &state->sd, "%20s[%x]: 0x%.8x\n", mipi_csis_gasket_regs[i].name, mipi_csis_gasket_regs[i].offset, cfg);
+	}
+}
+
+/* The device must be powered, @snap holds CSIS_SNAP_SIZE bytes */
+static void mipi_csis_snapshot_regs(struct csi_state *state,
+				    struct csis_regs_snapshot *snap)
+{
+	struct csis_reg_value *reg = snap->regs;
+	u32 i, val;
+
+	snap->magic = CSIS_REGS_MAGIC;
+	snap->num_regs = CSIS_SNAP_NUM_REGS;
+	snap->timestamp = ktime_get_ns();
+	snap->stream_count = state->stream_count;
+	snap->reserved = 0;
+
+	for (i = 0; i < ARRAY_SIZE(mipi_csis_regs); i++, reg++) {
+		reg->bank = CSIS_REGS_BANK_CSIS;
+		reg->offset = mipi_csis_regs[i].offset;
+		reg->value = mipi_csis_read(state, reg->offset);
+	}
+
+	for (i = 0; i < ARRAY_SIZE(mipi_csis_gasket_regs); i++, reg++) {
+		val = 0;
+		regmap_read(state->gasket, mipi_csis_gasket_regs[i].offset, &val);
+		reg->bank = CSIS_REGS_BANK_GASKET;
+		reg->offset = mipi_csis_gasket_regs[i].offset;
+		reg->value = val;
 	}
 }
 
@@ -677,6 +874,15 @@ static void mipi_csis_enable_interrupts(struct csi_state *state, bool on)
 		val |= 0x0FFFFF1F;
 	else
 		val &= ~0x0FFFFF1F;
+
+	/* frame end is only counted for debugging */
+	if (on && !debug)
+		val &= ~MIPI_CSIS_INTMSK_FRAME_END;
+
+	if (on && atomic_read(&state->emb_users))
+		val |= MIPI_CSIS_INTMSK_NON_IMAGE_DATA;
+	else
+		val &= ~MIPI_CSIS_INTMSK_NON_IMAGE_DATA;
 	mipi_csis_write(state, MIPI_CSIS_INTMSK, val);
 }
 
@@ -728,14 +934,15 @@ static void __mipi_csis_set_format(struct csi_state *state)
 {
 	struct v4l2_mbus_framefmt *mf = &state->format;
 	u32 val;
+	int i;
 
 	v4l2_dbg(1, debug, &state->sd, "fmt: %#x, %d x %d\n",
 		 mf->code, mf->width, mf->height);
 
 	/* Color format */
 	val = mipi_csis_read(state, MIPI_CSIS_ISPCONFIG_CH0);
-	val &= ~MIPI_CSIS_ISPCFG_FMT_MASK;
-	val |= state->csis_fmt->fmt_reg;
+	val &= ~(MIPI_CSIS_ISPCFG_FMT_MASK | MIPI_CSIS_ISPCFG_VC_MASK);
+	val |= state->routes[0].fmt_reg | state->routes[0].vc;
 	mipi_csis_write(state, MIPI_CSIS_ISPCONFIG_CH0, val);
 
 	val = mipi_csis_read(state, MIPI_CSIS_ISPCONFIG_CH0);
@@ -749,14 +956,10 @@ static void __mipi_csis_set_format(struct csi_state *state)
 	val = mf->width | (mf->height << 16);
 	mipi_csis_write(state, MIPI_CSIS_ISPRESOL_CH0, val);
 
-	if (state->hdr) {
-		mipi_csis_write(state, MIPI_CSIS_ISPRESOL_CH1, val);
-		mipi_csis_write(state, MIPI_CSIS_ISPRESOL_CH2, val);
-		mipi_csis_write(state, MIPI_CSIS_ISPRESOL_CH3, val);
-		val = state->csis_fmt->fmt_reg;
-		mipi_csis_write(state, MIPI_CSIS_ISPCONFIG_CH1, val | 1);
-		mipi_csis_write(state, MIPI_CSIS_ISPCONFIG_CH2, val | 2);
-		mipi_csis_write(state, MIPI_CSIS_ISPCONFIG_CH3, val | 3);
+	for (i = 1; i < state->num_routes; i++) {
+		mipi_csis_write(state, MIPI_CSIS_ISPRESOL_CH(i), val);
+		mipi_csis_write(state, MIPI_CSIS_ISPCONFIG_CH(i),
+				state->routes[i].fmt_reg | state->routes[i].vc);
 	}
 }
 
@@ -770,9 +973,54 @@ static void mipi_csis_set_hsync_settle(struct csi_state *state)
 	mipi_csis_write(state, MIPI_CSIS_DPHYCTRL, val);
 }
 
+/*
+ * Route every stream of the sensor frame descriptor to its own image
+ * channel, so that DOL HDR exposures sent on separate virtual channels
+ * reach separate source pads. Without a descriptor, channel n filters
+ * virtual channel n in HDR mode and only channel 0 is used otherwise.
+ */
+static void mipi_csis_select_routes(struct csi_state *state)
+{
+	struct v4l2_mbus_frame_desc fd = { 0 };
+	struct media_pad *source_pad;
+	struct v4l2_subdev *sen_sd;
+	int i, n;
+
+	n = state->hdr ? MIPI_CSIS_MAX_CHANNELS : 1;
+	for (i = 0; i < n; i++) {
+		state->routes[i].vc = i;
+		state->routes[i].fmt_reg = state->csis_fmt->fmt_reg;
+	}
+	state->num_routes = n;
+
+	source_pad = csis_get_remote_sensor_pad(state);
+	sen_sd = csis_get_remote_subdev(state, __func__);
+	if (!source_pad || !sen_sd)
+		return;
+
+	if (v4l2_subdev_call(sen_sd, pad, get_frame_desc, source_pad->index,
+			     &fd) || fd.type != V4L2_MBUS_FRAME_DESC_TYPE_CSI2 ||
+	    !fd.num_entries)
+		return;
+
+	n = min_t(int, fd.num_entries, MIPI_CSIS_MAX_CHANNELS);
+	for (i = 0; i < n; i++) {
+		state->routes[i].vc = fd.entry[i].bus.csi2.vc &
+				      MIPI_CSIS_ISPCFG_VC_MASK;
+		state->routes[i].fmt_reg = (fd.entry[i].bus.csi2.dt << 2) &
+					   MIPI_CSIS_ISPCFG_FMT_MASK;
+		v4l2_dbg(1, debug, &state->sd, "channel %d: vc %u, dt %#x\n",
+			 i, state->routes[i].vc, fd.entry[i].bus.csi2.dt);
+	}
+	state->num_routes = n;
+}
+
 static void mipi_csis_set_params(struct csi_state *state)
 {
 	u32 val;
+	int i;
+
+	mipi_csis_select_routes(state);
 
 	val = mipi_csis_read(state, MIPI_CSIS_CMN_CTRL);
 	val &= ~MIPI_CSIS_CMN_CTRL_LANE_NR_MASK;
@@ -793,16 +1041,27 @@ static void mipi_csis_set_params(struct csi_state *state)
 		val &= ~MIPI_CSIS_ISPCFG_ALIGN_32BIT;
 	mipi_csis_write(state, MIPI_CSIS_ISPCONFIG_CH0, val);
 
+	for (i = 1; i < state->num_routes; i++) {
+		val = mipi_csis_read(state, MIPI_CSIS_ISPCONFIG_CH(i));
+		if (state->csis_fmt->data_alignment == 32)
+			val |= MIPI_CSIS_ISPCFG_ALIGN_32BIT;
+		else
+			val &= ~MIPI_CSIS_ISPCFG_ALIGN_32BIT;
+		mipi_csis_write(state, MIPI_CSIS_ISPCONFIG_CH(i), val);
+	}
+
 	val = (0 << MIPI_CSIS_ISPSYNC_HSYNC_LINTV_OFFSET) |
 	      (0 << MIPI_CSIS_ISPSYNC_VSYNC_SINTV_OFFSET) |
 	      (0 << MIPI_CSIS_ISPSYNC_VSYNC_EINTV_OFFSET);
-	mipi_csis_write(state, MIPI_CSIS_ISPSYNC_CH0, val);
+	for (i = 0; i < state->num_routes; i++)
+		mipi_csis_write(state, MIPI_CSIS_ISPSYNC_CH(i), val);
 
 	val = mipi_csis_read(state, MIPI_CSIS_CLK_CTRL);
 	val &= ~MIPI_CSIS_CLK_CTRL_WCLK_SRC;
 	if (state->wclk_ext)
 		val |= MIPI_CSIS_CLK_CTRL_WCLK_SRC;
-	val |= MIPI_CSIS_CLK_CTRL_CLKGATE_TRAIL_CH0(15);
+	for (i = 0; i < state->num_routes; i++)
+		val |= MIPI_CSIS_CLK_CTRL_CLKGATE_TRAIL_CH(i, 15);
 	val &= ~MIPI_CSIS_CLK_CTRL_CLKGATE_EN_MSK;
 	mipi_csis_write(state, MIPI_CSIS_CLK_CTRL, val);
 
@@ -813,10 +1072,9 @@ static void mipi_csis_set_params(struct csi_state *state)
 	val = mipi_csis_read(state, MIPI_CSIS_CMN_CTRL);
 	val |= (MIPI_CSIS_CMN_CTRL_UPDATE_SHADOW |
 		MIPI_CSIS_CMN_CTRL_UPDATE_SHADOW_CTRL);
-	if (state->hdr) {
-		val |= MIPI_CSIS_CMN_CTRL_HDR_MODE;
-		val |= 0xE0000;
-	}
+	for (i = 1; i < state->num_routes; i++)
+		val |= MIPI_CSIS_CMN_CTRL_HDR_MODE |
+		       MIPI_CSIS_CMN_CTRL_UPDATE_SHADOW_CH(i);
 	mipi_csis_write(state, MIPI_CSIS_CMN_CTRL, val);
 }
 
@@ -1038,8 +1296,172 @@ static void disp_mix_gasket_enable(struct csi_state *state, bool enable)
 					0);
 }
 
-static void mipi_csis_start_stream(struct csi_state *state)
+/*
+ * Data rate in Mbps per lane from the sensor link frequency, 0 when the
+ * sensor has no LINK_FREQ control. The read goes through v4l2_g_ctrl(), as
+ * v4l2_get_link_freq() drops a g_volatile_ctrl error and reports index 0.
+ */
+static int mipi_csis_data_rate(struct csi_state *state, u32 *rate)
+{
+	struct v4l2_control ctrl = { .id = V4L2_CID_LINK_FREQ };
+	struct v4l2_querymenu qm = { .id = V4L2_CID_LINK_FREQ };
+	struct v4l2_subdev *sen_sd;
+	int ret;
+
+	*rate = 0;
+
+	sen_sd = csis_get_remote_subdev(state, __func__);
+	if (!sen_sd || !sen_sd->ctrl_handler ||
+	    !v4l2_ctrl_find(sen_sd->ctrl_handler, V4L2_CID_LINK_FREQ))
+		return 0;
+
+	ret = v4l2_g_ctrl(sen_sd->ctrl_handler, &ctrl);
+	if (ret)
+		return ret;
+
+	qm.index = ctrl.value;
+	ret = v4l2_querymenu(sen_sd->ctrl_handler, &qm);
+	if (ret)
+		return ret;
+
+	if (qm.value <= 0)
+		return -EINVAL;
+
+	*rate = div_u64(qm.value * 2, 1000000);
+
+	return 0;
+}
+
+/*
+ * Use the lane count of the sensor bus configuration, if it reports one.
+ * A sensor that fails get_mbus_config can not be received.
+ */
+static int mipi_csis_select_lanes(struct csi_state *state)
+{
+	struct v4l2_mbus_config cfg = { 0 };
+	struct media_pad *source_pad;
+	struct v4l2_subdev *sen_sd;
+	u32 lanes;
+	int ret;
+
+	state->num_lanes = state->num_lanes_dt;
+
+	source_pad = csis_get_remote_sensor_pad(state);
+	sen_sd = csis_get_remote_subdev(state, __func__);
+	if (!source_pad || !sen_sd)
+		return 0;
+
+	ret = v4l2_subdev_call(sen_sd, pad, get_mbus_config, source_pad->index,
+			       &cfg);
+	if (ret == -ENOIOCTLCMD)
+		return 0;
+	if (ret) {
+		v4l2_err(&state->sd, "%s: sensor bus configuration error %d\n",
+			 __func__, ret);
+		return ret;
+	}
+
+	if (cfg.type != V4L2_MBUS_CSI2_DPHY)
+		return 0;
+
+	lanes = cfg.bus.mipi_csi2.num_data_lanes;
+	if (lanes == 0 || lanes > state->max_num_lanes) {
+		v4l2_warn(&state->sd, "Unsupported number of data lanes: %u (max. %u)\n",
+			  lanes, state->max_num_lanes);
+		return 0;
+	}
+
+	state->num_lanes = lanes;
+
+	return 0;
+}
+
+/* Use the calibrated HS-settle of the current data rate, if there is one */
+static int mipi_csis_select_settle(struct csi_state *state)
+{
+	u32 rate;
+	int i, ret;
+
+	ret = mipi_csis_data_rate(state, &rate);
+	if (ret) {
+		v4l2_err(&state->sd, "%s: sensor link frequency error %d\n",
+			 __func__, ret);
+		return ret;
+	}
+
+	mutex_lock(&state->lock);
+
+	state->hs_settle = state->hs_settle_dt;
+	for (i = 0; rate && i < CSIS_SETTLE_CAL_RATES; i++) {
+		if (state->settle_cal[i].rate == rate) {
+			state->hs_settle = state->settle_cal[i].hs_settle;
+			break;
+		}
+	}
+
+	mutex_unlock(&state->lock);
+
+	v4l2_dbg(1, debug, &state->sd, "%u Mbps, %u lanes: hs_settle %u\n",
+		 rate, state->num_lanes, state->hs_settle);
+
+	return 0;
+}
+
+/*
+ * The gasket and the channel resolution are set from the CSIS format, so
+ * refuse to stream when the sensor went to another frame size (sensor side
+ * cropping, multi-area readout) after the last format set on the CSIS.
+ */
+static int mipi_csis_check_size(struct csi_state *state)
+{
+	struct v4l2_subdev_format fmt = {
+		.which = V4L2_SUBDEV_FORMAT_ACTIVE,
+	};
+	struct media_pad *source_pad;
+	struct v4l2_subdev *sen_sd;
+	int ret = 0;
+
+	source_pad = csis_get_remote_sensor_pad(state);
+	sen_sd = csis_get_remote_subdev(state, __func__);
+	if (!source_pad || !sen_sd)
+		return 0;
+
+	fmt.pad = source_pad->index;
+	if (v4l2_subdev_call(sen_sd, pad, get_fmt, NULL, &fmt) ||
+	    !fmt.format.width || !fmt.format.height)
+		return 0;
+
+	mutex_lock(&state->lock);
+
+	if (fmt.format.width != state->format.width ||
+	    fmt.format.height != state->format.height) {
+		v4l2_err(&state->sd, "sensor frame size %ux%u, CSIS format %ux%u\n",
+			 fmt.format.width, fmt.format.height,
+			 state->format.width, state->format.height);
+		ret = -EPIPE;
+	}
+
+	mutex_unlock(&state->lock);
+
+	return ret;
+}
+
+static int mipi_csis_start_stream(struct csi_state *state)
 {
+	int ret;
+
+	ret = mipi_csis_check_size(state);
+	if (ret)
+		return ret;
+
+	ret = mipi_csis_select_lanes(state);
+	if (ret)
+		return ret;
+
+	ret = mipi_csis_select_settle(state);
+	if (ret)
+		return ret;
+
 	mipi_csis_sw_reset(state);
 
 	disp_mix_gasket_config(state);
@@ -1050,6 +1472,8 @@ static void mipi_csis_start_stream(struct csi_state *state)
 	mipi_csis_enable_interrupts(state, true);
 
 	msleep(5);
+
+	return 0;
 }
 
 static void mipi_csis_stop_stream(struct csi_state *state)
@@ -1064,26 +1488,113 @@ static void mipi_csis_clear_counters(struct csi_state *state)
 	unsigned long flags;
 	int i;
 
-	spin_lock_irqsave(&state->slock, flags);
 	for (i = 0; i < MIPI_CSIS_NUM_EVENTS; i++)
-		state->events[i].counter = 0;
+		atomic64_set(&state->events[i], 0);
+	state->irq_max_ns = 0;
+	state->sequence = 0;
+	if (state->emb_ring)
+		WRITE_ONCE(state->emb_ring->head, 0);
+
+	spin_lock_irqsave(&state->slock, flags);
+	state->irq_status = 0;
+	state->irq_pkt_pending = false;
+	state->pkt_overruns = 0;
 	spin_unlock_irqrestore(&state->slock, flags);
+
+	spin_lock_irqsave(&mipi_csis_fs_lock, flags);
+	state->fs_ts = 0;
+	state->frame_us = 0;
+	state->skew_valid = false;
+	state->skew_max_us = 0;
+	state->fi_head = 0;
+	state->fi_count = 0;
+	state->fi_avg_us = 0;
+	state->late_frames = 0;
+	state->late_run = 0;
+	state->stream_ts = ktime_get();
+	spin_unlock_irqrestore(&mipi_csis_fs_lock, flags);
+}
+
+/* Called with mipi_csis_fs_lock held */
+static void mipi_csis_record_interval(struct csi_state *state, u32 us)
+{
+	state->fi_us[state->fi_head] = us;
+	state->fi_head = (state->fi_head + 1) % CSIS_FI_WINDOW;
+	if (state->fi_count < CSIS_FI_WINDOW)
+		state->fi_count++;
+
+	if (!state->fi_avg_us) {
+		state->fi_avg_us = us;
+	} else if (2 * us > 3 * state->fi_avg_us) {
+		state->late_frames++;
+		/*
+		 * A run of late frames means the sensor was slowed down
+		 * (S_FPS, AFPS), not that frames were dropped.
+		 */
+		if (++state->late_run >= CSIS_FI_RESEED) {
+			state->late_frames -= state->late_run;
+			state->late_run = 0;
+			state->fi_avg_us = us;
+		}
+	} else {
+		state->late_run = 0;
+		/* running average over ~8 frames */
+		state->fi_avg_us = state->fi_avg_us - state->fi_avg_us / 8 + us / 8;
+	}
+}
+
+/*
+ * Skew of this frame start to the closest frame start of another
+ * streaming instance. Only meaningful for sensors sharing XVS.
+ */
+static void mipi_csis_measure_skew(struct csi_state *state, ktime_t now)
+{
+	struct csi_state *other;
+	s64 skew;
+	int i;
+
+	spin_lock(&mipi_csis_fs_lock);
+
+	if (state->fs_ts) {
+		state->frame_us = ktime_us_delta(now, state->fs_ts);
+		mipi_csis_record_interval(state, state->frame_us);
+	}
+	state->fs_ts = now;
+
+	for (i = 0; i < CSIS_MAX_ENTITIES; i++) {
+		other = mipi_csis_instances[i];
+		if (!other || other == state || !other->fs_ts ||
+		    !state->frame_us)
+			continue;
+
+		skew = ktime_us_delta(now, other->fs_ts);
+		/* other instance is not streaming */
+		if (skew > 2 * state->frame_us)
+			continue;
+		/* closer to the next frame start of the other instance */
+		if (skew > state->frame_us / 2)
+			skew -= state->frame_us;
+
+		state->skew_us = skew;
+		state->skew_max_us = max(state->skew_max_us, abs(skew));
+		state->skew_valid = true;
+		break;
+	}
+
+	spin_unlock(&mipi_csis_fs_lock);
 }
 
 static void mipi_csis_log_counters(struct csi_state *state, bool non_errors)
 {
 	int i = non_errors ? MIPI_CSIS_NUM_EVENTS : MIPI_CSIS_NUM_EVENTS - 4;
-	unsigned long flags;
-
-	spin_lock_irqsave(&state->slock, flags);
+	s64 counter;
 
 	for (i--; i >= 0; i--) {
-		if (state->events[i].counter > 0 || debug)
-			v4l2_info(&state->sd, "%s events: %d\n",
-				  state->events[i].name,
-				  state->events[i].counter);
+		counter = atomic64_read(&state->events[i]);
+		if (counter > 0 || debug)
+			v4l2_info(&state->sd, "%s events: %lld\n",
+				  mipi_csis_events[i].name, counter);
 	}
-	spin_unlock_irqrestore(&state->slock, flags);
 }
 
 static int mipi_csi2_link_setup(struct media_entity *entity,
@@ -1118,6 +1629,7 @@ static int mipi_csis_s_power(struct v4l2_subdev *mipi_sd, int on)
 static int mipi_csis_s_stream(struct v4l2_subdev *mipi_sd, int enable)
 {
 	struct csi_state *state = mipi_sd_to_csi_state(mipi_sd);
+	int ret;
 
 	v4l2_dbg(1, debug, mipi_sd, "%s: %d, state: 0x%x\n",
 		 __func__, enable, state->flags);
@@ -1125,14 +1637,29 @@ static int mipi_csis_s_stream(struct v4l2_subdev *mipi_sd, int enable)
 	if (enable) {
 		pm_runtime_get_sync(state->dev);
 		mipi_csis_clear_counters(state);
-		mipi_csis_start_stream(state);
+		ret = mipi_csis_start_stream(state);
+		if (ret) {
+			pm_runtime_mark_last_busy(state->dev);
+			pm_runtime_put_autosuspend(state->dev);
+			return ret;
+		}
 		dump_csis_regs(state, __func__);
 		dump_gasket_regs(state, __func__);
+		mutex_lock(&state->lock);
+		state->stream_count++;
+		state->streaming = true;
+		if (state->regs_snap)
+			mipi_csis_snapshot_regs(state, state->regs_snap);
+		mutex_unlock(&state->lock);
 	} else {
 		mipi_csis_stop_stream(state);
+		mutex_lock(&state->lock);
+		state->streaming = false;
+		mutex_unlock(&state->lock);
 		if (debug > 0)
 			mipi_csis_log_counters(state, true);
-		pm_runtime_put(state->dev);
+		pm_runtime_mark_last_busy(state->dev);
+		pm_runtime_put_autosuspend(state->dev);
 	}
 
 	return 0;
@@ -1176,8 +1703,16 @@ static int mipi_csis_set_fmt(struct v4l2_subdev *mipi_sd,
 		mf->code = csis_fmt->code;
 	}
 
+	mutex_lock(&state->lock);
 	state->csis_fmt = csis_fmt;
 
+	/* the sensor returns the size it will send, cropping included */
+	if (format->which == V4L2_SUBDEV_FORMAT_ACTIVE) {
+		state->format.width = mf->width;
+		state->format.height = mf->height;
+	}
+	mutex_unlock(&state->lock);
+
 	return 0;
 }
 
@@ -1301,9 +1836,21 @@ static int mipi_csis_enum_frameintervals(struct v4l2_subdev *mipi_sd,
 static int mipi_csis_log_status(struct v4l2_subdev *mipi_sd)
 {
 	struct csi_state *state = mipi_sd_to_csi_state(mipi_sd);
+	int i;
 
 	mutex_lock(&state->lock);
 	mipi_csis_log_counters(state, true);
+	if (state->resume_latency_us > 0)
+		v4l2_info(&state->sd, "resume to first frame: %lld us, max %lld us\n",
+			  state->resume_latency_us, state->resume_latency_max_us);
+	if (state->skew_valid)
+		v4l2_info(&state->sd, "frame start skew: %lld us, max %lld us\n",
+			  state->skew_us, state->skew_max_us);
+	v4l2_info(&state->sd, "hard irq time max: %lld ns\n", state->irq_max_ns);
+	v4l2_info(&state->sd, "packet overruns: %u\n", state->pkt_overruns);
+	for (i = 0; i < state->num_routes; i++)
+		v4l2_info(&state->sd, "channel %d: vc %u, dt %#x\n", i,
+			  state->routes[i].vc, state->routes[i].fmt_reg >> 2);
 	if (debug) {
 		dump_csis_regs(state, __func__);
 		dump_gasket_regs(state, __func__);
@@ -1404,13 +1951,29 @@ static int csis_ioc_qcap(struct v4l2_subdev *dev, void *args)
 #define USER_TO_KERNEL(TYPE)
 #define KERNEL_TO_USER(TYPE)
 #endif
+/* Commands that only query or forward to the sensor leave the CSIS idle */
+static bool csis_ioctl_needs_pm(unsigned int cmd)
+{
+	switch (cmd) {
+	case VVCSIOC_RESET:
+	case VVCSIOC_STREAMON:
+	case VVCSIOC_STREAMOFF:
+	case VVCSIOC_S_FMT:
+		return true;
+	default:
+		return false;
+	}
+}
+
 static long csis_priv_ioctl(struct v4l2_subdev *sd, unsigned int cmd, void *arg_user)
 {
 	int ret = 1;
 	struct csi_state *state = container_of(sd, struct csi_state, sd);
 	void *arg = arg_user;
+	bool pm = csis_ioctl_needs_pm(cmd);
 
-	pm_runtime_get_sync(state->dev);
+	if (pm)
+		pm_runtime_get_sync(state->dev);
 
 	switch (cmd) {
 	case VVCSIOC_RESET:
@@ -1447,16 +2010,34 @@ static long csis_priv_ioctl(struct v4l2_subdev *sd, unsigned int cmd, void *arg_
 		ret = -EINVAL;
 		break;
 	}
-	pm_runtime_put(state->dev);
+
+	if (pm) {
+		pm_runtime_mark_last_busy(state->dev);
+		pm_runtime_put_autosuspend(state->dev);
+	}
 
 	return ret;
 }
 
 
+static int mipi_csis_subscribe_event(struct v4l2_subdev *sd,
+				     struct v4l2_fh *fh,
+				     struct v4l2_event_subscription *sub)
+{
+	switch (sub->type) {
+	case V4L2_EVENT_FRAME_SYNC:
+		return v4l2_event_subscribe(fh, sub, 4, NULL);
+	default:
+		return -EINVAL;
+	}
+}
+
 static struct v4l2_subdev_core_ops mipi_csis_core_ops = {
 	.s_power = mipi_csis_s_power,
 	.log_status = mipi_csis_log_status,
 	.ioctl = csis_priv_ioctl,
+	.subscribe_event = mipi_csis_subscribe_event,
+	.unsubscribe_event = v4l2_event_subdev_unsubscribe,
 };
 
 static struct v4l2_subdev_video_ops mipi_csis_video_ops = {
@@ -1480,48 +2061,703 @@ static struct v4l2_subdev_ops mipi_csis_subdev_ops = {
 	.pad = &mipi_csis_pad_ops,
 };
 
+/* Packet RAM holding the non-image data of an even or odd frame */
+static void __iomem *mipi_csis_pktdata(struct csi_state *state, u32 status)
+{
+	if (status & MIPI_CSIS_INTSRC_EVEN)
+		return state->regs + MIPI_CSIS_PKTDATA_EVEN;
+
+	return state->regs + MIPI_CSIS_PKTDATA_ODD;
+}
+
+/* Copy the non-image data of a frame to the next ring slot */
+static void mipi_csis_emb_push(struct csi_state *state,
+			       const struct csis_emb_data *emb)
+{
+	struct csis_emb_ring *ring = state->emb_ring;
+	struct csis_emb_slot *slot;
+
+	slot = &ring->slot[ring->head % CSIS_EMB_RING_SLOTS];
+
+	WRITE_ONCE(slot->seq, slot->seq + 1);
+	smp_wmb();
+
+	slot->sequence = emb->sequence;
+	slot->timestamp = ktime_to_ns(emb->timestamp);
+	slot->len = emb->len;
+	memcpy(slot->data, emb->data, emb->len);
+
+	smp_wmb();
+	WRITE_ONCE(slot->seq, slot->seq + 1);
+	WRITE_ONCE(ring->head, ring->head + 1);
+}
+
+static bool mipi_csis_emb_active(struct csi_state *state)
+{
+	return state->emb_buf && state->emb_ring &&
+	       atomic_read(&state->emb_users);
+}
+
+/*
+ * Copy the non-image data packet of frame seq out of the packet RAM, in the
+ * irq thread. The even and odd packet RAMs alternate, so the packet stays
+ * until the one of frame seq + 2 arrives. A copy that ends after that frame
+ * started may mix two frames and is dropped.
+ */
+static void mipi_csis_copy_pkt(struct csi_state *state, u32 status, u32 seq,
+			       ktime_t ts, u32 *pkt_data, unsigned int pkt_len)
+{
+	void __iomem *pktdata = mipi_csis_pktdata(state, status);
+	struct csis_emb_data emb = {
+		.sequence = seq,
+		.timestamp = ts,
+		.data = state->emb_buf,
+		.len = min_t(u32, emb_data_len, CSIS_EMB_DATA_SIZE),
+	};
+	bool emb_active = mipi_csis_emb_active(state);
+	unsigned long flags;
+
+	if (pkt_data)
+		memcpy_fromio(pkt_data, pktdata, pkt_len);
+	if (emb_active)
+		memcpy_fromio(state->emb_buf, pktdata, emb.len);
+
+	if (READ_ONCE(state->sequence) - 1 - seq >= 2) {
+		state->pkt_overruns++;
+		return;
+	}
+
+	if (pkt_data) {
+		spin_lock_irqsave(&state->slock, flags);
+		if (state->pkt_buf.data == pkt_data)
+			state->pkt_buf.data = NULL;
+		spin_unlock_irqrestore(&state->slock, flags);
+	}
+
+	if (emb_active)
+		mipi_csis_emb_push(state, &emb);
+}
+
+static void mipi_csis_init_event_map(void)
+{
+	int i;
+
+	for (i = 0; i < MIPI_CSIS_NUM_EVENTS; i++)
+		mipi_csis_event_map[__ffs(mipi_csis_events[i].mask)] = i + 1;
+}
+
+static void mipi_csis_queue_frame_sync(struct csi_state *state)
+{
+	struct v4l2_event ev = {
+		.type = V4L2_EVENT_FRAME_SYNC,
+		.u.frame_sync.frame_sequence = state->sequence - 1,
+	};
+
+	if (state->sd.devnode)
+		v4l2_event_queue(state->sd.devnode, &ev);
+}
+
+/*
+ * Hard irq part: acknowledge and latch the status and timestamp frame
+ * starts. The packet RAM copy, the notifiers and the event accounting run
+ * in the irq thread, the status, frame start and packet are handed over
+ * together under state->slock.
+ */
 static irqreturn_t mipi_csis_irq_handler(int irq, void *dev_id)
 {
 	struct csi_state *state = dev_id;
-	struct csis_pktbuf *pktbuf = &state->pkt_buf;
-	unsigned long flags;
+	ktime_t start = ktime_get();
+	irqreturn_t ret = IRQ_HANDLED;
 	u32 status;
+	s64 ns;
 
 	status = mipi_csis_read(state, MIPI_CSIS_INTSRC);
+	mipi_csis_write(state, MIPI_CSIS_INTSRC, status);
 
-	spin_lock_irqsave(&state->slock, flags);
-	if ((status & MIPI_CSIS_INTSRC_NON_IMAGE_DATA) && pktbuf->data) {
-		u32 offset;
+	spin_lock(&state->slock);
 
-		if (status & MIPI_CSIS_INTSRC_EVEN)
-			offset = MIPI_CSIS_PKTDATA_EVEN;
-		else
-			offset = MIPI_CSIS_PKTDATA_ODD;
+	if (status & MIPI_CSIS_INTSRC_FRAME_START) {
+		state->irq_ts = start;
+		state->sequence++;
+		mipi_csis_measure_skew(state, start);
+		mipi_csis_queue_frame_sync(state);
+	}
+
+	if ((status & MIPI_CSIS_INTSRC_NON_IMAGE_DATA) &&
+	    (state->pkt_buf.data || mipi_csis_emb_active(state))) {
+		state->irq_pkt_status = status;
+		state->irq_pkt_seq = state->sequence - 1;
+		state->irq_pkt_ts = state->irq_ts;
+		state->irq_pkt_pending = true;
+	}
+
+	if (state->irq_pkt_pending ||
+	    (status & MIPI_CSIS_INTSRC_ERRORS) || debug ||
+	    ((status & MIPI_CSIS_INTSRC_FRAME_START) &&
+	     (atomic64_read(&state->resume_ts) ||
+	      atomic_read(&state->fs_users)))) {
+		state->irq_status |= status;
+		if (status & MIPI_CSIS_INTSRC_FRAME_START) {
+			state->irq_fs_ts = start;
+			state->irq_fs_seq = state->sequence - 1;
+		}
+		ret = IRQ_WAKE_THREAD;
+	}
+
+	spin_unlock(&state->slock);
 
-		memcpy(pktbuf->data, state->regs + offset, pktbuf->len);
-		pktbuf->data = NULL;
-		rmb();
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	if (ns > state->irq_max_ns)
+		state->irq_max_ns = ns;
+
+	return ret;
+}
+
+static irqreturn_t mipi_csis_irq_thread(int irq, void *dev_id)
+{
+	struct csi_state *state = dev_id;
+	unsigned long flags;
+	u32 status, pending, fs_seq, pkt_status, pkt_seq;
+	ktime_t fs_ts, pkt_ts;
+	unsigned int pkt_len;
+	u32 *pkt_data;
+	bool pkt;
+	s64 resume_ts;
+	int i;
+
+	spin_lock_irqsave(&state->slock, flags);
+	status = state->irq_status;
+	state->irq_status = 0;
+	fs_ts = state->irq_fs_ts;
+	fs_seq = state->irq_fs_seq;
+	pkt = state->irq_pkt_pending;
+	state->irq_pkt_pending = false;
+	pkt_status = state->irq_pkt_status;
+	pkt_seq = state->irq_pkt_seq;
+	pkt_ts = state->irq_pkt_ts;
+	pkt_data = state->pkt_buf.data;
+	pkt_len = state->pkt_buf.len;
+	spin_unlock_irqrestore(&state->slock, flags);
+
+	if ((status & MIPI_CSIS_INTSRC_FRAME_START) &&
+	    atomic_read(&state->fs_users))
+		blocking_notifier_call_chain(&state->fs_notifier, fs_seq, &fs_ts);
+
+	if (status & MIPI_CSIS_INTSRC_FRAME_START) {
+		resume_ts = atomic64_xchg(&state->resume_ts, 0);
+		if (resume_ts) {
+			state->resume_latency_us =
+				ktime_us_delta(fs_ts, ns_to_ktime(resume_ts));
+			state->resume_latency_max_us =
+				max(state->resume_latency_max_us,
+				    state->resume_latency_us);
+			dev_dbg(state->dev, "resume to first frame: %lld us\n",
+				state->resume_latency_us);
+		}
 	}
 
+	if (pkt)
+		mipi_csis_copy_pkt(state, pkt_status, pkt_seq, pkt_ts,
+				   pkt_data, pkt_len);
+
 	/* Update the event/error counters */
 	if ((status & MIPI_CSIS_INTSRC_ERRORS) || debug) {
-		int i;
-		for (i = 0; i < MIPI_CSIS_NUM_EVENTS; i++) {
-			if (!(status & state->events[i].mask))
+		pending = status;
+		while (pending) {
+			i = __ffs(pending);
+			pending &= pending - 1;
+			if (!mipi_csis_event_map[i])
 				continue;
-			state->events[i].counter++;
-			v4l2_dbg(2, debug, &state->sd, "%s: %d\n",
-				 state->events[i].name,
-				 state->events[i].counter);
+			i = mipi_csis_event_map[i] - 1;
+			atomic64_inc(&state->events[i]);
+			v4l2_dbg(2, debug, &state->sd, "%s: %lld\n",
+				 mipi_csis_events[i].name,
+				 atomic64_read(&state->events[i]));
 		}
 		v4l2_dbg(2, debug, &state->sd, "status: %08x\n", status);
 	}
-	spin_unlock_irqrestore(&state->slock, flags);
 
-	mipi_csis_write(state, MIPI_CSIS_INTSRC, status);
 	return IRQ_HANDLED;
 }
 
+static struct csi_state *mipi_csis_find_by_sensor(struct device *sensor)
+{
+	struct csi_state *state = NULL;
+	unsigned long flags;
+	int i;
+
+	spin_lock_irqsave(&mipi_csis_fs_lock, flags);
+	for (i = 0; i < CSIS_MAX_ENTITIES; i++) {
+		if (mipi_csis_instances[i] &&
+		    mipi_csis_instances[i]->src_node == sensor->of_node) {
+			state = mipi_csis_instances[i];
+			break;
+		}
+	}
+	spin_unlock_irqrestore(&mipi_csis_fs_lock, flags);
+
+	return state;
+}
+
+int mipi_csis_frame_sync_register(struct device *sensor,
+				  struct notifier_block *nb)
+{
+	struct csi_state *state = mipi_csis_find_by_sensor(sensor);
+	int ret;
+
+	if (!state)
+		return -ENODEV;
+
+	ret = blocking_notifier_chain_register(&state->fs_notifier, nb);
+	if (!ret)
+		atomic_inc(&state->fs_users);
+
+	return ret;
+}
+EXPORT_SYMBOL(mipi_csis_frame_sync_register);
+
+void mipi_csis_frame_sync_unregister(struct device *sensor,
+				     struct notifier_block *nb)
+{
+	struct csi_state *state = mipi_csis_find_by_sensor(sensor);
+
+	if (!state)
+		return;
+
+	if (!blocking_notifier_chain_unregister(&state->fs_notifier, nb))
+		atomic_dec(&state->fs_users);
+}
+EXPORT_SYMBOL(mipi_csis_frame_sync_unregister);
+
+static int mipi_csis_emb_open(struct inode *inode, struct file *file)
+{
+	struct csi_state *state = container_of(file->private_data,
+					       struct csi_state, emb_misc);
+
+	file->private_data = state;
+	atomic_inc(&state->emb_users);
+
+	return 0;
+}
+
+static int mipi_csis_emb_release(struct inode *inode, struct file *file)
+{
+	struct csi_state *state = file->private_data;
+
+	atomic_dec(&state->emb_users);
+
+	return 0;
+}
+
+static int mipi_csis_emb_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct csi_state *state = file->private_data;
+
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+	vm_flags_clear(vma, VM_MAYWRITE);
+
+	return remap_vmalloc_range(vma, state->emb_ring, vma->vm_pgoff);
+}
+
+static const struct file_operations mipi_csis_emb_fops = {
+	.owner = THIS_MODULE,
+	.open = mipi_csis_emb_open,
+	.release = mipi_csis_emb_release,
+	.mmap = mipi_csis_emb_mmap,
+};
+
+static void mipi_csis_emb_init(struct csi_state *state)
+{
+	struct csis_emb_ring *ring;
+	int ret;
+
+	state->emb_buf = devm_kzalloc(state->dev, CSIS_EMB_DATA_SIZE, GFP_KERNEL);
+
+	ring = vmalloc_user(PAGE_ALIGN(sizeof(*ring)));
+	if (!ring) {
+		dev_warn(state->dev, "no memory for the embedded data ring\n");
+		return;
+	}
+
+	ring->num_slots = CSIS_EMB_RING_SLOTS;
+	ring->slot_size = sizeof(struct csis_emb_slot);
+
+	snprintf(state->emb_name, sizeof(state->emb_name), "csis-emb%d",
+		 state->index);
+	state->emb_misc.minor = MISC_DYNAMIC_MINOR;
+	state->emb_misc.name = state->emb_name;
+	state->emb_misc.fops = &mipi_csis_emb_fops;
+	state->emb_misc.parent = state->dev;
+
+	ret = misc_register(&state->emb_misc);
+	if (ret) {
+		dev_warn(state->dev, "embedded data device register failed\n");
+		vfree(ring);
+		return;
+	}
+
+	state->emb_ring = ring;
+}
+
+static void mipi_csis_emb_cleanup(struct csi_state *state)
+{
+	if (!state->emb_ring)
+		return;
+
+	misc_deregister(&state->emb_misc);
+	vfree(state->emb_ring);
+	state->emb_ring = NULL;
+}
+
+static u32 mipi_csis_fmt_bpp(const struct csis_pix_format *csis_fmt)
+{
+	switch (csis_fmt->fmt_reg) {
+	case MIPI_CSIS_ISPCFG_FMT_RAW8:
+		return 8;
+	case MIPI_CSIS_ISPCFG_FMT_RAW10:
+		return 10;
+	case MIPI_CSIS_ISPCFG_FMT_RAW12:
+		return 12;
+	case MIPI_CSIS_ISPCFG_FMT_RGB888:
+		return 24;
+	default:
+		return 16;
+	}
+}
+
+static int mipi_csis_cmp_u32(const void *a, const void *b)
+{
+	u32 x = *(const u32 *)a;
+	u32 y = *(const u32 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static int mipi_csis_stats_show(struct seq_file *s, void *data)
+{
+	struct csi_state *state = s->private;
+	u32 jitter[CSIS_FI_WINDOW];
+	u32 count, late, avg, mean, fps, width, height, bpp;
+	u64 sum = 0, elapsed_us, bytes, counter, rate;
+	unsigned long flags;
+	int i;
+
+	/* set_fmt updates the format and csis_fmt under state->lock */
+	mutex_lock(&state->lock);
+	width = state->format.width;
+	height = state->format.height;
+	bpp = mipi_csis_fmt_bpp(state->csis_fmt);
+	mutex_unlock(&state->lock);
+
+	spin_lock_irqsave(&mipi_csis_fs_lock, flags);
+	count = state->fi_count;
+	late = state->late_frames;
+	avg = state->fi_avg_us;
+	memcpy(jitter, state->fi_us, count * sizeof(jitter[0]));
+	elapsed_us = ktime_us_delta(ktime_get(), state->stream_ts);
+	spin_unlock_irqrestore(&mipi_csis_fs_lock, flags);
+
+	for (i = 0; i < count; i++)
+		sum += jitter[i];
+	mean = count ? div_u64(sum, count) : 0;
+	fps = mean ? 100000000U / mean : 0;
+
+	/* jitter is the distance of an interval from the window mean */
+	for (i = 0; i < count; i++)
+		jitter[i] = abs((s32)(jitter[i] - mean));
+	sort(jitter, count, sizeof(jitter[0]), mipi_csis_cmp_u32, NULL);
+
+	bytes = (u64)width * height * bpp / 8;
+
+	seq_printf(s, "frames:          %u\n", state->sequence);
+	seq_printf(s, "fps:             %u.%02u\n", fps / 100, fps % 100);
+	seq_printf(s, "interval:        %u us (nominal %u us)\n", mean, avg);
+	if (count) {
+		seq_printf(s, "jitter p50:      %u us\n", jitter[(count - 1) * 50 / 100]);
+		seq_printf(s, "jitter p90:      %u us\n", jitter[(count - 1) * 90 / 100]);
+		seq_printf(s, "jitter p99:      %u us\n", jitter[(count - 1) * 99 / 100]);
+		seq_printf(s, "jitter max:      %u us\n", jitter[count - 1]);
+	}
+	seq_printf(s, "late frames:     %u (> 1.5x nominal)\n", late);
+	seq_printf(s, "hard irq max:    %lld ns\n", state->irq_max_ns);
+	seq_printf(s, "pkt overruns:    %u\n", state->pkt_overruns);
+	seq_printf(s, "pm resumes:      %u (max %lld us)\n", state->pm_resumes,
+		   state->pm_resume_max_us);
+	seq_printf(s, "pm suspends:     %u\n", state->pm_suspends);
+	seq_printf(s, "resume to frame: %lld us (max %lld us)\n",
+		   state->resume_latency_us, state->resume_latency_max_us);
+	seq_printf(s, "bytes per frame: %llu (%ux%u, %u bpp)\n", bytes,
+		   width, height, bpp);
+
+	for (i = 0; i < MIPI_CSIS_NUM_EVENTS; i++) {
+		counter = atomic64_read(&state->events[i]);
+		if (!(mipi_csis_events[i].mask & MIPI_CSIS_INTSRC_ERRORS))
+			continue;
+		rate = elapsed_us ? div64_u64(counter * 100000000ULL, elapsed_us) : 0;
+		seq_printf(s, "%-24s %llu (%llu.%02llu/s)\n",
+			   mipi_csis_events[i].name, counter,
+			   div_u64(rate, 100), rate % 100);
+	}
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(mipi_csis_stats);
+
+static u64 mipi_csis_error_count(struct csi_state *state, u32 mask)
+{
+	u64 count = 0;
+	int i;
+
+	for (i = 0; i < MIPI_CSIS_NUM_EVENTS; i++)
+		if (mipi_csis_events[i].mask & mask)
+			count += atomic64_read(&state->events[i]);
+
+	return count;
+}
+
+static void mipi_csis_apply_settle(struct csi_state *state, u32 hs_settle)
+{
+	u32 val;
+
+	state->hs_settle = hs_settle;
+	mipi_csis_set_hsync_settle(state);
+
+	val = mipi_csis_read(state, MIPI_CSIS_CMN_CTRL);
+	val |= MIPI_CSIS_CMN_CTRL_UPDATE_SHADOW;
+	mipi_csis_write(state, MIPI_CSIS_CMN_CTRL, val);
+}
+
+static void mipi_csis_store_settle(struct csi_state *state, u32 rate,
+				   u32 hs_settle)
+{
+	int i, slot = -1;
+
+	for (i = 0; i < CSIS_SETTLE_CAL_RATES; i++) {
+		if (state->settle_cal[i].rate == rate) {
+			slot = i;
+			break;
+		}
+		if (slot < 0 && !state->settle_cal[i].rate)
+			slot = i;
+	}
+
+	/* table full, replace the oldest entry */
+	if (slot < 0) {
+		memmove(&state->settle_cal[0], &state->settle_cal[1],
+			sizeof(state->settle_cal) - sizeof(state->settle_cal[0]));
+		slot = CSIS_SETTLE_CAL_RATES - 1;
+	}
+
+	state->settle_cal[slot].rate = rate;
+	state->settle_cal[slot].hs_settle = hs_settle;
+}
+
+/*
+ * Sweep the whole HS-settle range while the sensor streams its test pattern
+ * and keep the middle of the widest window without ECC, CRC and SOT errors.
+ * Called with the stream running.
+ */
+static int mipi_csis_calibrate_settle(struct csi_state *state, u32 rate)
+{
+	const u32 err_mask = MIPI_CSIS_INTSRC_ERR_ECC | MIPI_CSIS_INTSRC_ERR_CRC |
+			     MIPI_CSIS_INTSRC_ERR_SOT_HS;
+	struct v4l2_subdev *sen_sd;
+	struct v4l2_ctrl *pattern = NULL;
+	u32 hs_settle = state->hs_settle;
+	u32 start = 0, best_start = 0, best_len = 0, len = 0;
+	u32 dwell_ms, seq, settle;
+	u64 errors;
+	s32 old_pattern = 0;
+	int ret = 0;
+
+	sen_sd = csis_get_remote_subdev(state, __func__);
+	if (!sen_sd)
+		return -ENODEV;
+
+	if (!rate) {
+		ret = mipi_csis_data_rate(state, &rate);
+		if (ret)
+			return ret;
+	}
+	if (!rate) {
+		v4l2_err(&state->sd, "%s: unknown data rate\n", __func__);
+		return -EINVAL;
+	}
+
+	mutex_lock(&state->lock);
+	if (state->settle_cal_busy) {
+		mutex_unlock(&state->lock);
+		return -EBUSY;
+	}
+	state->settle_cal_busy = true;
+	mutex_unlock(&state->lock);
+
+	if (sen_sd->ctrl_handler)
+		pattern = v4l2_ctrl_find(sen_sd->ctrl_handler,
+					 V4L2_CID_TEST_PATTERN);
+	if (pattern) {
+		old_pattern = v4l2_ctrl_g_ctrl(pattern);
+		v4l2_ctrl_s_ctrl(pattern, 1);
+	} else {
+		v4l2_warn(&state->sd, "%s: no test pattern, using live image\n",
+			  __func__);
+	}
+
+	dwell_ms = max_t(u32, CSIS_SETTLE_DWELL_MS,
+			 4 * READ_ONCE(state->fi_avg_us) / 1000);
+
+	/*
+	 * The lock is only taken to program each step, so that s_stream and
+	 * the other subdev ops are not blocked across the dwell time.
+	 */
+	for (settle = 0; settle <= CSIS_HS_SETTLE_MAX; settle++) {
+		mutex_lock(&state->lock);
+		mipi_csis_apply_settle(state, settle);
+		mutex_unlock(&state->lock);
+		msleep(dwell_ms / 2);
+
+		seq = READ_ONCE(state->sequence);
+		errors = mipi_csis_error_count(state, err_mask);
+		msleep(dwell_ms);
+
+		if (READ_ONCE(state->sequence) - seq >= 2 &&
+		    mipi_csis_error_count(state, err_mask) == errors) {
+			if (!len++)
+				start = settle;
+			if (len > best_len) {
+				best_len = len;
+				best_start = start;
+			}
+		} else {
+			len = 0;
+		}
+
+		v4l2_dbg(1, debug, &state->sd, "hs_settle %u: %s\n", settle,
+			 len ? "ok" : "errors");
+	}
+
+	mutex_lock(&state->lock);
+	if (best_len) {
+		hs_settle = best_start + best_len / 2;
+		mipi_csis_store_settle(state, rate, hs_settle);
+		v4l2_info(&state->sd, "%u Mbps: hs_settle %u (window %u-%u)\n",
+			  rate, hs_settle, best_start, best_start + best_len - 1);
+	} else {
+		v4l2_err(&state->sd, "%u Mbps: no error free hs_settle\n", rate);
+		ret = -EIO;
+	}
+	mipi_csis_apply_settle(state, hs_settle);
+	state->settle_cal_busy = false;
+	mutex_unlock(&state->lock);
+
+	if (pattern)
+		v4l2_ctrl_s_ctrl(pattern, old_pattern);
+
+	return ret;
+}
+
+static int mipi_csis_settle_show(struct seq_file *s, void *data)
+{
+	struct csi_state *state = s->private;
+	int i;
+
+	mutex_lock(&state->lock);
+	seq_printf(s, "dt:      %u\n", state->hs_settle_dt);
+	seq_printf(s, "current: %u\n", state->hs_settle);
+	for (i = 0; i < CSIS_SETTLE_CAL_RATES; i++)
+		if (state->settle_cal[i].rate)
+			seq_printf(s, "%u Mbps: %u\n", state->settle_cal[i].rate,
+				   state->settle_cal[i].hs_settle);
+	mutex_unlock(&state->lock);
+
+	return 0;
+}
+
+static int mipi_csis_settle_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, mipi_csis_settle_show, inode->i_private);
+}
+
+/* Write a data rate in Mbps per lane, or 0 for the sensor rate, to calibrate */
+static ssize_t mipi_csis_settle_write(struct file *file,
+				      const char __user *buf,
+				      size_t count, loff_t *ppos)
+{
+	struct csi_state *state = file_inode(file)->i_private;
+	u32 rate;
+	int ret;
+
+	ret = kstrtou32_from_user(buf, count, 0, &rate);
+	if (ret)
+		return ret;
+
+	if (pm_runtime_get_if_in_use(state->dev) <= 0)
+		return -ENODEV;
+
+	ret = mipi_csis_calibrate_settle(state, rate);
+	pm_runtime_mark_last_busy(state->dev);
+	pm_runtime_put_autosuspend(state->dev);
+
+	return ret ? ret : count;
+}
+
+static const struct file_operations mipi_csis_settle_fops = {
+	.owner = THIS_MODULE,
+	.open = mipi_csis_settle_open,
+	.read = seq_read,
+	.write = mipi_csis_settle_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+/* Snapshot of the current register values, taken at open */
+static int mipi_csis_regs_open(struct inode *inode, struct file *file)
+{
+	struct csi_state *state = inode->i_private;
+	struct csis_regs_snapshot *snap;
+
+	if (pm_runtime_get_if_active(state->dev, true) <= 0)
+		return -ENODEV;
+
+	snap = kzalloc(CSIS_SNAP_SIZE, GFP_KERNEL);
+	if (snap) {
+		mutex_lock(&state->lock);
+		mipi_csis_snapshot_regs(state, snap);
+		mutex_unlock(&state->lock);
+	}
+
+	pm_runtime_mark_last_busy(state->dev);
+	pm_runtime_put_autosuspend(state->dev);
+
+	if (!snap)
+		return -ENOMEM;
+
+	file->private_data = snap;
+	return nonseekable_open(inode, file);
+}
+
+static ssize_t mipi_csis_regs_read(struct file *file, char __user *buf,
+				   size_t count, loff_t *ppos)
+{
+	return simple_read_from_buffer(buf, count, ppos, file->private_data,
+				       CSIS_SNAP_SIZE);
+}
+
+static int mipi_csis_regs_release(struct inode *inode, struct file *file)
+{
+	kfree(file->private_data);
+	return 0;
+}
+
+static const struct file_operations mipi_csis_regs_fops = {
+	.owner = THIS_MODULE,
+	.open = mipi_csis_regs_open,
+	.read = mipi_csis_regs_read,
+	.llseek = no_llseek,
+	.release = mipi_csis_regs_release,
+};
+
 static int mipi_csis_parse_dt(struct platform_device *pdev,
 			    struct csi_state *state)
 {
@@ -1543,11 +2779,15 @@ static int mipi_csis_parse_dt(struct platform_device *pdev,
 
 	/* Get MIPI CSI-2 bus configration from the endpoint node. */
 	of_property_read_u32(node, "csis-hs-settle", &state->hs_settle);
+	state->hs_settle_dt = state->hs_settle;
 	of_property_read_u32(node, "csis-clk-settle", &state->clk_settle);
 	of_property_read_u32(node, "data-lanes", &state->num_lanes);
+	state->num_lanes_dt = state->num_lanes;
 
 	state->wclk_ext = of_property_read_bool(node, "csis-wclk");
 
+	state->src_node = of_graph_get_remote_port_parent(node);
+
 	of_node_put(node);
 	return 0;
 }
@@ -1567,7 +2807,7 @@ static int mipi_csis_subdev_init(struct v4l2_subdev *mipi_sd,
 	snprintf(mipi_sd->name, sizeof(mipi_sd->name), "%s.%d",
 		 CSIS_SUBDEV_NAME, state->index);
 	mipi_sd->entity.function = MEDIA_ENT_F_IO_V4L;
-	mipi_sd->flags |= V4L2_SUBDEV_FL_HAS_DEVNODE;
+	mipi_sd->flags |= V4L2_SUBDEV_FL_HAS_DEVNODE | V4L2_SUBDEV_FL_HAS_EVENTS;
 	mipi_sd->dev = &pdev->dev;
 
 	state->csis_fmt      = &mipi_csis_formats[0];
@@ -1950,6 +3190,7 @@ static int mipi_csis_probe(struct platform_device *pdev)
 
 	mutex_init(&state->lock);
 	spin_lock_init(&state->slock);
+	BLOCKING_INIT_NOTIFIER_HEAD(&state->fs_notifier);
 
 	state->pdev = pdev;
 	mipi_sd = &state->sd;
@@ -1963,62 +3204,69 @@ static int mipi_csis_probe(struct platform_device *pdev)
 	if (state->num_lanes == 0 || state->num_lanes > state->max_num_lanes) {
 		dev_err(dev, "Unsupported number of data lanes: %d (max. %d)\n",
 			state->num_lanes, state->max_num_lanes);
-		return -EINVAL;
+		ret = -EINVAL;
+		goto err_put_src;
 	}
 
 	ret = mipi_csis_phy_init(state);
 	if (ret < 0)
-		return ret;
+		goto err_put_src;
 
 	of_id = of_match_node(mipi_csis_of_match, dev->of_node);
 	if (!of_id || !of_id->data) {
 		dev_err(dev, "No match data for %s\n", dev_name(dev));
-		return -EINVAL;
+		ret = -EINVAL;
+		goto err_put_src;
 	}
 	state->pdata = of_id->data;
 
 	state->gasket = syscon_regmap_lookup_by_phandle(dev->of_node, "csi-gpr");
 	if (IS_ERR(state->gasket)) {
 		dev_err(dev, "failed to get csi gasket\n");
-		return PTR_ERR(state->gasket);
+		ret = PTR_ERR(state->gasket);
+		goto err_put_src;
 	}
 
 	ret = disp_mix_sft_parse_resets(state);
 	if (ret < 0)
-		return ret;
+		goto err_put_src;
 
 	if (state->pdata->use_mix_gpr) {
 		state->mix_gpr = syscon_regmap_lookup_by_phandle(dev->of_node, "gpr");
 		if (IS_ERR(state->mix_gpr)) {
 			dev_err(dev, "failed to get mix gpr\n");
-			return PTR_ERR(state->mix_gpr);
+			ret = PTR_ERR(state->mix_gpr);
+			goto err_put_src;
 		}
 	}
 
 	mem_res = platform_get_resource(pdev, IORESOURCE_MEM, 0);
 	state->regs = devm_ioremap_resource(dev, mem_res);
-	if (IS_ERR(state->regs))
-		return PTR_ERR(state->regs);
+	if (IS_ERR(state->regs)) {
+		ret = PTR_ERR(state->regs);
+		goto err_put_src;
+	}
 
 	state->irq = platform_get_irq(pdev, 0);
 	if (state->irq < 0) {
 		dev_err(dev, "Failed to get irq\n");
-		return state->irq;
+		ret = state->irq;
+		goto err_put_src;
 	}
 
 	ret = mipi_csis_clk_get(state);
 	if (ret < 0)
-		return ret;
+		goto err_put_src;
 
 	ret = disp_mix_clks_get(state);
 	if (ret < 0) {
 		dev_err(dev, "Failed to get disp mix clocks");
-		return ret;
+		goto err_put_src;
 	}
 
 	ret = mipi_csis_clk_enable(state);
 	if (ret < 0)
-		return ret;
+		goto err_put_src;
 
 	disp_mix_clks_enable(state, true);
 	disp_mix_sft_rstn(state, false);
@@ -2027,18 +3275,20 @@ static int mipi_csis_probe(struct platform_device *pdev)
 	disp_mix_clks_enable(state, false);
 	mipi_csis_clk_disable(state);
 
-	ret = devm_request_irq(dev, state->irq, mipi_csis_irq_handler, 0,
-			       dev_name(dev), state);
+	mipi_csis_init_event_map();
+	ret = devm_request_threaded_irq(dev, state->irq, mipi_csis_irq_handler,
+					mipi_csis_irq_thread, 0,
+					dev_name(dev), state);
 	if (ret) {
 		dev_err(dev, "Interrupt request failed\n");
-		return ret;
+		goto err_put_src;
 	}
 
 	platform_set_drvdata(pdev, state);
 	ret = mipi_csis_subdev_init(&state->sd, pdev, &mipi_csis_subdev_ops);
 	if (ret < 0) {
 		dev_err(dev, "mipi csi subdev init failed\n");
-		return ret;
+		goto err_put_src;
 	}
 
 	state->pads[MIPI_CSIS_VC0_PAD_SINK].flags = MEDIA_PAD_FL_SINK;
@@ -2052,18 +3302,44 @@ static int mipi_csis_probe(struct platform_device *pdev)
 	ret = media_entity_pads_init(&state->sd.entity, MIPI_CSIS_VCX_PADS_NUM, state->pads);
 	if (ret < 0) {
 		dev_err(dev, "mipi csi entity pad init failed\n");
-		return ret;
+		goto err_put_src;
 	}
 
-	memcpy(state->events, mipi_csis_events, sizeof(state->events));
 	state->sd.entity.ops = &mipi_csi2_sd_media_ops;
 
+	pm_runtime_set_autosuspend_delay(dev, autosuspend_ms);
+	pm_runtime_use_autosuspend(dev);
 	pm_runtime_enable(dev);
 
+	if (state->index < CSIS_MAX_ENTITIES)
+		mipi_csis_instances[state->index] = state;
+
+	mipi_csis_emb_init(state);
+
+	state->debugfs_dir = debugfs_create_dir(state->sd.name, NULL);
+	debugfs_create_file("stats", 0444, state->debugfs_dir, state,
+			    &mipi_csis_stats_fops);
+	debugfs_create_file("hs_settle", 0644, state->debugfs_dir, state,
+			    &mipi_csis_settle_fops);
+	debugfs_create_file("regs", 0444, state->debugfs_dir, state,
+			    &mipi_csis_regs_fops);
+
+	state->regs_snap = devm_kzalloc(dev, CSIS_SNAP_SIZE, GFP_KERNEL);
+	if (state->regs_snap) {
+		state->regs_blob.data = state->regs_snap;
+		state->regs_blob.size = CSIS_SNAP_SIZE;
+		debugfs_create_blob("regs_stream", 0444, state->debugfs_dir,
+				    &state->regs_blob);
+	}
+
 	dev_info(&pdev->dev, "lanes: %d, hs_settle: %d, clk_settle: %d, wclk: %d, freq: %u\n",
 		 state->num_lanes, state->hs_settle, state->clk_settle,
 		 state->wclk_ext, state->clk_frequency);
 	return 0;
+
+err_put_src:
+	of_node_put(state->src_node);
+	return ret;
 }
 
 static int mipi_csis_system_suspend(struct device *dev)
@@ -2073,8 +3349,15 @@ static int mipi_csis_system_suspend(struct device *dev)
 
 static int mipi_csis_system_resume(struct device *dev)
 {
+	struct csi_state *state = dev_get_drvdata(dev);
 	int ret;
 
+	/* only a stream running across the sleep restarts on its own */
+	mutex_lock(&state->lock);
+	if (state->streaming)
+		atomic64_set(&state->resume_ts, ktime_get_ns());
+	mutex_unlock(&state->lock);
+
 	ret = pm_runtime_force_resume(dev);
 	if (ret < 0) {
 		dev_err(dev, "force resume %s failed!\n", dev_name(dev));
@@ -2095,12 +3378,17 @@ static int mipi_csis_runtime_suspend(struct device *dev)
 
 	disp_mix_clks_enable(state, false);
 	mipi_csis_clk_disable(state);
+
+	state->pm_suspends++;
+	dev_dbg(dev, "runtime suspend\n");
 	return 0;
 }
 
 static int mipi_csis_runtime_resume(struct device *dev)
 {
 	struct csi_state *state = dev_get_drvdata(dev);
+	ktime_t start = ktime_get();
+	s64 us;
 	int ret;
 
 	ret = regulator_enable(state->mipi_phy_regulator);
@@ -2115,14 +3403,28 @@ static int mipi_csis_runtime_resume(struct device *dev)
 	disp_mix_sft_rstn(state, false);
 	mipi_csis_phy_reset(state);
 
+	us = ktime_us_delta(ktime_get(), start);
+	state->pm_resumes++;
+	state->pm_resume_max_us = max(state->pm_resume_max_us, us);
+	dev_dbg(dev, "runtime resume: %lld us\n", us);
 	return 0;
 }
 
 static int mipi_csis_remove(struct platform_device *pdev)
 {
 	struct csi_state *state = platform_get_drvdata(pdev);
+	unsigned long flags;
+
+	spin_lock_irqsave(&mipi_csis_fs_lock, flags);
+	if (state->index < CSIS_MAX_ENTITIES)
+		mipi_csis_instances[state->index] = NULL;
+	spin_unlock_irqrestore(&mipi_csis_fs_lock, flags);
 
+	debugfs_remove_recursive(state->debugfs_dir);
+	mipi_csis_emb_cleanup(state);
+	of_node_put(state->src_node);
 	media_entity_cleanup(&state->sd.entity);
+	pm_runtime_dont_use_autosuspend(&pdev->dev);
 	pm_runtime_disable(&pdev->dev);
 
 	return 0;
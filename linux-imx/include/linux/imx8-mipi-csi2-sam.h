@@ -0,0 +1,25 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Freescale i.MX8 MIPI CSIS in-kernel interface
+ */
+
+#ifndef __IMX8_MIPI_CSI2_SAM_H__
+#define __IMX8_MIPI_CSI2_SAM_H__
+
+#include <linux/notifier.h>
+#include <uapi/linux/imx8-mipi-csi2-sam.h>
+
+struct device;
+
+/*
+ * Frame start notifications for the sensor connected to a CSIS receiver.
+ * The notifier is called from the CSIS irq thread, it may sleep. The
+ * action is the frame sequence number and data points to the ktime_t
+ * frame start time.
+ */
+int mipi_csis_frame_sync_register(struct device *sensor,
+				  struct notifier_block *nb);
+void mipi_csis_frame_sync_unregister(struct device *sensor,
+				     struct notifier_block *nb);
+
+#endif /* __IMX8_MIPI_CSI2_SAM_H__ */
@@ -0,0 +1,94 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+/*
+ * Freescale i.MX8 MIPI CSIS embedded data ring and register snapshots
+ *
+ * The ring is exported read-only by the /dev/csis-embN misc device of
+ * each CSIS receiver and mapped with mmap(). The driver fills one slot
+ * per non-image data packet, normally the embedded lines of a frame. The
+ * non-image data interrupts are enabled at stream on when the device is
+ * open, so open it before starting the stream.
+ */
+
+#ifndef __UAPI_IMX8_MIPI_CSI2_SAM_H__
+#define __UAPI_IMX8_MIPI_CSI2_SAM_H__
+
+#include <linux/types.h>
+
+#define CSIS_EMB_RING_SLOTS		8
+#define CSIS_EMB_DATA_SIZE		4096
+
+/**
+ * struct csis_emb_slot - embedded data of one frame
+ * @seq: odd while the driver writes the slot, read it before and after
+ *       copying the slot and retry if it changed or was odd
+ * @sequence: frame sequence number, counted from stream on
+ * @timestamp: frame start time, CLOCK_MONOTONIC in ns
+ * @len: number of valid bytes in @data
+ * @data: embedded data as received by the CSIS
+ */
+struct csis_emb_slot {
+	__u32 seq;
+	__u32 sequence;
+	__u64 timestamp;
+	__u32 len;
+	__u32 reserved;
+	__u8 data[CSIS_EMB_DATA_SIZE];
+};
+
+/**
+ * struct csis_emb_ring - embedded data ring mapped to user space
+ * @head: number of slots written since stream on, the last written slot
+ *        is slot[(head - 1) % CSIS_EMB_RING_SLOTS]
+ * @num_slots: CSIS_EMB_RING_SLOTS
+ * @slot_size: sizeof(struct csis_emb_slot)
+ * @slot: the ring slots
+ */
+struct csis_emb_ring {
+	__u32 head;
+	__u32 num_slots;
+	__u32 slot_size;
+	__u32 reserved;
+	struct csis_emb_slot slot[CSIS_EMB_RING_SLOTS];
+};
+
+/*
+ * Register snapshots of a CSIS receiver and its ISP gasket, read from the
+ * "regs" (current values) and "regs_stream" (taken at the last stream on)
+ * debugfs files of the receiver.
+ */
+#define CSIS_REGS_MAGIC			0x53474552	/* "REGS" */
+
+#define CSIS_REGS_BANK_CSIS		0
+#define CSIS_REGS_BANK_GASKET		1
+
+/**
+ * struct csis_reg_value - value of one register
+ * @bank: CSIS_REGS_BANK_CSIS or CSIS_REGS_BANK_GASKET
+ * @offset: register offset in the bank
+ * @value: register value
+ */
+struct csis_reg_value {
+	__u16 bank;
+	__u16 offset;
+	__u32 value;
+};
+
+/**
+ * struct csis_regs_snapshot - register snapshot header
+ * @magic: CSIS_REGS_MAGIC
+ * @num_regs: number of entries in @regs
+ * @timestamp: snapshot time, CLOCK_MONOTONIC in ns
+ * @stream_count: number of stream starts before the snapshot
+ * @reserved: zero
+ * @regs: register values
+ */
+struct csis_regs_snapshot {
+	__u32 magic;
+	__u32 num_regs;
+	__u64 timestamp;
+	__u32 stream_count;
+	__u32 reserved;
+	struct csis_reg_value regs[];
+};
+
+#endif /* __UAPI_IMX8_MIPI_CSI2_SAM_H__ */
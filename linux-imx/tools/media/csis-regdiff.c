@@ -0,0 +1,243 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * csis-regdiff - decode and compare i.MX8 MIPI CSIS register snapshots
+ *
+ * Copyright (c) 2024, Framos. All rights reserved.
+ *
+ * The snapshots are read from the debugfs directory of a CSIS receiver:
+ *
+ *   regs          current register values
+ *   regs_stream   register values taken at the last stream on
+ *
+ * Save the snapshot of a known good stream start and compare it with
+ * the one of a failing mode:
+ *
+ *   cp /sys/kernel/debug/<csis>/regs_stream good.bin
+ *   ... change mode, start streaming ...
+ *   csis-regdiff good.bin /sys/kernel/debug/<csis>/regs_stream
+ *
+ * With a single snapshot all registers are printed. Build with:
+ *
+ *   $CC -O2 -Wall -I<linux-imx>/include/uapi -o csis-regdiff csis-regdiff.c
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <linux/imx8-mipi-csi2-sam.h>
+
+#define MAX_REGS	256
+
+struct snapshot {
+	struct csis_regs_snapshot hdr;
+	struct csis_reg_value regs[MAX_REGS];
+};
+
+struct reg_desc {
+	unsigned int bank;
+	unsigned int offset;
+	const char *name;
+	void (*decode)(unsigned int val, char *buf, size_t len);
+};
+
+static void decode_cmn_ctrl(unsigned int val, char *buf, size_t len)
+{
+	snprintf(buf, len, "lanes %u, enable %u",
+		 ((val >> 8) & 0x3) + 1, val & 0x1);
+}
+
+static void decode_dphyctrl(unsigned int val, char *buf, size_t len)
+{
+	snprintf(buf, len, "hs_settle %u, clk_settle %u, lane enable 0x%02x",
+		 val >> 24, (val >> 22) & 0x3, val & 0x1f);
+}
+
+static void decode_ispconfig(unsigned int val, char *buf, size_t len)
+{
+	snprintf(buf, len, "vc %u, dt 0x%02x, align32 %u, pixel mode %u",
+		 val & 0x3, (val >> 2) & 0x3f, (val >> 11) & 0x1,
+		 (val >> 12) & 0x3);
+}
+
+static void decode_ispresol(unsigned int val, char *buf, size_t len)
+{
+	snprintf(buf, len, "%ux%u", val & 0xffff, val >> 16);
+}
+
+static void decode_gasket_ctrl(unsigned int val, char *buf, size_t len)
+{
+	snprintf(buf, len, "dt 0x%02x, dual comp %u, enable %u",
+		 (val >> 8) & 0x3f, (val >> 1) & 0x1, val & 0x1);
+}
+
+static const struct reg_desc reg_descs[] = {
+	{ CSIS_REGS_BANK_CSIS, 0x00, "CSIS_VERSION", NULL },
+	{ CSIS_REGS_BANK_CSIS, 0x04, "CSIS_CMN_CTRL", decode_cmn_ctrl },
+	{ CSIS_REGS_BANK_CSIS, 0x08, "CSIS_CLK_CTRL", NULL },
+	{ CSIS_REGS_BANK_CSIS, 0x10, "CSIS_INTMSK", NULL },
+	{ CSIS_REGS_BANK_CSIS, 0x14, "CSIS_INTSRC", NULL },
+	{ CSIS_REGS_BANK_CSIS, 0x20, "CSIS_DPHYSTATUS", NULL },
+	{ CSIS_REGS_BANK_CSIS, 0x24, "CSIS_DPHYCTRL", decode_dphyctrl },
+	{ CSIS_REGS_BANK_CSIS, 0x30, "CSIS_DPHYBCTRL_L", NULL },
+	{ CSIS_REGS_BANK_CSIS, 0x34, "CSIS_DPHYBCTRL_H", NULL },
+	{ CSIS_REGS_BANK_CSIS, 0x38, "CSIS_DPHYSCTRL_L", NULL },
+	{ CSIS_REGS_BANK_CSIS, 0x3c, "CSIS_DPHYSCTRL_H", NULL },
+	{ CSIS_REGS_BANK_CSIS, 0x40, "CSIS_ISPCONFIG_CH0", decode_ispconfig },
+	{ CSIS_REGS_BANK_CSIS, 0x50, "CSIS_ISPCONFIG_CH1", decode_ispconfig },
+	{ CSIS_REGS_BANK_CSIS, 0x60, "CSIS_ISPCONFIG_CH2", decode_ispconfig },
+	{ CSIS_REGS_BANK_CSIS, 0x70, "CSIS_ISPCONFIG_CH3", decode_ispconfig },
+	{ CSIS_REGS_BANK_CSIS, 0x44, "CSIS_ISPRESOL_CH0", decode_ispresol },
+	{ CSIS_REGS_BANK_CSIS, 0x54, "CSIS_ISPRESOL_CH1", decode_ispresol },
+	{ CSIS_REGS_BANK_CSIS, 0x64, "CSIS_ISPRESOL_CH2", decode_ispresol },
+	{ CSIS_REGS_BANK_CSIS, 0x74, "CSIS_ISPRESOL_CH3", decode_ispresol },
+	{ CSIS_REGS_BANK_CSIS, 0x48, "CSIS_ISPSYNC_CH0", NULL },
+	{ CSIS_REGS_BANK_CSIS, 0x58, "CSIS_ISPSYNC_CH1", NULL },
+	{ CSIS_REGS_BANK_CSIS, 0x68, "CSIS_ISPSYNC_CH2", NULL },
+	{ CSIS_REGS_BANK_CSIS, 0x78, "CSIS_ISPSYNC_CH3", NULL },
+	{ CSIS_REGS_BANK_GASKET, 0x00, "GPR_GASKET_0_CTRL", decode_gasket_ctrl },
+	{ CSIS_REGS_BANK_GASKET, 0x04, "GPR_GASKET_0_HSIZE", NULL },
+	{ CSIS_REGS_BANK_GASKET, 0x08, "GPR_GASKET_0_VSIZE", NULL },
+};
+
+static const struct reg_desc *find_desc(const struct csis_reg_value *reg)
+{
+	unsigned int i;
+
+	for (i = 0; i < sizeof(reg_descs) / sizeof(reg_descs[0]); i++) {
+		if (reg_descs[i].bank == reg->bank &&
+		    reg_descs[i].offset == reg->offset)
+			return &reg_descs[i];
+	}
+
+	return NULL;
+}
+
+static int load(const char *path, struct snapshot *snap)
+{
+	size_t len, need;
+	FILE *f;
+
+	f = fopen(path, "rb");
+	if (!f) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	memset(snap, 0, sizeof(*snap));
+	len = fread(snap, 1, sizeof(*snap), f);
+	fclose(f);
+
+	if (len < sizeof(snap->hdr) || snap->hdr.magic != CSIS_REGS_MAGIC) {
+		fprintf(stderr, "%s: not a CSIS register snapshot\n", path);
+		return -1;
+	}
+
+	need = sizeof(snap->hdr) + snap->hdr.num_regs * sizeof(snap->regs[0]);
+	if (snap->hdr.num_regs > MAX_REGS || len < need) {
+		fprintf(stderr, "%s: truncated snapshot\n", path);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void print_reg(const char *tag, const struct csis_reg_value *reg)
+{
+	const struct reg_desc *desc = find_desc(reg);
+	char name[32], fields[96] = "";
+
+	if (desc) {
+		snprintf(name, sizeof(name), "%s", desc->name);
+		if (desc->decode)
+			desc->decode(reg->value, fields, sizeof(fields));
+	} else {
+		snprintf(name, sizeof(name), "%s[0x%02x]",
+			 reg->bank == CSIS_REGS_BANK_GASKET ? "GASKET" : "CSIS",
+			 reg->offset);
+	}
+
+	printf("%s%-20s 0x%08x  %s\n", tag, name, reg->value, fields);
+}
+
+static void print_header(const char *path, const struct snapshot *snap)
+{
+	printf("%s: stream %u, %llu.%06llu s\n", path, snap->hdr.stream_count,
+	       (unsigned long long)snap->hdr.timestamp / 1000000000ULL,
+	       (unsigned long long)snap->hdr.timestamp % 1000000000ULL / 1000);
+}
+
+static const struct csis_reg_value *lookup(const struct snapshot *snap,
+					   const struct csis_reg_value *reg)
+{
+	unsigned int i;
+
+	for (i = 0; i < snap->hdr.num_regs; i++) {
+		if (snap->regs[i].bank == reg->bank &&
+		    snap->regs[i].offset == reg->offset)
+			return &snap->regs[i];
+	}
+
+	return NULL;
+}
+
+/* Interrupt source and PHY status change with every frame */
+static int volatile_reg(const struct csis_reg_value *reg)
+{
+	return reg->bank == CSIS_REGS_BANK_CSIS &&
+	       (reg->offset == 0x14 || reg->offset == 0x20);
+}
+
+int main(int argc, char **argv)
+{
+	static struct snapshot a, b;
+	const struct csis_reg_value *other;
+	unsigned int i, diffs = 0;
+
+	if (argc < 2 || argc > 3) {
+		fprintf(stderr, "usage: %s SNAPSHOT [SNAPSHOT]\n", argv[0]);
+		return 2;
+	}
+
+	if (load(argv[1], &a))
+		return 2;
+
+	print_header(argv[1], &a);
+
+	if (argc == 2) {
+		for (i = 0; i < a.hdr.num_regs; i++)
+			print_reg("  ", &a.regs[i]);
+		return 0;
+	}
+
+	if (load(argv[2], &b))
+		return 2;
+
+	print_header(argv[2], &b);
+
+	for (i = 0; i < a.hdr.num_regs; i++) {
+		other = lookup(&b, &a.regs[i]);
+		if (volatile_reg(&a.regs[i]) ||
+		    (other && other->value == a.regs[i].value))
+			continue;
+
+		print_reg("- ", &a.regs[i]);
+		if (other)
+			print_reg("+ ", other);
+		diffs++;
+	}
+
+	for (i = 0; i < b.hdr.num_regs; i++) {
+		if (lookup(&a, &b.regs[i]))
+			continue;
+
+		print_reg("+ ", &b.regs[i]);
+		diffs++;
+	}
+
+	if (!diffs)
+		printf("no differences\n");
+
+	return diffs ? 1 : 0;
+}